@@ -0,0 +1,354 @@
+/*
+ * Class: bufferlist
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      The documents open in an editor, each with its own cursor and view.
+ *      All of them draw their lines from the same linepool and are drawn
+ *      through the same tout buffer, so a second buffer costs its own text
+ *      and little else.  Switching only changes which one is current.
+ *
+ *      Big files can be loaded in the background (see loader.h); the lines
+ *      come in through collect(), which the editor calls whenever
+ *      loadingFd() becomes readable.  With keepIndexes(), a big file gets an
+ *      index (see sidecar.h) once it's loaded; opening it again attaches
+ *      the document to the lines indexed, so only lines added to the file
+ *      since are loaded, and the user is put back where they were.
+ */
+
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "document.h"
+#include "clipboard.h"
+#include "highlighter.h"
+#include "loader.h"
+#include "sidecar.h"
+
+using namespace std;
+
+/**
+ * One open document and where the user is in it.
+ */
+struct buffer {
+   document file;
+   string filename;
+   size_t savedRevision;
+   highlighter highlight;
+   unique_ptr<loader> loading; // while the file is still being read
+   unique_ptr<sidecar> index; // the file's index, while it holds
+
+   size_t startLine;
+   size_t startCursor; // for use when line length exceeds terminal width, will be a multiple of the screen width
+   size_t virtualCursorLine;
+   size_t virtualCursorChar;
+
+   // selection runs from the anchor to the cursor, in either direction
+   bool selecting;
+   textpos anchor;
+
+   buffer() {
+      savedRevision = 0;
+      startLine = startCursor = 0;
+      virtualCursorLine = virtualCursorChar = 0;
+      selecting = false;
+      anchor = {0, 0};
+   }
+
+   bool modified() const {
+      return file.revision != savedRevision;
+   }
+};
+
+class bufferlist {
+   private:
+      vector<unique_ptr<buffer>> buffers;
+      size_t active;
+      int wake[2]; // the loaders write to one end, the editor polls the other
+
+      // where indexes are kept ("" for nowhere), and the width of the screen
+      string indexDir;
+      size_t indexWidth;
+
+      void loaded(buffer&);
+      sidecarposition position(const buffer&) const;
+
+   public:
+      bufferlist();
+
+      size_t size() const;
+      size_t index() const;
+      buffer& current();
+      buffer& at(const size_t);
+
+      buffer& add(const string&, const bool progressive = false);
+      bool select(const size_t);
+      size_t find(const string&) const;
+
+      int loadingFd() const;
+      bool collect();
+      void finishLoading();
+
+      bool keepIndexes(const string&, const size_t);
+      void rememberPositions();
+      void dropIndex(buffer&, const string&);
+};
+
+/**
+ * @constructs bufferlist
+ * Starts with no buffers; the editor adds the first one.
+ */
+bufferlist::bufferlist() {
+   active = 0;
+   indexWidth = 0;
+   if (pipe(wake) == 0) {
+      for (int end : wake) fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+   } else {
+      wake[0] = wake[1] = -1;
+   }
+}
+
+/**
+ * @method size
+ * @returns {size_t} the number of open buffers.
+ */
+size_t bufferlist::size() const {
+   return buffers.size();
+}
+
+/**
+ * @method index
+ * @returns {size_t} the index of the current buffer.
+ */
+size_t bufferlist::index() const {
+   return active;
+}
+
+/**
+ * @method current
+ * @returns {buffer&} the buffer being edited.
+ */
+buffer& bufferlist::current() {
+   return *buffers.at(active);
+}
+
+/**
+ * @method at
+ * @param {const size_t} i - the index of a buffer
+ * @returns {buffer&} that buffer.
+ */
+buffer& bufferlist::at(const size_t i) {
+   return *buffers.at(i);
+}
+
+/**
+ * @method add
+ * Opens a new buffer and makes it current.  If the file can't be read the
+ * buffer starts out blank (but keeps the name, for saving).
+ * @param {const string&} filename - the file to load ("" for none)
+ * @param {const bool} progressive - true to load a big file in the background
+ * @returns {buffer&} the new buffer.
+ */
+buffer& bufferlist::add(const string& filename, const bool progressive) {
+   buffers.emplace_back(new buffer());
+   active = buffers.size() - 1;
+
+   buffer& b = *buffers.back();
+   b.filename = filename;
+
+   struct stat info;
+   if (progressive && (wake[1] >= 0) && !filename.empty() && (stat(filename.c_str(), &info) == 0) && (info.st_size > LOADER_THRESHOLD)) {
+      // the lines an index from before has are attached, and only the rest is loaded
+      off_t from = 0;
+      if (!indexDir.empty()) {
+         b.index.reset(new sidecar());
+         vector<off_t> starts;
+         if (b.index->open(indexDir, filename)) {
+            b.index->starts(COLD_BLOCK_LINES, starts);
+            if (b.file.attach(filename, info, starts, b.index->lines(), b.index->indexedBytes())) {
+               from = b.index->indexedBytes();
+            } else {
+               b.index->close();
+            }
+         }
+      }
+
+      b.loading.reset(new loader());
+      if (!b.loading->start(filename, b.file, wake[1], from, !indexDir.empty())) b.loading.reset();
+
+      if (b.index && b.index->valid() && !b.file.empty()) {
+         sidecarposition where = b.index->position();
+         b.startLine = min(where.startLine, b.file.size() - 1);
+         b.virtualCursorLine = min(max(where.cursorLine, b.startLine), b.file.size() - 1);
+         b.virtualCursorChar = min(where.cursorChar, b.file.at(b.virtualCursorLine).length());
+         if ((where.width == indexWidth) && (where.startCursor < b.file.at(b.startLine).length())) b.startCursor = where.startCursor;
+      }
+   }
+
+   // with a loader, the first few KB are in and the rest comes through collect()
+   if (!b.loading && (filename.empty() || !b.file.load(filename))) {
+      b.file.clear();
+      b.file.insert(0, "");
+   }
+   b.savedRevision = b.file.revision;
+   b.highlight.choose(filename, b.file);
+   return b;
+}
+
+/**
+ * @method select
+ * Makes another buffer current.
+ * @param {const size_t} i - the index of the buffer
+ * @returns {bool} false if there is no such buffer.
+ */
+bool bufferlist::select(const size_t i) {
+   if (i >= buffers.size()) return false;
+   active = i;
+   return true;
+}
+
+/**
+ * @method find
+ * @param {const string&} filename - the file to look for
+ * @returns {size_t} the index of the buffer with that file, or size() if none.
+ */
+size_t bufferlist::find(const string& filename) const {
+   for (size_t i = 0; i < buffers.size(); i++) {
+      if (!filename.empty() && (buffers[i]->filename == filename)) return i;
+   }
+   return buffers.size();
+}
+
+/**
+ * @method loadingFd
+ * @returns {int} a descriptor that becomes readable when there are lines to
+ * collect(), or -1 if nothing is loading.
+ */
+int bufferlist::loadingFd() const {
+   for (const unique_ptr<buffer>& b : buffers) {
+      if (b->loading) return wake[0];
+   }
+   return -1;
+}
+
+/**
+ * @method collect
+ * Moves the lines loaded in the background into their documents.  Loading
+ * doesn't count as a modification.
+ * @returns {bool} true if the current buffer got any.
+ */
+bool bufferlist::collect() {
+   char drained[256];
+   while (read(wake[0], drained, sizeof drained) > 0) {}
+
+   bool changed = false;
+   for (size_t i = 0; i < buffers.size(); i++) {
+      buffer& b = *buffers[i];
+      if (!b.loading) continue;
+
+      bool unmodified = !b.modified();
+      if (b.loading->collect(b.file) > 0) {
+         if (unmodified) b.savedRevision = b.file.revision;
+         changed = changed || (i == active);
+      }
+      if (b.loading->done()) {
+         loaded(b);
+         b.loading.reset();
+      }
+   }
+   return changed;
+}
+
+/**
+ * @method finishLoading
+ * Waits for every background load to finish and collects all of it, for
+ * when the whole file is needed (saving, for one).
+ */
+void bufferlist::finishLoading() {
+   for (const unique_ptr<buffer>& b : buffers) {
+      if (b->loading) {
+         bool unmodified = !b->modified();
+         b->loading->finish(b->file);
+         loaded(*b);
+         b->loading.reset();
+         if (unmodified) b->savedRevision = b->file.revision;
+      }
+   }
+}
+
+/**
+ * @method keepIndexes
+ * Indexes big files as they're loaded, for opening them again quickly.
+ * @param {const string&} dir - the directory to keep the indexes in (made if it isn't there)
+ * @param {const size_t} width - the width of the screen
+ * @returns {bool} true if the directory is there.
+ */
+bool bufferlist::keepIndexes(const string& dir, const size_t width) {
+   struct stat info;
+   if ((stat(dir.c_str(), &info) != 0) && (mkdir(dir.c_str(), 0700) != 0)) return false;
+   indexDir = dir;
+   indexWidth = width;
+   return true;
+}
+
+/**
+ * @method rememberPositions
+ * Writes where the user is in every file with an index into the index.
+ */
+void bufferlist::rememberPositions() {
+   for (const unique_ptr<buffer>& b : buffers) {
+      if (b->index && b->index->valid()) b->index->remember(position(*b));
+   }
+}
+
+/**
+ * @method dropIndex
+ * Forgets the index of a buffer that was just saved; if it was saved over
+ * the file indexed, the index is deleted, since it doesn't hold any more.
+ * @param {buffer&} b - the buffer
+ * @param {const string&} written - the file it was saved to
+ */
+void bufferlist::dropIndex(buffer& b, const string& written) {
+   if (b.index && b.index->valid()) {
+      string path = sidecar::location(indexDir, b.filename);
+      if (path == sidecar::location(indexDir, written)) unlink(path.c_str());
+   }
+   b.index.reset();
+}
+
+/**
+ * @private
+ * @method loaded
+ * Writes the index of a buffer that has just been loaded in full, if it
+ * has lines the index didn't have (or there wasn't one).
+ * @param {buffer&} b - the buffer
+ */
+void bufferlist::loaded(buffer& b) {
+   if (indexDir.empty() || (b.index && b.index->valid() && (b.loading->indexedLines() == 0))) return;
+   if (sidecar::write(indexDir, b.filename, b.index.get(), b.loading->index(), b.loading->indexedLines(), b.loading->readTo(), position(b))) {
+      if (!b.index) b.index.reset(new sidecar());
+      b.index->open(indexDir, b.filename);
+   }
+}
+
+/**
+ * @private
+ * @method position
+ * @param {const buffer&} b - a buffer
+ * @returns {sidecarposition} where the user is in it.
+ */
+sidecarposition bufferlist::position(const buffer& b) const {
+   return { indexWidth, b.startLine, b.startCursor, b.virtualCursorLine, b.virtualCursorChar };
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Class: clipboard
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Copy, cut and paste for a document.  The clipboard never copies the
+ *      text it holds; it keeps references to the document's lines plus where
+ *      the copied range starts in the first line and ends in the last one.
+ *      Since edited lines are cloned by the document, the references keep
+ *      seeing the text exactly as it was when it was copied.  Lines of the
+ *      document that are kept compressed stay that way: whole blocks of them
+ *      are shared, compressed text and all, without being thawed.
+ */
+
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+/**
+ * A position within a document.  chr may be equal to the length of the
+ * line (the append position).
+ */
+struct textpos {
+   size_t line;
+   size_t chr;
+};
+
+bool operator<(const textpos& a, const textpos& b) {
+   return (a.line < b.line) || ((a.line == b.line) && (a.chr < b.chr));
+}
+
+bool operator==(const textpos& a, const textpos& b) {
+   return (a.line == b.line) && (a.chr == b.chr);
+}
+
+bool operator!=(const textpos& a, const textpos& b) {
+   return !(a == b);
+}
+
+class clipboard {
+   private:
+      vector<lineref> lines;
+      vector<coldblock> cold; // the blocks the NULL lines are in, numbered from lines[1]
+      size_t headOffset; // where the copied text starts in lines.front()
+      size_t tailLength; // where the copied text ends in lines.back()
+
+   public:
+      clipboard();
+
+      bool empty() const;
+      size_t lineCount() const;
+      string text() const;
+
+      void copy(const document&, const textpos, const textpos);
+      void cut(document&, const textpos, const textpos);
+      textpos paste(document&, const textpos) const;
+};
+
+/**
+ * @constructs clipboard
+ */
+clipboard::clipboard() {
+   headOffset = 0;
+   tailLength = 0;
+}
+
+/**
+ * @method empty
+ * @returns {bool} true if nothing has been copied yet.
+ */
+bool clipboard::empty() const {
+   return lines.empty();
+}
+
+/**
+ * @method lineCount
+ * @returns {size_t} the number of lines touched by the copied text.
+ */
+size_t clipboard::lineCount() const {
+   return lines.size();
+}
+
+/**
+ * @method text
+ * Builds the copied text as a single string, with lines separated by '\n'.
+ * This one does copy, so keep it away from large blocks.
+ * @returns {string} the copied text.
+ */
+string clipboard::text() const {
+   if (lines.empty()) return "";
+   if (lines.size() == 1) return lines.front()->substr(headOffset, tailLength - headOffset);
+
+   string result = lines.front()->substr(headOffset);
+   string raw;
+   size_t b = 0;
+   for (size_t i = 1; i < lines.size() - 1; i++) {
+      result += '\n';
+      if (lines[i]) {
+         result += *lines[i];
+         continue;
+      }
+
+      // a compressed block, all at once
+      const coldblock& block = cold[b++];
+      if (!lzDecompress(*block.packed, block.rawBytes, raw)) {
+         throw runtime_error("clipboard: a compressed block is corrupt");
+      }
+      result += raw;
+      i += block.count - 1;
+   }
+   result += '\n';
+   result += lines.back()->substr(0, tailLength);
+   return result;
+}
+
+/**
+ * @method copy
+ * Remembers the text in [from, to).  Costs one pointer per line, and
+ * compressed blocks in between aren't thawed.
+ * @param {const document&} doc - the document to copy from
+ * @param {const textpos} from - the first character to copy
+ * @param {const textpos} to - one past the last character to copy
+ */
+void clipboard::copy(const document& doc, const textpos from, const textpos to) {
+   cold.clear();
+   if (from.line == to.line) {
+      lines.assign(1, doc.ref(from.line));
+   } else {
+      vector<lineref> middle = doc.refs(from.line + 1, to.line, cold);
+      lines.clear();
+      lines.reserve(middle.size() + 2);
+      lines.push_back(doc.ref(from.line));
+      lines.insert(lines.end(), make_move_iterator(middle.begin()), make_move_iterator(middle.end()));
+      lines.push_back(doc.ref(to.line));
+   }
+   headOffset = from.chr;
+   tailLength = to.chr;
+}
+
+/**
+ * @method cut
+ * Copies the text in [from, to), then removes it from the document.
+ * The lines in between are dropped with a single erase, and only the first
+ * line is rewritten.
+ * @param {document&} doc - the document to cut from
+ * @param {const textpos} from - the first character to cut
+ * @param {const textpos} to - one past the last character to cut
+ */
+void clipboard::cut(document& doc, const textpos from, const textpos to) {
+   copy(doc, from, to);
+
+   if (from.line == to.line) {
+      doc.edit(from.line).erase(from.chr, to.chr - from.chr);
+   } else {
+      string joined = doc.at(from.line).substr(0, from.chr);
+      joined.append(doc.at(to.line), to.chr, string::npos);
+      doc.edit(from.line) = move(joined);
+      doc.erase(from.line + 1, to.line + 1);
+   }
+}
+
+/**
+ * @method paste
+ * Inserts the copied text at the provided position.  Whole lines are
+ * shared with the clipboard instead of being copied; only the first and
+ * last lines, which get merged with the text around the cursor, are built.
+ * @param {document&} doc - the document to paste into
+ * @param {const textpos} at - where to paste
+ * @returns {textpos} the position just after the pasted text.
+ */
+textpos clipboard::paste(document& doc, const textpos at) const {
+   if (lines.empty()) return at;
+
+   if (lines.size() == 1) {
+      doc.edit(at.line).insert(at.chr, *lines.front(), headOffset, tailLength - headOffset);
+      return { at.line, at.chr + (tailLength - headOffset) };
+   }
+
+   // split the current line around the cursor
+   string after = doc.at(at.line).substr(at.chr);
+   string& first = doc.edit(at.line);
+   first.erase(at.chr);
+   first.append(*lines.front(), headOffset, string::npos);
+
+   // whole lines in the middle are shared
+   doc.insertRefs(at.line + 1, lines.begin() + 1, lines.end() - 1, cold);
+
+   // the last line gets what was after the cursor
+   size_t lastLine = at.line + lines.size() - 1;
+   string last = lines.back()->substr(0, tailLength);
+   last.append(after);
+   doc.insert(lastLine, move(last));
+
+   return { lastLine, tailLength };
+}
+
+#endif
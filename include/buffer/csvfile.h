@@ -0,0 +1,830 @@
+/*
+ * Class: csvfile
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A CSV (or TSV) file being edited, for the table editor.  The file is
+ *      mmap()ed and never parsed as a whole: a thread finds where each row
+ *      starts (minding quoted fields with newlines in them), and fields are
+ *      only split out of the rows that are asked for, which are the ones on
+ *      screen.  Row offsets are kept in chunks of CSVFILE_CHUNK, so the
+ *      index grows without being copied; the thread publishes how many rows
+ *      it has done with an atomic store, and rows below that can be read
+ *      while it carries on.  Once every row is indexed the same thread goes
+ *      through them again, a piece per core, for the widest field of each
+ *      column, which the grid is laid out with from then on.
+ *
+ *      Edits go into an overlay of whole rows (by row number in the file),
+ *      and sorting only builds an order to show the rows in.  Sorting,
+ *      summing and finding run over a column across the cores, with
+ *      parallel.h.  save() streams the rows, in the order shown, into a new
+ *      file that then takes the place of the old one (a savefile); rows
+ *      that weren't edited are copied as they were.  If another process
+ *      cuts the file short, the mapping reads zeros past the new end instead
+ *      of taking SIGBUS (mapguard.h), and the rows are no longer saved.
+ */
+
+#ifndef CSVFILE_H
+#define CSVFILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../misc/parallel.h"
+#include "../misc/mapguard.h"
+#include "../misc/savefile.h"
+
+using namespace std;
+
+// row offsets per chunk of the index, which is also how many rows the
+// thread indexes between wake-ups (after the first CSVFILE_FIRST, a screen
+// or so, which it wakes up for right away)
+#define CSVFILE_CHUNK 65536
+#define CSVFILE_FIRST 256
+// fields wider than this are cut short on screen (and so are columns)
+#define CSVFILE_MAX_WIDTH 32
+// how much save() writes at a time
+#define CSVFILE_WRITE_BUFFER 65536
+// how long to sleep while waiting for the index
+#define CSVFILE_WAIT_US 1000
+
+/**
+ * What the grid needs to know about a column.
+ */
+struct csvcolumn {
+   size_t width;  // the widest field, up to CSVFILE_MAX_WIDTH
+   bool numeric;  // every field that isn't empty is a number
+};
+
+class csvfile {
+   private:
+      string filename;
+      int fd;
+      char delimiter;
+      string lineEnd; // what ends the rows of the file ("\r\n" or "\n")
+      const char* data;
+      size_t length;
+      mapguard guard;
+
+      // where rows start, in chunks; there's room for the most chunks the
+      // file could need, so the thread never moves them
+      vector<unique_ptr<size_t[]>> chunks;
+      atomic<size_t> indexedRows;
+      atomic<bool> indexDone;
+      atomic<bool> statsDone;
+      atomic<bool> cancelled;
+      pthread_t thread;
+      bool threaded;
+      int wake[2]; // written to as rows are indexed and when the stats are in
+
+      mutable mutex columnLock;
+      vector<csvcolumn> columnStats;
+
+      map<size_t, vector<string>> edits; // rows changed, by row number in the file
+      vector<size_t> order; // rows in the order shown (empty: as in the file)
+
+      static void* run(void*);
+      void index();
+      void gatherStats();
+      void signal();
+
+      size_t rowStart(const size_t) const;
+      size_t rowEnd(const size_t) const;
+      size_t rowNext(const size_t) const;
+      bool rawField(const size_t, const size_t, string_view&, string&) const;
+      void waitIndexed() const;
+
+   public:
+      csvfile();
+      ~csvfile();
+
+      bool open(const string&);
+      void close();
+
+      int wakeFd() const;
+      void drain();
+
+      size_t rows() const;
+      bool indexed() const;
+      bool measured() const;
+      char separator() const;
+      bool truncated() const;
+      size_t fileRow(const size_t) const;
+
+      void fields(const size_t, const size_t, vector<string>&) const;
+      string field(const size_t, const size_t) const;
+      void set(const size_t, const size_t, const string&);
+      bool modified() const;
+      vector<csvcolumn> columns() const;
+
+      void sort(const size_t, const bool);
+      bool sum(const size_t, double&, size_t&) const;
+      bool find(const size_t, const string&, const size_t, size_t&) const;
+      bool save();
+};
+
+/**
+ * @function csvNumber
+ * @param {string_view} text - a field
+ * @param {double&} number - set to the number, if it is one
+ * @returns {bool} true if the whole field (spaces aside) is a number.
+ */
+bool csvNumber(string_view text, double& number) {
+   while (!text.empty() && (text.front() == ' ')) text.remove_prefix(1);
+   while (!text.empty() && (text.back() == ' ')) text.remove_suffix(1);
+   if (text.empty() || (text.length() > 64)) return false;
+   char digits[65];
+   memcpy(digits, text.data(), text.length());
+   digits[text.length()] = '\0';
+   char* end;
+   number = strtod(digits, &end);
+   return (end == digits + text.length());
+}
+
+/**
+ * @constructs csvfile
+ * Starts out with no file.
+ */
+csvfile::csvfile() : indexedRows(0), indexDone(false), statsDone(false), cancelled(false) {
+   fd = -1;
+   delimiter = ',';
+   data = NULL;
+   length = 0;
+   threaded = false;
+   if (pipe(wake) == 0) {
+      for (int end : wake) fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+   } else {
+      wake[0] = wake[1] = -1;
+   }
+}
+
+/**
+ * Stops the thread and lets go of the file; unsaved changes are lost.
+ */
+csvfile::~csvfile() {
+   close();
+   for (int end : wake) if (end >= 0) ::close(end);
+}
+
+/**
+ * @method open
+ * Maps a file and starts indexing its rows.  Tabs separate the fields of
+ * .tsv files, and of files whose first row has tabs and no commas; commas
+ * separate them otherwise.
+ * @param {const string&} name - the file
+ * @returns {bool} true if the file could be mapped.
+ */
+bool csvfile::open(const string& name) {
+   close();
+   filename = name;
+   fd = ::open(name.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   struct stat info;
+   if ((fstat(fd, &info) != 0) || !S_ISREG(info.st_mode)) {
+      close();
+      return false;
+   }
+   length = info.st_size;
+   if (length > 0) {
+      void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+         close();
+         return false;
+      }
+      data = static_cast<const char*>(mapped);
+      guard.watch(data, length);
+   }
+
+   const char* newline = length ? static_cast<const char*>(memchr(data, '\n', length)) : NULL;
+   string_view first(data, newline ? newline - data : length);
+   bool tsv = (name.length() > 4) && (name.compare(name.length() - 4, 4, ".tsv") == 0);
+   delimiter = (tsv || ((first.find('\t') != string::npos) && (first.find(',') == string::npos))) ? '\t' : ',';
+   lineEnd = (newline && (newline > data) && (newline[-1] == '\r')) ? "\r\n" : "\n";
+
+   // every row takes a byte at least, so this many chunks are always enough
+   chunks.resize(length / CSVFILE_CHUNK + 2);
+   indexedRows.store(0, memory_order_relaxed);
+   indexDone.store(false, memory_order_relaxed);
+   statsDone.store(false, memory_order_relaxed);
+   cancelled.store(false, memory_order_relaxed);
+
+   threaded = (pthread_create(&thread, NULL, run, this) == 0);
+   if (!threaded) {
+      index();
+      gatherStats();
+   }
+   return true;
+}
+
+/**
+ * @method close
+ * Stops the thread (wherever it is) and forgets the file and the edits.
+ */
+void csvfile::close() {
+   cancelled.store(true, memory_order_relaxed);
+   if (threaded) pthread_join(thread, NULL);
+   threaded = false;
+   guard.release();
+   if (data) munmap(const_cast<char*>(data), length);
+   data = NULL;
+   if (fd >= 0) ::close(fd);
+   fd = -1;
+   length = 0;
+   chunks.clear();
+   indexedRows.store(0, memory_order_relaxed);
+   columnStats.clear();
+   edits.clear();
+   order.clear();
+   drain();
+}
+
+/**
+ * @method wakeFd
+ * @returns {int} a pipe that becomes readable when there are more rows, or the column widths are in.
+ */
+int csvfile::wakeFd() const {
+   return wake[0];
+}
+
+/**
+ * @method drain
+ * Empties the pipe, once what it woke up for has been seen to.
+ */
+void csvfile::drain() {
+   char bytes[64];
+   while ((wake[0] >= 0) && (read(wake[0], bytes, sizeof(bytes)) > 0));
+}
+
+/**
+ * @method rows
+ * @returns {size_t} how many rows have been indexed (all of them, once indexed()).
+ */
+size_t csvfile::rows() const {
+   return indexedRows.load(memory_order_acquire);
+}
+
+/**
+ * @method indexed
+ * @returns {bool} true once every row of the file has been found.
+ */
+bool csvfile::indexed() const {
+   return indexDone.load(memory_order_acquire);
+}
+
+/**
+ * @method measured
+ * @returns {bool} true once the widths of the columns are known.
+ */
+bool csvfile::measured() const {
+   return statsDone.load(memory_order_acquire);
+}
+
+/**
+ * @method separator
+ * @returns {char} what separates fields: a comma or a tab.
+ */
+char csvfile::separator() const {
+   return delimiter;
+}
+
+/**
+ * @method truncated
+ * @returns {bool} true if the file was cut short by someone else since it
+ * was opened, so that some of it was read as zeros.
+ */
+bool csvfile::truncated() const {
+   return guard.lost();
+}
+
+/**
+ * @method fileRow
+ * @param {const size_t} row - a row as shown
+ * @returns {size_t} where the row is in the file.
+ */
+size_t csvfile::fileRow(const size_t row) const {
+   return order.empty() ? row : order[row];
+}
+
+/**
+ * @method fields
+ * Splits the fields out of a row, as far as a column.
+ * @param {const size_t} row - the row as shown (below rows())
+ * @param {const size_t} upto - the fields wanted (fewer if the row is short)
+ * @param {vector<string>&} out - replaced by the fields
+ */
+void csvfile::fields(const size_t row, const size_t upto, vector<string>& out) const {
+   out.clear();
+   size_t at = fileRow(row);
+   auto edited = edits.find(at);
+   if (edited != edits.end()) {
+      out.assign(edited->second.begin(), edited->second.begin() + min(upto, edited->second.size()));
+      return;
+   }
+   string_view raw;
+   string unquoted;
+   for (size_t column = 0; column < upto; column++) {
+      if (!rawField(at, column, raw, unquoted)) break;
+      out.emplace_back(raw);
+   }
+}
+
+/**
+ * @method field
+ * @param {const size_t} row - the row as shown
+ * @param {const size_t} column - the column
+ * @returns {string} the field (empty past the end of the row).
+ */
+string csvfile::field(const size_t row, const size_t column) const {
+   vector<string> cells;
+   fields(row, column + 1, cells);
+   return (column < cells.size()) ? cells[column] : string();
+}
+
+/**
+ * @method set
+ * Changes a field.  The row goes into the overlay whole, with empty fields
+ * added up to the column if it was short.
+ * @param {const size_t} row - the row as shown
+ * @param {const size_t} column - the column
+ * @param {const string&} value - what the field becomes
+ */
+void csvfile::set(const size_t row, const size_t column, const string& value) {
+   size_t at = fileRow(row);
+   if (edits.find(at) == edits.end()) {
+      vector<string> cells;
+      fields(row, (size_t)-1, cells);
+      edits[at] = move(cells);
+   }
+   vector<string>& changed = edits[at];
+   if (changed.size() <= column) changed.resize(column + 1);
+   changed[column] = value;
+
+   lock_guard<mutex> hold(columnLock);
+   if (columnStats.size() <= column) columnStats.resize(column + 1, { 0, true });
+   columnStats[column].width = max(columnStats[column].width, min(value.length(), (size_t)CSVFILE_MAX_WIDTH));
+   double number;
+   if (!value.empty() && !csvNumber(value, number)) columnStats[column].numeric = false;
+}
+
+/**
+ * @method modified
+ * @returns {bool} true if there are edits, or an order, that haven't been saved.
+ */
+bool csvfile::modified() const {
+   return !edits.empty() || !order.empty();
+}
+
+/**
+ * @method columns
+ * @returns {vector<csvcolumn>} the columns as measured so far (none until measured()).
+ */
+vector<csvcolumn> csvfile::columns() const {
+   lock_guard<mutex> hold(columnLock);
+   return columnStats;
+}
+
+/**
+ * @method sort
+ * Shows the rows below the first (the header) in the order of a column:
+ * by number if every field in it that isn't empty is a number, otherwise
+ * by bytes.  Stable, so sorting by one column and then another groups by
+ * the second with the first kept inside each group.  Waits for the index.
+ * @param {const size_t} column - the column
+ * @param {const bool} reverse - largest first
+ */
+void csvfile::sort(const size_t column, const bool reverse) {
+   waitIndexed();
+   const size_t count = rows();
+   if (count < 3) return;
+
+   struct sortkey {
+      double number;
+      string_view text;
+      size_t row;
+   };
+   vector<sortkey> keys(count - 1);
+   const size_t parts = parallelThreads(keys.size());
+   vector<deque<string>> unquoted(parts); // fields that had to be copied, a deque per part
+   vector<char> numeric(parts, true);
+
+   parallelFor(parts, [&](size_t p) {
+      size_t from = keys.size() * p / parts;
+      size_t to = keys.size() * (p + 1) / parts;
+      string copy;
+      for (size_t k = from; k < to; k++) {
+         sortkey& key = keys[k];
+         key.row = fileRow(k + 1);
+         key.number = 0;
+         auto edited = edits.find(key.row);
+         if (edited != edits.end()) {
+            key.text = (column < edited->second.size()) ? string_view(edited->second[column]) : string_view();
+         } else if (!rawField(key.row, column, key.text, copy)) {
+            key.text = string_view();
+         } else if (key.text.data() == copy.data()) {
+            unquoted[p].push_back(move(copy));
+            key.text = unquoted[p].back();
+         }
+         if (numeric[p] && !key.text.empty() && !csvNumber(key.text, key.number)) numeric[p] = false;
+      }
+   });
+
+   bool byNumber = true;
+   for (char n : numeric) byNumber = byNumber && n;
+   if (byNumber) {
+      // empty fields go before every number
+      for (sortkey& key : keys) if (key.text.empty()) key.number = -HUGE_VAL;
+      if (reverse) parallelSort(keys, [](const sortkey& a, const sortkey& b) { return b.number < a.number; });
+      else parallelSort(keys, [](const sortkey& a, const sortkey& b) { return a.number < b.number; });
+   } else {
+      if (reverse) parallelSort(keys, [](const sortkey& a, const sortkey& b) { return b.text < a.text; });
+      else parallelSort(keys, [](const sortkey& a, const sortkey& b) { return a.text < b.text; });
+   }
+
+   vector<size_t> sorted(count);
+   sorted[0] = fileRow(0);
+   parallelFor(parts, [&](size_t p) {
+      for (size_t k = keys.size() * p / parts; k < keys.size() * (p + 1) / parts; k++) sorted[k + 1] = keys[k].row;
+   });
+   order.swap(sorted);
+}
+
+/**
+ * @method sum
+ * Adds up the numbers in a column, below the header, across the cores.
+ * Waits for the index.
+ * @param {const size_t} column - the column
+ * @param {double&} total - set to the sum
+ * @param {size_t&} count - set to how many fields were numbers
+ * @returns {bool} true if any were.
+ */
+bool csvfile::sum(const size_t column, double& total, size_t& count) const {
+   waitIndexed();
+   const size_t all = rows();
+   const size_t parts = parallelThreads(all);
+   vector<double> totals(parts, 0);
+   vector<size_t> counts(parts, 0);
+
+   parallelFor(parts, [&](size_t p) {
+      string copy;
+      string_view text;
+      double number;
+      for (size_t row = max((size_t)1, all * p / parts); row < all * (p + 1) / parts; row++) {
+         auto edited = edits.find(row);
+         if (edited != edits.end()) {
+            text = (column < edited->second.size()) ? string_view(edited->second[column]) : string_view();
+         } else if (!rawField(row, column, text, copy)) {
+            continue;
+         }
+         if (csvNumber(text, number)) {
+            totals[p] += number;
+            counts[p]++;
+         }
+      }
+   });
+
+   total = 0;
+   count = 0;
+   for (size_t p = 0; p < parts; p++) {
+      total += totals[p];
+      count += counts[p];
+   }
+   return count > 0;
+}
+
+/**
+ * @method find
+ * Looks for the next field in a column with some text in it, after a row
+ * (as shown) and round past the end.  Rows are searched in blocks, each
+ * block split between the cores, so a match near the row is found without
+ * going through the rest.  Waits for the index.
+ * @param {const size_t} column - the column
+ * @param {const string&} text - what to look for
+ * @param {const size_t} after - the row to start after
+ * @param {size_t&} found - set to the row (as shown) the text is in
+ * @returns {bool} true if it was found.
+ */
+bool csvfile::find(const size_t column, const string& text, const size_t after, size_t& found) const {
+   waitIndexed();
+   const size_t all = rows();
+   if (all == 0) return false;
+   const size_t block = (size_t)PARALLEL_MIN * PARALLEL_MAX_THREADS;
+
+   // rows counted from the one after, wrapping round to it
+   for (size_t done = 0; done < all; done += block) {
+      const size_t span = min(block, all - done);
+      const size_t parts = parallelThreads(span);
+      vector<size_t> first(parts, span);
+
+      parallelFor(parts, [&](size_t p) {
+         string copy;
+         string_view value;
+         for (size_t k = span * p / parts; k < span * (p + 1) / parts; k++) {
+            size_t row = (after + 1 + done + k) % all;
+            size_t at = fileRow(row);
+            auto edited = edits.find(at);
+            if (edited != edits.end()) {
+               value = (column < edited->second.size()) ? string_view(edited->second[column]) : string_view();
+            } else if (!rawField(at, column, value, copy)) {
+               continue;
+            }
+            if (value.find(text) != string_view::npos) {
+               first[p] = k;
+               return;
+            }
+         }
+      });
+
+      for (size_t k : first) {
+         if (k < span) {
+            found = (after + 1 + done + k) % all;
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+/**
+ * @method save
+ * Writes every row, in the order shown, to a new file next to this one,
+ * CSVFILE_WRITE_BUFFER bytes at a time, and puts it in the file's place.
+ * Rows that weren't edited are copied byte for byte, line ending and all;
+ * edited ones are joined again, quoting fields that need it, and end the way
+ * the file's rows do.  The last row written ends in a newline only if the
+ * file's last row did.  Then opens the new file, so the index starts over.
+ * A file that was truncated() isn't written, since the rows it lost would
+ * be saved as zeros.  Waits for the index.
+ * @returns {bool} true if the file was written.
+ */
+bool csvfile::save() {
+   waitIndexed();
+   savefile out;
+   if (truncated() || !out.open(filename)) return false;
+
+   string pending;
+   pending.reserve(CSVFILE_WRITE_BUFFER);
+   bool ok = true;
+   auto flush = [&]() {
+      ok = ok && out.write(pending.data(), pending.length());
+      pending.clear();
+   };
+
+   const size_t count = rows();
+   const bool endsInNewline = (length > 0) && (data[length - 1] == '\n');
+   for (size_t row = 0; ok && (row < count); row++) {
+      size_t at = fileRow(row);
+      auto edited = edits.find(at);
+      if (edited == edits.end()) {
+         pending.append(data + rowStart(at), rowNext(at) - rowStart(at));
+      } else {
+         for (size_t column = 0; column < edited->second.size(); column++) {
+            const string& value = edited->second[column];
+            if (column > 0) pending += delimiter;
+            if (value.find_first_of(string(1, delimiter) + "\"\r\n") == string::npos) {
+               pending += value;
+               continue;
+            }
+            pending += '"';
+            for (char c : value) {
+               if (c == '"') pending += '"';
+               pending += c;
+            }
+            pending += '"';
+         }
+         pending += lineEnd;
+      }
+
+      // only the last row of the file can be without a newline, wherever it's sorted to
+      bool last = (row + 1 == count);
+      if (!last && (pending.empty() || (pending.back() != '\n'))) {
+         pending += lineEnd;
+      } else if (last && !endsInNewline && !pending.empty() && (pending.back() == '\n')) {
+         pending.resize(pending.length() - ((pending.length() > 1) && (pending[pending.length() - 2] == '\r') ? 2 : 1));
+      } else if (last && endsInNewline && (pending.empty() || (pending.back() != '\n'))) {
+         pending += lineEnd;
+      }
+      if (pending.length() >= CSVFILE_WRITE_BUFFER) flush();
+   }
+   flush();
+
+   // rows copied after the file was cut short came out as zeros
+   if (!ok || truncated() || !out.commit()) return false;
+   return open(filename);
+}
+
+/**
+ * @private
+ * @method run
+ * Where the thread starts: indexes the rows, then measures the columns.
+ */
+void* csvfile::run(void* self) {
+   csvfile* file = static_cast<csvfile*>(self);
+   file->index();
+   file->gatherStats();
+   return NULL;
+}
+
+/**
+ * @private
+ * @method index
+ * Finds where every row starts.  A newline inside quotes is part of a
+ * field, so quotes are counted between newlines; a doubled quote inside a
+ * quoted field counts twice and changes nothing.
+ */
+void csvfile::index() {
+   if (length > 0) madvise(const_cast<char*>(data), length, MADV_SEQUENTIAL);
+   size_t count = 0;
+   size_t at = 0;
+   bool quoted = false;
+   while ((at < length) && !cancelled.load(memory_order_relaxed)) {
+      if (!quoted) {
+         if (count % CSVFILE_CHUNK == 0) chunks[count / CSVFILE_CHUNK].reset(new size_t[CSVFILE_CHUNK]);
+         chunks[count / CSVFILE_CHUNK][count % CSVFILE_CHUNK] = at;
+         count++;
+         if ((count % CSVFILE_CHUNK == 0) || (count == CSVFILE_FIRST)) {
+            // the last row found can't be read until the next one starts
+            indexedRows.store(count - 1, memory_order_release);
+            signal();
+         }
+      }
+      const char* newline = static_cast<const char*>(memchr(data + at, '\n', length - at));
+      size_t end = newline ? newline - data : length;
+      for (const char* quote = data + at; (quote = static_cast<const char*>(memchr(quote, '"', data + end - quote))); quote++) {
+         quoted = !quoted;
+      }
+      at = end + 1;
+   }
+   indexedRows.store(count, memory_order_release);
+   indexDone.store(true, memory_order_release);
+   if (length > 0) madvise(const_cast<char*>(data), length, MADV_NORMAL);
+   signal();
+}
+
+/**
+ * @private
+ * @method gatherStats
+ * Measures every column of every row (as in the file), a piece of the rows
+ * per core, and merges what the pieces found with what edits have set.
+ */
+void csvfile::gatherStats() {
+   if (cancelled.load(memory_order_relaxed)) return;
+   const size_t count = rows();
+   const size_t parts = parallelThreads(count);
+   vector<vector<csvcolumn>> found(parts);
+
+   parallelFor(parts, [&](size_t p) {
+      string copy;
+      string_view value;
+      double number;
+      vector<csvcolumn>& mine = found[p];
+      for (size_t row = count * p / parts; row < count * (p + 1) / parts; row++) {
+         if (cancelled.load(memory_order_relaxed)) return;
+         for (size_t column = 0; rawField(row, column, value, copy); column++) {
+            if (mine.size() <= column) mine.resize(column + 1, { 0, true });
+            mine[column].width = max(mine[column].width, min(value.length(), (size_t)CSVFILE_MAX_WIDTH));
+            // the header row may be words over numbers
+            if ((row > 0) && mine[column].numeric && !value.empty() && !csvNumber(value, number)) mine[column].numeric = false;
+         }
+      }
+   });
+   if (cancelled.load(memory_order_relaxed)) return;
+
+   {
+      lock_guard<mutex> hold(columnLock);
+      for (vector<csvcolumn>& piece : found) {
+         if (columnStats.size() < piece.size()) columnStats.resize(piece.size(), { 0, true });
+         for (size_t column = 0; column < piece.size(); column++) {
+            columnStats[column].width = max(columnStats[column].width, piece[column].width);
+            columnStats[column].numeric = columnStats[column].numeric && piece[column].numeric;
+         }
+      }
+   }
+   statsDone.store(true, memory_order_release);
+   signal();
+}
+
+/**
+ * @private
+ * @method signal
+ * Wakes up whoever is polling wakeFd().
+ */
+void csvfile::signal() {
+   if (wake[1] >= 0) {
+      char byte = 1;
+      if (write(wake[1], &byte, 1) < 0) { /* the pipe is full already, which wakes it all the same */ }
+   }
+}
+
+/**
+ * @private
+ * @method rowStart
+ * @param {const size_t} row - a row in the file (below rows())
+ * @returns {size_t} the offset it starts at.
+ */
+size_t csvfile::rowStart(const size_t row) const {
+   return chunks[row / CSVFILE_CHUNK][row % CSVFILE_CHUNK];
+}
+
+/**
+ * @private
+ * @method rowEnd
+ * @param {const size_t} row - a row in the file (below rows())
+ * @returns {size_t} the offset of its newline (or carriage return), or the end of the file.
+ */
+size_t csvfile::rowEnd(const size_t row) const {
+   // until the index is done, every row published has the next one after it
+   size_t end = (!indexed() || (row + 1 < rows())) ? rowStart(row + 1) - 1 : length;
+   if ((end == length) && (end > rowStart(row)) && (data[end - 1] == '\n')) end--;
+   if ((end > rowStart(row)) && (data[end - 1] == '\r')) end--;
+   return end;
+}
+
+/**
+ * @private
+ * @method rowNext
+ * @param {const size_t} row - a row in the file (below rows(), once indexed)
+ * @returns {size_t} where the row after it starts, or the end of the file:
+ * the row from rowStart() up to here is the row with its line ending.
+ */
+size_t csvfile::rowNext(const size_t row) const {
+   return (row + 1 < rows()) ? rowStart(row + 1) : length;
+}
+
+/**
+ * @private
+ * @method rawField
+ * Finds a field of a row as it is in the file.  A field without quotes is a
+ * view into the mapping; one with quotes has them taken out into a copy,
+ * and the view is of the copy.
+ * @param {const size_t} row - the row in the file
+ * @param {const size_t} column - the column
+ * @param {string_view&} value - set to the field
+ * @param {string&} copy - where a quoted field is unquoted into
+ * @returns {bool} false if the row has no such column.
+ */
+bool csvfile::rawField(const size_t row, const size_t column, string_view& value, string& copy) const {
+   const char* at = data + rowStart(row);
+   const char* end = data + rowEnd(row);
+
+   // an empty row has one empty field
+   for (size_t skip = 0; skip < column; skip++) {
+      bool quoted = false;
+      while ((at < end) && (quoted || (*at != delimiter))) {
+         if (*at == '"') quoted = !quoted;
+         at++;
+      }
+      if (at >= end) return false;
+      at++;
+   }
+
+   if ((at < end) && (*at == '"')) {
+      copy.clear();
+      for (at++; at < end; at++) {
+         if (*at == '"') {
+            if ((at + 1 < end) && (at[1] == '"')) {
+               at++;
+            } else {
+               // anything after the closing quote, up to the delimiter, is kept too
+               for (at++; (at < end) && (*at != delimiter); at++) copy += *at;
+               break;
+            }
+         }
+         copy += *at;
+      }
+      value = copy;
+      return true;
+   }
+
+   const char* delim = static_cast<const char*>(memchr(at, delimiter, end - at));
+   value = string_view(at, (delim ? delim : end) - at);
+   return true;
+}
+
+/**
+ * @private
+ * @method waitIndexed
+ * Sleeps until every row has been indexed.
+ */
+void csvfile::waitIndexed() const {
+   while (!indexed()) usleep(CSVFILE_WAIT_US);
+}
+
+#endif
@@ -0,0 +1,988 @@
+/*
+ * Class: document
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Holds the lines of the file being edited.  Every line lives in its own
+ *      reference counted string, so handing a block of lines to somebody
+ *      else (the clipboard, for instance) only copies pointers.  A shared line
+ *      is cloned the first time it gets edited, so nobody else sees the change.
+ *      Lines come from linepool, which all documents share.
+ *
+ *      The document also keeps a running summary of which lines changed, for
+ *      anything that keeps its own state per line (like the highlighter).
+ *
+ *      It also remembers which file it was last loaded from or saved to, and
+ *      how many lines from the start are still as they are in it.  If the
+ *      file hasn't been touched since (same inode, size and mtime), save()
+ *      only writes from the first changed line on and truncates the rest, so
+ *      fixing a line near the end of a huge file doesn't rewrite all of it.
+ *
+ *      Optionally, lines far from where the user is can be kept compressed:
+ *      compact() packs runs of COLD_BLOCK_LINES of them into blocks (with the
+ *      codec in lz.h) and drops the lines themselves.  A line of a block that
+ *      is asked for brings the whole block back (it "thaws"); the thawed
+ *      blocks used most recently are kept that way, and compact() drops the
+ *      lines of the rest again.  Changing a line of a block turns the block
+ *      back into ordinary lines.  Lines are never dropped outside compact(),
+ *      so references from at() stay good until the next call to it.  Blocks
+ *      share their compressed text, so a block can be handed over (to the
+ *      clipboard, and pasted from there) without being thawed.
+ *
+ *      attach() makes a document out of a file whose lines were indexed
+ *      before (see sidecar.h) without reading it: every block is left where
+ *      it is in the file, and thawing one reads it from there.  Blocks like
+ *      that that a save would write over are packed first.
+ */
+
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "linepool.h"
+#include "../misc/lz.h"
+#include "../misc/savefile.h"
+
+using namespace std;
+
+typedef shared_ptr<string> lineref;
+
+/**
+ * @function newLine
+ * @returns {lineref} a new line, taken from the shared pool.
+ */
+template <typename... Args>
+lineref newLine(Args&&... args) {
+   return allocate_shared<string>(lineallocator<string>(), forward<Args>(args)...);
+}
+
+/**
+ * The lines changed since the last takeChanges(): [from, to] as numbered
+ * now, and how many lines were added (or removed, if negative) among them.
+ * Line k after to used to be line k - shift.
+ */
+struct linechanges {
+   bool any;
+   size_t from;
+   size_t to;
+   long shift;
+};
+
+// lines per compressed block, and how many thawed blocks are kept thawed
+#define COLD_BLOCK_LINES 512
+#define COLD_THAWED 8
+
+/**
+ * Lines [first, first + count) kept compressed.  They are joined by newlines
+ * (rawBytes long in all) before being compressed, or left in the file the
+ * document was attached to, at offset.
+ */
+struct coldblock {
+   size_t first;
+   size_t count;
+   size_t rawBytes;
+   off_t offset; // -1 for a block in packed
+   shared_ptr<const string> packed; // shared by every copy of the block
+   bool thawed; // the lines are in the document as well, for now
+   size_t lastUse;
+};
+
+struct coldstats {
+   size_t rawBytes; // of all the blocks
+   size_t packedBytes;
+   size_t thaws;
+   double lastThaw; // seconds
+   double maxThaw;
+};
+
+/**
+ * The file a document was last loaded from or saved to, as it was left.
+ * An empty name means there isn't one (or it's not to be trusted).
+ */
+struct diskfile {
+   string name;
+   dev_t dev;
+   ino_t ino;
+   off_t size;
+   struct timespec mtime;
+};
+
+class document {
+   private:
+      // a line in a block that isn't thawed is NULL; asking for it thaws the
+      // block, which const methods can do too
+      mutable vector<lineref> lines;
+      mutable vector<coldblock> blocks; // in order
+      mutable size_t uses;
+      mutable coldstats stats;
+      linechanges changes;
+      diskfile disk;
+      size_t unchanged; // lines from the start that are the same as on disk
+      int attached; // the file blocks with an offset are in, or -1
+
+      void changed(const size_t, const size_t, const long);
+      void remember(const string&, const struct stat&);
+      bool untouched(const string&) const;
+      off_t offsetOf(const size_t) const;
+
+      const lineref& hot(const size_t) const;
+      size_t blockAt(const size_t) const;
+      void thaw(coldblock&) const;
+      void unpack(const coldblock&, string&) const;
+      void dissolve(const size_t, const size_t);
+      void shift(const size_t, const long);
+      void freeze(const size_t, const size_t);
+      void pack(coldblock&) const;
+      void detach();
+
+   public:
+      size_t revision; // goes up with every change
+
+      document();
+      document(const document&) = delete;
+      ~document();
+
+      size_t size() const;
+      bool empty() const;
+
+      const string& at(const size_t) const;
+      string& edit(const size_t);
+      lineref ref(const size_t) const;
+
+      void insert(const size_t, const string&);
+      void insert(const size_t, string&&);
+      void insertRefs(const size_t, vector<lineref>::const_iterator, vector<lineref>::const_iterator, const vector<coldblock>&);
+      vector<lineref> refs(const size_t, const size_t) const;
+      vector<lineref> refs(const size_t, const size_t, vector<coldblock>&) const;
+      void replace(const size_t, const size_t, vector<lineref>&&);
+      void erase(const size_t);
+      void erase(const size_t, const size_t);
+      void clear();
+
+      bool load(const string&);
+      bool attach(const string&, const struct stat&, const vector<off_t>&, const size_t, const off_t);
+      bool save(const string&);
+      void source(const string&, const struct stat&);
+      const diskfile& origin() const;
+      void append(string&&);
+      string text() const;
+
+      linechanges takeChanges();
+
+      bool compact(const size_t, const size_t, const chrono::steady_clock::time_point);
+      const coldstats& coldStats() const;
+};
+
+#define DOCUMENT_IO_BUFFER 65536
+
+/**
+ * @constructs document
+ * Starts out with no lines at all; the editor adds the first blank one.
+ */
+document::document() {
+   revision = 0;
+   changes = { false, 0, 0, 0 };
+   uses = 0;
+   stats = { 0, 0, 0, 0, 0 };
+   disk.name.clear();
+   unchanged = 0;
+   attached = -1;
+}
+
+/**
+ * Lets go of the file the document was attached to, if it was.
+ */
+document::~document() {
+   detach();
+}
+
+/**
+ * @method size
+ * @returns {size_t} the number of lines in the document.
+ */
+size_t document::size() const {
+   return lines.size();
+}
+
+/**
+ * @method empty
+ * @returns {bool} true if the document has no lines.
+ */
+bool document::empty() const {
+   return lines.empty();
+}
+
+/**
+ * @method at
+ * Read-only access to a line; never clones anything.
+ * @param {const size_t} index - the line to get
+ * @returns {const string&} the text of the line.
+ * @throws {out_of_range} when index is past the end of the document.
+ */
+const string& document::at(const size_t index) const {
+   return *hot(index);
+}
+
+/**
+ * @method edit
+ * Writable access to a line.  If the line is shared with anything else
+ * (the clipboard, another buffer) it gets cloned first.
+ * @param {const size_t} index - the line to edit
+ * @returns {string&} the text of the line, safe to modify.
+ * @throws {out_of_range} when index is past the end of the document.
+ */
+string& document::edit(const size_t index) {
+   hot(index);
+   dissolve(index, index + 1);
+   lineref& line = lines.at(index);
+   if (line.use_count() > 1) {
+      line = newLine(*line);
+   }
+   revision++;
+   changed(index, index, 0);
+   return *line;
+}
+
+/**
+ * @method ref
+ * Shares a line without copying its text.
+ * @param {const size_t} index - the line to share
+ * @returns {lineref} a reference to the line.
+ */
+lineref document::ref(const size_t index) const {
+   return hot(index);
+}
+
+/**
+ * @method insert
+ * Inserts a new line before the provided index.
+ * @param {const size_t} index - where the new line goes (size() appends)
+ * @param {const string&} text - the text of the new line
+ */
+void document::insert(const size_t index, const string& text) {
+   shift(index, 1);
+   lines.insert(lines.begin() + index, newLine(text));
+   revision++;
+   changed(index, index, 1);
+}
+
+void document::insert(const size_t index, string&& text) {
+   shift(index, 1);
+   lines.insert(lines.begin() + index, newLine(move(text)));
+   revision++;
+   changed(index, index, 1);
+}
+
+/**
+ * @method insertRefs
+ * Inserts already existing lines before the provided index.  The lines are
+ * shared, not copied, so this only costs one pointer per line, and lines
+ * still in compressed blocks (see refs()) stay in them.
+ * @param {const size_t} index - where the lines go (size() appends)
+ * @param {iterator} first - the first line to insert
+ * @param {iterator} last - one past the last line to insert
+ * @param {const vector<coldblock>&} cold - the blocks the NULL lines are in, numbered from first
+ */
+void document::insertRefs(const size_t index, vector<lineref>::const_iterator first, vector<lineref>::const_iterator last, const vector<coldblock>& cold) {
+   if (first == last) return;
+   shift(index, last - first);
+   lines.insert(lines.begin() + index, first, last);
+
+   vector<coldblock> moved(cold);
+   for (coldblock& block : moved) {
+      block.first += index;
+      block.thawed = false;
+      block.lastUse = 0;
+      stats.rawBytes += block.rawBytes;
+      stats.packedBytes += block.packed->length();
+   }
+   auto position = lower_bound(blocks.begin(), blocks.end(), index, [](const coldblock& block, const size_t line) { return block.first < line; });
+   blocks.insert(position, moved.begin(), moved.end());
+
+   revision++;
+   changed(index, index + (last - first) - 1, last - first);
+}
+
+/**
+ * @method refs
+ * Shares a run of lines without copying their text.
+ * @param {const size_t} first - the first line
+ * @param {const size_t} last - one past the last line
+ * @returns {vector<lineref>} references to the lines.
+ */
+vector<lineref> document::refs(const size_t first, const size_t last) const {
+   vector<lineref> shared;
+   shared.reserve(last - first);
+   for (size_t i = first; i < last; i++) shared.push_back(hot(i));
+   return shared;
+}
+
+/**
+ * @method refs
+ * Shares a run of lines without copying their text, or thawing the
+ * compressed blocks wholly inside it: their lines come back NULL, and the
+ * blocks themselves (sharing the compressed text) go in cold, for
+ * insertRefs().  Blocks still in the attached file are packed first.
+ * @param {const size_t} first - the first line
+ * @param {const size_t} last - one past the last line
+ * @param {vector<coldblock>&} cold - replaced by the blocks, numbered from first
+ * @returns {vector<lineref>} references to the lines.
+ */
+vector<lineref> document::refs(const size_t first, const size_t last, vector<coldblock>& cold) const {
+   vector<lineref> shared;
+   shared.reserve(last - first);
+   cold.clear();
+   for (size_t i = first; i < last; ) {
+      size_t b = blockAt(i);
+      if ((b == blocks.size()) || (blocks[b].first != i) || (i + blocks[b].count > last)) {
+         shared.push_back(hot(i));
+         i++;
+         continue;
+      }
+
+      coldblock& block = blocks[b];
+      if (block.offset >= 0) pack(block);
+      cold.push_back(block);
+      cold.back().first = i - first;
+      shared.resize(shared.size() + block.count);
+      i += block.count;
+   }
+   return shared;
+}
+
+/**
+ * @method replace
+ * Replaces the lines in [first, last) with others, as one change.  The
+ * references are moved in, so nothing is copied.
+ * @param {const size_t} first - the first line to replace
+ * @param {const size_t} last - one past the last line to replace
+ * @param {vector<lineref>&&} with - the lines that take their place
+ */
+void document::replace(const size_t first, const size_t last, vector<lineref>&& with) {
+   const size_t kept = min(with.size(), last - first);
+   const long count = (long)with.size() - (long)(last - first);
+   dissolve(first, last);
+   shift(last, count);
+   move(with.begin(), with.begin() + kept, lines.begin() + first);
+   if (count > 0) {
+      lines.insert(lines.begin() + last, make_move_iterator(with.begin() + kept), make_move_iterator(with.end()));
+   } else {
+      lines.erase(lines.begin() + first + kept, lines.begin() + last);
+   }
+   revision++;
+   changed(first, first + (with.empty() ? 0 : with.size() - 1), count);
+}
+
+/**
+ * @method erase
+ * Removes a single line.
+ * @param {const size_t} index - the line to remove
+ */
+void document::erase(const size_t index) {
+   dissolve(index, index + 1);
+   shift(index + 1, -1);
+   lines.erase(lines.begin() + index);
+   revision++;
+   changed(index, index, -1);
+}
+
+/**
+ * @method erase
+ * Removes the lines in [first, last).
+ * @param {const size_t} first - the first line to remove
+ * @param {const size_t} last - one past the last line to remove
+ */
+void document::erase(const size_t first, const size_t last) {
+   if (first == last) return;
+   dissolve(first, last);
+   shift(last, -(long)(last - first));
+   lines.erase(lines.begin() + first, lines.begin() + last);
+   revision++;
+   changed(first, first, -(long)(last - first));
+}
+
+/**
+ * @method clear
+ * Removes every line.
+ */
+void document::clear() {
+   long removed = lines.size();
+   lines.clear();
+   dissolve(0, (size_t)-1);
+   revision++;
+   changed(0, 0, -removed);
+}
+
+/**
+ * @method load
+ * Replaces the document with the lines of a file.  A file ending in a
+ * newline doesn't get an extra blank line at the end.
+ * @param {const string&} filename - the file to read
+ * @returns {bool} true if the file could be read.
+ */
+bool document::load(const string& filename) {
+   int fd = open(filename.c_str(), O_RDONLY);
+   disk.name.clear();
+   if (fd < 0) return false;
+
+   struct stat info;
+   bool known = (fstat(fd, &info) == 0);
+   long removed = lines.size();
+   lines.clear();
+   dissolve(0, (size_t)-1);
+   detach();
+   string partial;
+   char buffer[DOCUMENT_IO_BUFFER];
+   ssize_t n;
+   while ((n = read(fd, buffer, sizeof buffer)) > 0) {
+      const char* start = buffer;
+      const char* end = buffer + n;
+      for (const char* newline; (newline = (const char*)memchr(start, '\n', end - start)) != NULL; start = newline + 1) {
+         partial.append(start, newline - start);
+         lines.push_back(newLine(move(partial)));
+         partial.clear();
+      }
+      partial.append(start, end - start);
+   }
+   close(fd);
+
+   if (!partial.empty() || lines.empty()) lines.push_back(newLine(move(partial)));
+   revision++;
+   changed(0, lines.size() - 1, (long)lines.size() - removed);
+   if (known && (n == 0)) remember(filename, info);
+   return n == 0;
+}
+
+/**
+ * @method attach
+ * Replaces the document with the lines of a file that were indexed before,
+ * without reading any of them: they're left in the file, in blocks of
+ * COLD_BLOCK_LINES, and a block is read when a line of it is asked for.
+ * @param {const string&} filename - the file
+ * @param {const struct stat&} info - what it looked like when it was indexed
+ * @param {const vector<off_t>&} starts - where each block starts in it
+ * @param {const size_t} count - how many lines there are in all
+ * @param {const off_t} end - where the last line ends, after its newline
+ * @returns {bool} true if the file is there, and is the one indexed.
+ */
+bool document::attach(const string& filename, const struct stat& info, const vector<off_t>& starts, const size_t count, const off_t end) {
+   int fd = open(filename.c_str(), O_RDONLY);
+   struct stat now;
+   if ((fd < 0) || (fstat(fd, &now) != 0) || (now.st_dev != info.st_dev) || (now.st_ino != info.st_ino)
+      || (starts.size() != (count + COLD_BLOCK_LINES - 1) / COLD_BLOCK_LINES)) {
+      if (fd >= 0) close(fd);
+      return false;
+   }
+
+   long removed = lines.size();
+   lines.clear();
+   dissolve(0, (size_t)-1);
+   detach();
+   attached = fd;
+
+   lines.resize(count);
+   for (size_t b = 0; b < starts.size(); b++) {
+      size_t first = b * COLD_BLOCK_LINES;
+      off_t next = (b + 1 < starts.size()) ? starts[b + 1] : end;
+      blocks.push_back({ first, min((size_t)COLD_BLOCK_LINES, count - first), (size_t)(next - starts[b] - 1), starts[b], nullptr, false, 0 });
+   }
+   revision++;
+   changed(0, count ? count - 1 : 0, (long)count - removed);
+   remember(filename, info);
+   return true;
+}
+
+/**
+ * @method save
+ * Writes every line, each followed by a newline, in large blocks.  When
+ * the file is the one the document came from and nobody else has touched
+ * it, only the lines from the first changed one on are written, in place.
+ * Otherwise all of it goes to a new file next to it (a savefile), which is
+ * synced and then renamed over the old one, so a crash leaves one or the
+ * other whole (and blocks of an attached document can still be read from
+ * the old one while the new one is written).  Only a directory that can't
+ * take a new file makes the whole file be written over in place.  Either
+ * way the data is on disk before this returns.
+ * @param {const string&} filename - the file to write
+ * @returns {bool} true if everything was written.
+ */
+bool document::save(const string& filename) {
+   size_t from = 0;
+   off_t offset = 0;
+   if (untouched(filename)) {
+      from = min(unchanged, lines.size());
+      offset = offsetOf(from);
+
+      // a last line without its newline on disk gets one now, which moves
+      // everything after it
+      if (offset > disk.size) from = offset = 0;
+   }
+
+   // blocks left in the file can't be written over in place, so the
+   // blocks that would be are packed first
+   struct stat existing, source;
+   bool exists = (stat(filename.c_str(), &existing) == 0);
+   bool sourceFile = exists && (attached >= 0) && (fstat(attached, &source) == 0)
+      && (existing.st_dev == source.st_dev) && (existing.st_ino == source.st_ino);
+   if ((attached >= 0) && (from > 0)) {
+      for (coldblock& block : blocks) {
+         if ((block.offset >= 0) && (block.first + block.count > from)) pack(block);
+      }
+   }
+
+   savefile copy;
+   int fd = -1;
+   disk.name.clear();
+   if (from > 0) {
+      fd = open(filename.c_str(), O_WRONLY);
+   } else if (copy.open(filename)) {
+      fd = copy.descriptor();
+   } else if (!sourceFile) {
+      fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   }
+   if (fd < 0) return false;
+   const bool aside = (fd == copy.descriptor());
+
+   bool ok = (lseek(fd, offset, SEEK_SET) == offset);
+   off_t written = 0;
+   string buffer;
+   buffer.reserve(DOCUMENT_IO_BUFFER);
+   auto drain = [&]() {
+      size_t done = 0;
+      while (ok && (done < buffer.length())) {
+         ssize_t n = write(fd, buffer.data() + done, buffer.length() - done);
+         if (n <= 0) ok = false; else done += n;
+      }
+      written += done;
+      buffer.clear();
+   };
+
+   // compressed blocks are written as they are unpacked, without thawing them
+   string raw;
+   for (size_t i = from; i < lines.size(); ) {
+      const string* text = lines[i].get();
+      size_t next = i + 1;
+      if (!text) {
+         const coldblock& block = blocks[blockAt(i)];
+         unpack(block, raw);
+         for (size_t k = block.first; k < i; k++) raw.erase(0, raw.find('\n') + 1);
+         text = &raw;
+         next = block.first + block.count;
+      }
+
+      if (buffer.length() + text->length() + 1 > DOCUMENT_IO_BUFFER) drain();
+      buffer += *text;
+      buffer += '\n';
+      i = next;
+   }
+   drain();
+
+   struct stat info;
+   bool known = false;
+   if (aside) {
+      known = ok = ok && copy.commit(&info);
+   } else {
+      // whatever was past the end of the lines written is gone
+      if (ok && (from > 0)) ok = (ftruncate(fd, offset + written) == 0);
+      if (ok) ok = (((from > 0) ? fdatasync(fd) : fsync(fd)) == 0);
+      known = ok && (fstat(fd, &info) == 0);
+      ok = (close(fd) == 0) && ok;
+   }
+   if (ok && known) remember(filename, info);
+   return ok;
+}
+
+/**
+ * @method source
+ * Says which file the lines about to be append()ed come from, for loading
+ * it a piece at a time.  The document should be empty.
+ * @param {const string&} filename - the file
+ * @param {const struct stat&} info - what it looked like when it was opened
+ */
+void document::source(const string& filename, const struct stat& info) {
+   remember(filename, info);
+}
+
+/**
+ * @method origin
+ * @returns {const diskfile&} the file the document was last loaded from or
+ * saved to, as it was left (an empty name if there isn't one).
+ */
+const diskfile& document::origin() const {
+   return disk;
+}
+
+/**
+ * @method append
+ * Adds a line read from the file given to source() at the end.  It counts
+ * as unchanged if every line before it does.
+ * @param {string&&} text - the line
+ */
+void document::append(string&& text) {
+   bool clean = (unchanged == lines.size());
+   insert(lines.size(), move(text));
+   if (clean) unchanged = lines.size();
+}
+
+/**
+ * @method text
+ * @returns {string} every line, joined by newlines (without thawing anything).
+ */
+string document::text() const {
+   string joined, raw;
+   for (size_t i = 0; i < lines.size(); ) {
+      if (i > 0) joined += '\n';
+      if (lines[i]) {
+         joined += *lines[i];
+         i++;
+      } else {
+         const coldblock& block = blocks[blockAt(i)];
+         unpack(block, raw);
+         joined += raw;
+         i = block.first + block.count;
+      }
+   }
+   return joined;
+}
+
+/**
+ * @method takeChanges
+ * @returns {linechanges} the lines changed since the last call.
+ */
+linechanges document::takeChanges() {
+   linechanges taken = changes;
+   changes.any = false;
+   return taken;
+}
+
+/**
+ * @private
+ * @method changed
+ * Adds a change to the running summary.  Lines [first, last] (numbered as
+ * they are now) are different, and count lines were inserted at first (or
+ * removed from there, if negative).
+ * @param {const size_t} first - the first line that changed
+ * @param {const size_t} last - the last line that changed
+ * @param {const long} count - how many lines were added at first
+ */
+void document::changed(const size_t first, const size_t last, const long count) {
+   unchanged = min(unchanged, first);
+   if (!changes.any) {
+      changes = { true, first, last, count };
+      return;
+   }
+
+   // the lines already marked move along with the ones after first
+   if (changes.to >= first) {
+      if (count >= 0) {
+         changes.to += count;
+      } else if (changes.to >= first + (size_t)(-count)) {
+         changes.to -= (size_t)(-count);
+      } else {
+         changes.to = first;
+      }
+   }
+
+   changes.from = min(changes.from, first);
+   changes.to = max(changes.to, last);
+   changes.shift += count;
+}
+
+/**
+ * @private
+ * @method remember
+ * Notes that the document is now the same as a file.
+ * @param {const string&} filename - the file
+ * @param {const struct stat&} info - what it looks like now
+ */
+void document::remember(const string& filename, const struct stat& info) {
+   disk = { filename, info.st_dev, info.st_ino, info.st_size, info.st_mtim };
+   unchanged = lines.size();
+}
+
+/**
+ * @private
+ * @method untouched
+ * @param {const string&} filename - the file about to be written
+ * @returns {bool} true if it's the file the document was last the same as,
+ * and it doesn't look like anything else wrote to it since.
+ */
+bool document::untouched(const string& filename) const {
+   struct stat info;
+   if (disk.name.empty() || (filename != disk.name) || (stat(filename.c_str(), &info) != 0)) return false;
+   return (info.st_dev == disk.dev) && (info.st_ino == disk.ino) && (info.st_size == disk.size)
+      && (info.st_mtim.tv_sec == disk.mtime.tv_sec) && (info.st_mtim.tv_nsec == disk.mtime.tv_nsec);
+}
+
+/**
+ * @private
+ * @method offsetOf
+ * @param {const size_t} line - a line (or size())
+ * @returns {off_t} where the line starts in the file save() writes.
+ */
+off_t document::offsetOf(const size_t line) const {
+   off_t offset = 0;
+   string raw;
+   for (size_t i = 0; i < line; ) {
+      if (lines[i]) {
+         offset += lines[i]->length() + 1;
+         i++;
+         continue;
+      }
+
+      // a whole block at once, or the lines of it that come before line
+      const coldblock& block = blocks[blockAt(i)];
+      if (block.first + block.count <= line) {
+         offset += block.rawBytes + 1;
+      } else {
+         unpack(block, raw);
+         size_t end = 0;
+         for (size_t k = block.first; k < line; k++) end = raw.find('\n', end) + 1;
+         offset += end;
+      }
+      i = block.first + block.count;
+   }
+   return offset;
+}
+
+/**
+ * @method compact
+ * Drops the lines of thawed blocks that weren't used recently and packs
+ * lines outside [hotFrom, hotTo] into new blocks, until the deadline.
+ * @param {const size_t} hotFrom - the first line to keep as it is
+ * @param {const size_t} hotTo - the last line to keep as it is
+ * @param {time_point} deadline - when to stop
+ * @returns {bool} true if there's more to pack (call it again).
+ */
+bool document::compact(const size_t hotFrom, const size_t hotTo, const chrono::steady_clock::time_point deadline) {
+   // keep the most recently thawed blocks, and the ones in use
+   vector<coldblock*> thawed;
+   for (coldblock& block : blocks) {
+      if (block.thawed && ((block.first + block.count <= hotFrom) || (block.first > hotTo))) thawed.push_back(&block);
+   }
+   if (thawed.size() > COLD_THAWED) {
+      sort(thawed.begin(), thawed.end(), [](const coldblock* a, const coldblock* b) { return a->lastUse > b->lastUse; });
+      for (size_t i = COLD_THAWED; i < thawed.size(); i++) {
+         for (size_t k = 0; k < thawed[i]->count; k++) lines[thawed[i]->first + k].reset();
+         thawed[i]->thawed = false;
+      }
+   }
+
+   // pack whole blocks out of the runs of lines between the blocks there are
+   size_t next = 0; // the first line after the last block looked at
+   for (size_t b = 0; b <= blocks.size(); b++) {
+      size_t gapEnd = (b < blocks.size()) ? blocks[b].first : lines.size();
+      while (next + COLD_BLOCK_LINES <= gapEnd) {
+         if ((next <= hotTo) && (next + COLD_BLOCK_LINES > hotFrom)) {
+            // skip past the hot lines
+            if (hotTo >= gapEnd) break;
+            next = hotTo + 1;
+            continue;
+         }
+         if (chrono::steady_clock::now() >= deadline) return true;
+
+         freeze(next, b);
+         next += COLD_BLOCK_LINES;
+         b++; // the new block comes before the one the gap ended at
+      }
+      if (b < blocks.size()) next = blocks[b].first + blocks[b].count;
+   }
+   return false;
+}
+
+/**
+ * @method coldStats
+ * @returns {const coldstats&} how the compressed lines are doing.
+ */
+const coldstats& document::coldStats() const {
+   return stats;
+}
+
+/**
+ * @private
+ * @method hot
+ * @param {const size_t} index - a line
+ * @returns {const lineref&} the line, thawing its block if it has to.
+ * @throws {out_of_range} when index is past the end of the document.
+ */
+const lineref& document::hot(const size_t index) const {
+   const lineref& line = lines.at(index);
+   if (!line) thaw(blocks[blockAt(index)]);
+   return line;
+}
+
+/**
+ * @private
+ * @method blockAt
+ * @param {const size_t} line - a line
+ * @returns {size_t} the index of the block the line is in, or blocks.size().
+ */
+size_t document::blockAt(const size_t line) const {
+   auto after = upper_bound(blocks.begin(), blocks.end(), line, [](const size_t l, const coldblock& block) { return l < block.first; });
+   if (after == blocks.begin()) return blocks.size();
+   const coldblock& block = *(after - 1);
+   return (line < block.first + block.count) ? (after - 1) - blocks.begin() : blocks.size();
+}
+
+/**
+ * @private
+ * @method unpack
+ * @param {const coldblock&} block - a block
+ * @param {string&} raw - replaced by its lines, joined by newlines
+ * @throws {runtime_error} if the block doesn't decompress.
+ */
+void document::unpack(const coldblock& block, string& raw) const {
+   if (block.offset >= 0) {
+      // a file cut short since (a log truncated in place, say) reads as blank lines
+      raw.resize(block.rawBytes);
+      size_t done = 0;
+      for (ssize_t n; (done < raw.length()) && ((n = pread(attached, &raw[done], raw.length() - done, block.offset + done)) > 0); ) {
+         done += n;
+      }
+      fill(raw.begin() + done, raw.end(), '\n');
+      return;
+   }
+   if (!lzDecompress(*block.packed, block.rawBytes, raw)) {
+      throw runtime_error("document: a compressed block is corrupt");
+   }
+}
+
+/**
+ * @private
+ * @method thaw
+ * Puts the lines of a block back in the document (keeping the block).
+ * @param {coldblock&} block - the block
+ */
+void document::thaw(coldblock& block) const {
+   auto started = chrono::steady_clock::now();
+
+   string raw;
+   unpack(block, raw);
+   size_t start = 0;
+   for (size_t k = 0; k < block.count; k++) {
+      size_t end = raw.find('\n', start);
+      if (end == string::npos) end = raw.length();
+      lines[block.first + k] = newLine(raw, start, end - start);
+      start = end + 1;
+   }
+   block.thawed = true;
+   block.lastUse = ++uses;
+
+   stats.thaws++;
+   stats.lastThaw = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+   stats.maxThaw = max(stats.maxThaw, stats.lastThaw);
+}
+
+/**
+ * @private
+ * @method dissolve
+ * Turns the blocks with any of the lines [first, last) back into ordinary
+ * lines (those wholly inside the range are simply forgotten, since their
+ * lines are about to go anyway or already have).
+ * @param {const size_t} first - the first line
+ * @param {const size_t} last - one past the last line
+ */
+void document::dissolve(const size_t first, const size_t last) {
+   // the first block that ends after first
+   size_t from = partition_point(blocks.begin(), blocks.end(), [first](const coldblock& block) { return block.first + block.count <= first; }) - blocks.begin();
+   size_t to = from;
+   for (; (to < blocks.size()) && (blocks[to].first < last); to++) {
+      coldblock& block = blocks[to];
+      bool partly = (block.first < first) || (block.first + block.count > last);
+      if (partly && !block.thawed) thaw(block);
+      if (block.offset < 0) {
+         stats.rawBytes -= block.rawBytes;
+         stats.packedBytes -= block.packed->length();
+      }
+   }
+   blocks.erase(blocks.begin() + from, blocks.begin() + to);
+}
+
+/**
+ * @private
+ * @method shift
+ * Moves the blocks from a line on, for lines inserted (or removed) there.
+ * A block that the line is in the middle of is dissolved first.
+ * @param {const size_t} at - where lines are inserted (or the first line after those removed)
+ * @param {const long} count - how many (negative when removed)
+ */
+void document::shift(const size_t at, const long count) {
+   if (blocks.empty()) return;
+   if (count > 0) {
+      size_t b = blockAt(at);
+      if ((b < blocks.size()) && (blocks[b].first < at)) dissolve(at, at + 1);
+   }
+   auto from = lower_bound(blocks.begin(), blocks.end(), at, [](const coldblock& block, const size_t line) { return block.first < line; });
+   for (auto block = from; block != blocks.end(); block++) block->first += count;
+}
+
+/**
+ * @private
+ * @method freeze
+ * Packs COLD_BLOCK_LINES lines, none of them in a block, into a new block.
+ * @param {const size_t} first - the first line
+ * @param {const size_t} position - where the block goes in blocks
+ */
+void document::freeze(const size_t first, const size_t position) {
+   string raw;
+   for (size_t k = 0; k < COLD_BLOCK_LINES; k++) {
+      if (k > 0) raw += '\n';
+      raw += *lines[first + k];
+   }
+
+   string packed;
+   lzCompress(raw.data(), raw.length(), packed);
+   packed.shrink_to_fit();
+   coldblock block = { first, COLD_BLOCK_LINES, raw.length(), -1, make_shared<const string>(move(packed)), false, 0 };
+   for (size_t k = 0; k < COLD_BLOCK_LINES; k++) lines[first + k].reset();
+
+   stats.rawBytes += block.rawBytes;
+   stats.packedBytes += block.packed->length();
+   blocks.insert(blocks.begin() + position, move(block));
+}
+
+/**
+ * @private
+ * @method pack
+ * Reads a block that's still in the file the document is attached to and
+ * compresses it, so it doesn't need the file any more.
+ * @param {coldblock&} block - the block
+ */
+void document::pack(coldblock& block) const {
+   string raw, packed;
+   unpack(block, raw);
+   lzCompress(raw.data(), raw.length(), packed);
+   packed.shrink_to_fit();
+   block.packed = make_shared<const string>(move(packed));
+   block.offset = -1;
+
+   stats.rawBytes += block.rawBytes;
+   stats.packedBytes += block.packed->length();
+}
+
+/**
+ * @private
+ * @method detach
+ * Lets go of the file the document was attached to (no blocks should be
+ * left in it).
+ */
+void document::detach() {
+   if (attached >= 0) close(attached);
+   attached = -1;
+}
+
+#endif
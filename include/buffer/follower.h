@@ -0,0 +1,307 @@
+/*
+ * Class: follower
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Reads lines out of something that keeps growing: a pipe (until it's
+ *      closed) or a file that's being appended to, like tail -f.  Nothing
+ *      blocks: read() takes whatever is there right now and hands back the
+ *      complete lines, and waitFd()/timeout() say what to poll() on to find
+ *      out when there's more.
+ *
+ *      On Linux a file is watched with inotify; elsewhere it's checked every
+ *      FOLLOW_POLL_MS.  A file that gets truncated is read again from the
+ *      start, and one that gets replaced (log rotation) is reopened by name
+ *      once the rest of the old one has been read.
+ *
+ *      Tabs become spaces and other control characters become '?', so every
+ *      character of a line takes one cell on the screen.
+ */
+
+#ifndef FOLLOWER_H
+#define FOLLOWER_H
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "linering.h"
+
+using namespace std;
+
+// how much is read at a time, and at most per call to read()
+#define FOLLOW_CHUNK 65536
+#define FOLLOW_BATCH (16 * FOLLOW_CHUNK)
+
+// how often a file is checked for more without inotify
+#define FOLLOW_POLL_MS 250
+
+class follower {
+   private:
+      int fd;
+      int notify; // inotify descriptor, or -1
+      string path; // empty when reading a pipe
+      bool ended;
+      bool backlog; // the last read() stopped before everything was read
+      bool missing; // the name went away (moved or deleted) and hasn't come back
+      string partial; // the start of a line whose newline hasn't come yet
+      string cleaned;
+
+      bool reopen();
+      bool replaced();
+      size_t drain(linering&);
+      void addLine(linering&, const char*, size_t);
+
+   public:
+      follower();
+      ~follower();
+
+      bool open(const string&);
+      bool attach(const int);
+
+      int waitFd() const;
+      int timeout() const;
+      bool done() const;
+
+      size_t read(linering&);
+};
+
+/**
+ * @constructs follower
+ * Starts out following nothing.
+ */
+follower::follower() {
+   fd = notify = -1;
+   ended = backlog = missing = false;
+}
+
+follower::~follower() {
+   if (fd >= 0) close(fd);
+   if (notify >= 0) close(notify);
+}
+
+/**
+ * @method open
+ * Follows a file, starting with what's already in it.
+ * @param {const string&} filename - the file to follow
+ * @returns {bool} true if the file could be opened.
+ */
+bool follower::open(const string& filename) {
+   path = filename;
+   return reopen();
+}
+
+/**
+ * @method attach
+ * Reads a pipe (or anything else) until it's closed.  The follower closes
+ * the descriptor when it's done with it.
+ * @param {const int} descriptor - what to read
+ * @returns {bool} true if it can be read.
+ */
+bool follower::attach(const int descriptor) {
+   path.clear();
+   fd = descriptor;
+   return (fd >= 0) && (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0);
+}
+
+/**
+ * @method waitFd
+ * @returns {int} the descriptor that becomes readable when there's more
+ * (or -1 if there's nothing to wait on; see timeout()).
+ */
+int follower::waitFd() const {
+   if (ended) return -1;
+   return path.empty() ? fd : notify;
+}
+
+/**
+ * @method timeout
+ * @returns {int} how long to wait on waitFd() before calling read() anyway,
+ * in milliseconds (-1 for as long as it takes).
+ */
+int follower::timeout() const {
+   if (backlog) return 0;
+   if (missing) return FOLLOW_POLL_MS; // nothing to be notified about until it's back
+   if (ended || path.empty() || (notify >= 0)) return -1;
+   return FOLLOW_POLL_MS;
+}
+
+/**
+ * @method done
+ * @returns {bool} true once a pipe has been closed; files never are.
+ */
+bool follower::done() const {
+   return ended;
+}
+
+/**
+ * @method read
+ * Reads whatever is there (up to FOLLOW_BATCH at a time) into a ring of lines.
+ * @param {linering&} ring - where the lines go
+ * @returns {size_t} how many lines were added.
+ */
+size_t follower::read(linering& ring) {
+   if ((fd < 0) || ended) return 0;
+
+#if defined(__linux__)
+   // the events themselves don't matter, only that there were some
+   if (notify >= 0) {
+      char events[4096];
+      while (::read(notify, events, sizeof events) > 0) {}
+   }
+#endif
+
+   if (!path.empty()) {
+      // truncated: start over
+      struct stat info;
+      if ((fstat(fd, &info) == 0) && (info.st_size < lseek(fd, 0, SEEK_CUR))) {
+         lseek(fd, 0, SEEK_SET);
+         partial.clear();
+      }
+   }
+
+   size_t added = drain(ring);
+
+   // replaced: the rest of the old file is read, so go on with the new one
+   if (!backlog && !path.empty() && replaced() && reopen()) {
+      added += drain(ring);
+   }
+   return added;
+}
+
+/**
+ * @private
+ * @method reopen
+ * Opens the file by name again (and watches it, where there's inotify).
+ * @returns {bool} true if it could be opened.
+ */
+bool follower::reopen() {
+   int opened = ::open(path.c_str(), O_RDONLY | O_NONBLOCK);
+   if (opened < 0) return false;
+
+   if (fd >= 0) close(fd);
+   fd = opened;
+   partial.clear();
+
+#if defined(__linux__)
+   if (notify >= 0) close(notify);
+   notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if ((notify >= 0) && (inotify_add_watch(notify, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0)) {
+      close(notify);
+      notify = -1;
+   }
+#endif
+   return true;
+}
+
+/**
+ * @private
+ * @method replaced
+ * Also notes whether the name is missing altogether, as it is between a
+ * log being moved away and the new one being created.
+ * @returns {bool} true if the name now belongs to a different file than the one open.
+ */
+bool follower::replaced() {
+   struct stat named, opened;
+   missing = (stat(path.c_str(), &named) != 0);
+   if (missing || (fstat(fd, &opened) != 0)) return false;
+   return (named.st_ino != opened.st_ino) || (named.st_dev != opened.st_dev);
+}
+
+/**
+ * @private
+ * @method drain
+ * Reads until there's nothing more right now, or FOLLOW_BATCH has been read.
+ * @param {linering&} ring - where the lines go
+ * @returns {size_t} how many lines were added.
+ */
+size_t follower::drain(linering& ring) {
+   size_t added = 0;
+   size_t total = 0;
+   char chunk[FOLLOW_CHUNK];
+   backlog = false;
+
+   while (true) {
+      if (total >= FOLLOW_BATCH) {
+         backlog = true;
+         break;
+      }
+
+      ssize_t n = ::read(fd, chunk, sizeof chunk);
+      if ((n == 0) && path.empty()) {
+         // the pipe was closed; whatever is left is the last line
+         if (!partial.empty()) {
+            addLine(ring, partial.data(), partial.length());
+            partial.clear();
+            added++;
+         }
+         ended = true;
+         break;
+      }
+      if (n <= 0) {
+         if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) && path.empty()) ended = true;
+         break;
+      }
+      total += n;
+
+      const char* start = chunk;
+      const char* end = chunk + n;
+      for (const char* newline; (newline = (const char*)memchr(start, '\n', end - start)) != NULL; start = newline + 1) {
+         if (partial.empty()) {
+            addLine(ring, start, newline - start);
+         } else {
+            partial.append(start, newline - start);
+            addLine(ring, partial.data(), partial.length());
+            partial.clear();
+         }
+         added++;
+      }
+      partial.append(start, end - start);
+   }
+
+   return added;
+}
+
+/**
+ * @private
+ * @method addLine
+ * Adds a line to the ring with its control characters made printable.
+ * @param {linering&} ring - where the line goes
+ * @param {const char*} text - the line, without its newline
+ * @param {const size_t} length - how long it is
+ */
+void follower::addLine(linering& ring, const char* text, size_t length) {
+   if ((length > 0) && (text[length - 1] == '\r')) length--;
+
+   bool plain = true;
+   for (size_t i = 0; (i < length) && plain; i++) {
+      plain = ((unsigned char)text[i] >= 0x20) && (text[i] != 0x7f);
+   }
+   if (plain) {
+      ring.push(text, length);
+      return;
+   }
+
+   cleaned.clear();
+   for (size_t i = 0; i < length; i++) {
+      if (text[i] == '\t') {
+         cleaned.append(8 - (cleaned.length() % 8), ' ');
+      } else if (((unsigned char)text[i] < 0x20) || (text[i] == 0x7f)) {
+         cleaned += '?';
+      } else {
+         cleaned += text[i];
+      }
+   }
+   ring.push(cleaned.data(), cleaned.length());
+}
+
+#endif
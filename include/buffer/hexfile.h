@@ -0,0 +1,275 @@
+/*
+ * Class: hexfile
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A binary file being edited in place, for the hex editor.  The file is
+ *      never read into memory: a window of it (HEXFILE_WINDOW bytes) is
+ *      read with pread() at a time, and read again elsewhere when bytes
+ *      outside it are asked for, so memory stays the same whatever the size
+ *      of the file (even larger than RAM, or than the address space).  It's
+ *      read rather than mapped so that another process cutting the file
+ *      short only makes the bytes past the new end read as zeros, where a
+ *      mapping would take SIGBUS.
+ *
+ *      Edits never touch the window.  They go into an overlay, a map of the
+ *      ranges changed (by where they start, none of them touching), which
+ *      save() writes back into the file where they belong.  Bytes can only be
+ *      changed, never inserted or removed, so nothing else moves.
+ */
+
+#ifndef HEXFILE_H
+#define HEXFILE_H
+
+#include <string>
+#include <map>
+#include <iterator>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// how much of the file is read at once (a multiple of the page size)
+#define HEXFILE_WINDOW (1024 * 1024)
+
+class hexfile {
+   private:
+      int fd;
+      bool writable;
+      off_t length;
+
+      // the part of the file read in right now
+      string window;
+      off_t windowStart;
+
+      map<off_t, string> patches; // changed ranges, by where they start
+
+      bool moveWindow(const off_t);
+
+   public:
+      hexfile();
+      ~hexfile();
+
+      bool open(const string&);
+      bool readOnly() const;
+      off_t size() const;
+
+      void read(const off_t, const size_t, string&);
+      unsigned char at(const off_t);
+      bool changed(const off_t) const;
+      void set(const off_t, const unsigned char);
+      bool modified() const;
+      bool save();
+};
+
+/**
+ * @constructs hexfile
+ * Starts out with no file.
+ */
+hexfile::hexfile() {
+   fd = -1;
+   writable = false;
+   length = 0;
+   windowStart = 0;
+}
+
+/**
+ * Closes the file; unsaved changes are lost.
+ */
+hexfile::~hexfile() {
+   if (fd >= 0) close(fd);
+}
+
+/**
+ * @method open
+ * Opens a file for editing, or just for looking at if it can't be written.
+ * @param {const string&} filename - the file
+ * @returns {bool} true if the file could be opened.
+ */
+bool hexfile::open(const string& filename) {
+   fd = ::open(filename.c_str(), O_RDWR);
+   writable = (fd >= 0);
+   if (fd < 0) fd = ::open(filename.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+
+   struct stat info;
+   if ((fstat(fd, &info) != 0) || !S_ISREG(info.st_mode)) {
+      close(fd);
+      fd = -1;
+      return false;
+   }
+   length = info.st_size;
+   return true;
+}
+
+/**
+ * @method readOnly
+ * @returns {bool} true if the file couldn't be opened for writing.
+ */
+bool hexfile::readOnly() const {
+   return !writable;
+}
+
+/**
+ * @method size
+ * @returns {off_t} the size of the file in bytes.
+ */
+off_t hexfile::size() const {
+   return length;
+}
+
+/**
+ * @method read
+ * Gets a run of bytes as they are now, edits included.
+ * @param {const off_t} offset - where the run starts
+ * @param {const size_t} count - how many bytes (fewer past the end of the file)
+ * @param {string&} bytes - replaced by the bytes
+ */
+void hexfile::read(const off_t offset, const size_t count, string& bytes) {
+   bytes.clear();
+   if (offset >= length) return;
+   size_t wanted = (size_t)min((off_t)count, length - offset);
+
+   // from the file, a window at a time
+   while (bytes.length() < wanted) {
+      off_t at = offset + bytes.length();
+      if ((at < windowStart) || (at >= windowStart + (off_t)window.length())) {
+         if (!moveWindow(at)) {
+            bytes.append(wanted - bytes.length(), '\0');
+            break;
+         }
+      }
+      size_t n = min(wanted - bytes.length(), (size_t)(windowStart + window.length() - at));
+      bytes.append(window, at - windowStart, n);
+   }
+
+   // then the edits that fall in the run
+   auto patch = patches.upper_bound(offset);
+   if (patch != patches.begin()) patch--;
+   for (; (patch != patches.end()) && (patch->first < offset + (off_t)wanted); patch++) {
+      off_t from = max(patch->first, offset);
+      off_t to = min(patch->first + (off_t)patch->second.length(), offset + (off_t)wanted);
+      if (from < to) memcpy(&bytes[from - offset], patch->second.data() + (from - patch->first), to - from);
+   }
+}
+
+/**
+ * @method at
+ * @param {const off_t} offset - a byte of the file
+ * @returns {unsigned char} the byte as it is now.
+ */
+unsigned char hexfile::at(const off_t offset) {
+   string byte;
+   read(offset, 1, byte);
+   return byte.empty() ? 0 : byte[0];
+}
+
+/**
+ * @method changed
+ * @param {const off_t} offset - a byte of the file
+ * @returns {bool} true if the byte was edited since the file was opened or saved.
+ */
+bool hexfile::changed(const off_t offset) const {
+   auto patch = patches.upper_bound(offset);
+   if (patch == patches.begin()) return false;
+   patch--;
+   return offset < patch->first + (off_t)patch->second.length();
+}
+
+/**
+ * @method set
+ * Changes a byte.  The range it goes into grows to take it in, and joins
+ * the range after it if they meet.
+ * @param {const off_t} offset - the byte (inside the file)
+ * @param {const unsigned char} value - what it becomes
+ */
+void hexfile::set(const off_t offset, const unsigned char value) {
+   if ((offset < 0) || (offset >= length)) return;
+
+   auto patch = patches.upper_bound(offset);
+   if (patch != patches.begin()) {
+      auto before = prev(patch);
+      off_t end = before->first + before->second.length();
+      if (offset < end) {
+         before->second[offset - before->first] = value;
+         return;
+      }
+      if (offset == end) {
+         before->second += (char)value;
+         if ((patch != patches.end()) && (patch->first == offset + 1)) {
+            before->second += patch->second;
+            patches.erase(patch);
+         }
+         return;
+      }
+   }
+
+   string range(1, (char)value);
+   if ((patch != patches.end()) && (patch->first == offset + 1)) {
+      range += patch->second;
+      patches.erase(patch);
+   }
+   patches.emplace(offset, move(range));
+}
+
+/**
+ * @method modified
+ * @returns {bool} true if there are edits that haven't been saved.
+ */
+bool hexfile::modified() const {
+   return !patches.empty();
+}
+
+/**
+ * @method save
+ * Writes the edited ranges into the file, in place, and drops the window,
+ * which is read again with them in it.
+ * @returns {bool} true if all of them were written (those that were are forgotten).
+ */
+bool hexfile::save() {
+   if (!writable) return false;
+   window.clear();
+   for (auto patch = patches.begin(); patch != patches.end(); ) {
+      size_t done = 0;
+      while (done < patch->second.length()) {
+         ssize_t n = pwrite(fd, patch->second.data() + done, patch->second.length() - done, patch->first + done);
+         if (n <= 0) return false;
+         done += n;
+      }
+      patch = patches.erase(patch);
+   }
+   return fdatasync(fd) == 0;
+}
+
+/**
+ * @private
+ * @method moveWindow
+ * Reads the window in so that it starts at the page with a byte in it.
+ * Whatever is past the end of the file now (if it was cut short) is zeros.
+ * @param {const off_t} offset - the byte
+ * @returns {bool} true if it could be read.
+ */
+bool hexfile::moveWindow(const off_t offset) {
+   off_t page = sysconf(_SC_PAGESIZE);
+   windowStart = offset - (offset % page);
+   window.assign((size_t)min((off_t)HEXFILE_WINDOW, length - windowStart), '\0');
+   for (size_t done = 0; done < window.length(); ) {
+      ssize_t n = pread(fd, &window[done], window.length() - done, windowStart + done);
+      if ((n < 0) && (errno == EINTR)) continue;
+      if (n < 0) {
+         window.clear();
+         return false;
+      }
+      if (n == 0) break;
+      done += n;
+   }
+   return true;
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Class: highlighter
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Syntax highlighting for one document, without lexing the whole thing
+ *      on every key.  The state each line ends in is kept, for the lines from
+ *      the top of the document to as far down as anything has been drawn.
+ *      After an edit only the changed lines are lexed again, and then the
+ *      lines after them until one ends in the same state it did before; from
+ *      there on nothing can have changed.  Lines further down than the screen
+ *      are left until they're scrolled to.
+ *
+ *      The languages themselves live in syntax.h.
+ */
+
+#ifndef HIGHLIGHTER_H
+#define HIGHLIGHTER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "document.h"
+#include "syntax.h"
+
+using namespace std;
+
+// refresh() found nothing that needs painting again
+#define HIGHLIGHT_UNCHANGED ((size_t)-1)
+
+class highlighter {
+   private:
+      const language* lang;
+      vector<int> states; // the state each line ends in, for the lines lexed so far
+
+      // the classes of the last line asked for
+      size_t cachedLine;
+      size_t cachedRevision;
+      vector<unsigned char> cached;
+
+      int stateBefore(const document&, const size_t);
+
+   public:
+      highlighter();
+
+      bool choose(const string&, const document&);
+      bool active() const;
+      const char* name() const;
+
+      size_t refresh(document&, const size_t);
+      const unsigned char* classes(const document&, const size_t);
+};
+
+/**
+ * @constructs highlighter
+ * Starts out highlighting nothing.
+ */
+highlighter::highlighter() {
+   lang = NULL;
+   cachedLine = cachedRevision = HIGHLIGHT_UNCHANGED;
+}
+
+/**
+ * @method choose
+ * Picks the language for a file by its extension, or for a shell script by
+ * its #! line, and starts over.
+ * @param {const string&} filename - the name of the file
+ * @param {const document&} doc - its contents
+ * @returns {bool} true if there is a language for it.
+ */
+bool highlighter::choose(const string& filename, const document& doc) {
+   lang = NULL;
+   for (const language& candidate : languages) {
+      for (const char* const* extension = candidate.extensions; *extension && !lang; extension++) {
+         size_t length = strlen(*extension);
+         if ((filename.length() > length) && (filename.compare(filename.length() - length, length, *extension) == 0)) {
+            lang = &candidate;
+         }
+      }
+   }
+
+   if (!lang && !doc.empty() && (doc.at(0).compare(0, 2, "#!") == 0) && (doc.at(0).find("sh") != string::npos)) {
+      for (const language& candidate : languages) {
+         if (candidate.lex == lexShell) lang = &candidate;
+      }
+   }
+
+   states.clear();
+   cachedLine = HIGHLIGHT_UNCHANGED;
+   return lang != NULL;
+}
+
+/**
+ * @method active
+ * @returns {bool} true if there is anything to highlight.
+ */
+bool highlighter::active() const {
+   return lang != NULL;
+}
+
+/**
+ * @method name
+ * @returns {const char*} the name of the language, or "" if none.
+ */
+const char* highlighter::name() const {
+   return lang ? lang->name : "";
+}
+
+/**
+ * @method refresh
+ * Catches up with the edits made to the document since the last call, and
+ * lexes again whatever they could have changed (down to lastLine at most;
+ * past that is forgotten and done again when it's needed).
+ * @param {document&} doc - the document being highlighted
+ * @param {const size_t} lastLine - the last line on the screen
+ * @returns {size_t} the last line whose colors may have changed (every
+ * changed line from the first edit on), or HIGHLIGHT_UNCHANGED.
+ */
+size_t highlighter::refresh(document& doc, const size_t lastLine) {
+   linechanges changes = doc.takeChanges();
+   if (!lang || !changes.any) return HIGHLIGHT_UNCHANGED;
+   cachedLine = HIGHLIGHT_UNCHANGED;
+
+   // nothing from there down has been drawn yet, so it can wait until it is
+   if (changes.from >= states.size()) return HIGHLIGHT_UNCHANGED;
+
+   // lines [from, oldTo] were replaced by [from, to]; if that runs past what
+   // was lexed, start over from the edit
+   long oldTo = (long)changes.to - changes.shift;
+   if ((changes.to >= doc.size()) || (oldTo >= (long)states.size()) || (oldTo + 1 < (long)changes.from)) {
+      states.resize(changes.from);
+      return lastLine;
+   }
+   int oldEnd = (oldTo >= 0) ? states[oldTo] : 0;
+   states.erase(states.begin() + changes.from, states.begin() + (oldTo + 1));
+   states.insert(states.begin() + changes.from, changes.to - changes.from + 1, 0);
+
+   // lex again until a line ends the way it used to; nothing after it changes
+   for (size_t line = changes.from; line < states.size(); line++) {
+      int state = lang->lex(doc.at(line), (line == 0) ? 0 : states[line - 1], NULL);
+      bool settled = (line == changes.to) ? (state == oldEnd) : ((line > changes.to) && (state == states[line]));
+      states[line] = state;
+      if (settled) return line;
+
+      if ((line >= lastLine) && (line >= changes.to)) {
+         // not settled by the bottom of the screen: forget the rest
+         states.resize(line + 1);
+         return lastLine;
+      }
+   }
+   return lastLine;
+}
+
+/**
+ * @method classes
+ * @param {const document&} doc - the document being highlighted
+ * @param {const size_t} line - the line to get the classes of
+ * @returns {const unsigned char*} the SYNTAX_ class of every character of the line.
+ */
+const unsigned char* highlighter::classes(const document& doc, const size_t line) {
+   if ((line == cachedLine) && (doc.revision == cachedRevision)) return cached.data();
+
+   const string& text = doc.at(line);
+   cached.resize(text.length() + 1);
+   int state = lang->lex(text, stateBefore(doc, line), cached.data());
+   if (line == states.size()) states.push_back(state);
+
+   cachedLine = line;
+   cachedRevision = doc.revision;
+   return cached.data();
+}
+
+/**
+ * @private
+ * @method stateBefore
+ * Lexes as far down as needed to know the state a line starts in.
+ * @param {const document&} doc - the document being highlighted
+ * @param {const size_t} line - the line
+ * @returns {int} the state the line before it ended in (0 for the first line).
+ */
+int highlighter::stateBefore(const document& doc, const size_t line) {
+   while (states.size() < line) {
+      size_t next = states.size();
+      states.push_back(lang->lex(doc.at(next), (next == 0) ? 0 : states[next - 1], NULL));
+   }
+   return (line == 0) ? 0 : states[line - 1];
+}
+
+#endif
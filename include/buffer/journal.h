@@ -0,0 +1,844 @@
+/*
+ * Class: journal
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      An append-only log of the edits made to a document, so that a session
+ *      which dies before it is saved can be recovered.  Each edit is a tiny
+ *      binary record (an opcode and a few varints), runs of typing and
+ *      backspacing are folded into single records, and nothing touches the
+ *      disk until sync() is called, which the editor does when the keyboard
+ *      goes idle.  Edits apply to the current buffer; opening and switching
+ *      buffers are recorded too.  Saving a buffer records that it's to be
+ *      loaded again from its file, which has its edits now, and replay skips
+ *      the edits that a later load makes moot.  Once no other buffer has
+ *      changes, saving starts the journal over with just the buffers' names,
+ *      written aside and renamed into place, so a crash leaves the old one or
+ *      the new one.  Pasting into another buffer than the one copied from
+ *      records the clipboard's text first, so no buffer's edits ever depend
+ *      on another's.
+ *
+ *      Record layout: one opcode byte followed by LEB128 numbers; text is a
+ *      length followed by the bytes.  Files are recorded along with the size
+ *      and mtime they had, and replay leaves out the edits to one that has
+ *      changed since, instead of applying them to lines they weren't made on.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "document.h"
+#include "clipboard.h"
+#include "buffers.h"
+#include "tidy.h"
+
+using namespace std;
+
+#define JOURNAL_MAGIC "TXJ2"
+
+#define JOURNAL_INSERT 1 // line chr text
+#define JOURNAL_ERASE 2  // line chr count
+#define JOURNAL_SPLIT 3  // line chr
+#define JOURNAL_JOIN 4   // line (joined onto the line before it)
+#define JOURNAL_COPY 5   // fromline fromchr toline tochr
+#define JOURNAL_CUT 6    // fromline fromchr toline tochr
+#define JOURNAL_PASTE 7  // line chr
+#define JOURNAL_BASE 8   // file (the current buffer is that file, loaded again)
+#define JOURNAL_CLIP 9   // text (the clipboard holds that text)
+#define JOURNAL_OPEN 10  // file (a new buffer with that file is current)
+#define JOURNAL_SWITCH 11 // index (that buffer is current)
+#define JOURNAL_TEXT 12  // text (the current buffer holds that text, unsaved)
+#define JOURNAL_TIDY 13  // fromline toline command (see tidy.h)
+// a file is its name, then its size plus one (0 for no file), and its mtime
+// in seconds and nanoseconds
+
+// where the clipboard came from, when it isn't a buffer
+#define JOURNAL_CLIP_WRITTEN -1 // a JOURNAL_CLIP record has its text
+#define JOURNAL_CLIP_UNKNOWN -2 // replayed from an earlier session
+
+class journal {
+   private:
+      int fd;
+      string path;
+      string pending;
+      chrono::steady_clock::time_point lastSync;
+
+      // the run of typing (or backspacing) that hasn't been encoded yet
+      int runOp;
+      size_t runLine;
+      size_t runChr;
+      size_t runCount;
+      string runText;
+
+      // the buffer edits go to, how many there are, and which one the
+      // clipboard was copied (or cut) from
+      size_t current;
+      size_t bufferCount;
+      long clipSource;
+
+      // files replay found changed since their edits were made
+      vector<string> changed;
+
+      void endRun();
+      bool restart(bufferlist&, const clipboard&);
+      void putNumber(size_t);
+      void putText(const string&);
+      void putFile(const int, const string&, const document&);
+      void putRange(const int, const textpos, const textpos);
+
+   public:
+      journal();
+      ~journal();
+
+      bool open(const string&);
+      bool enabled() const;
+      bool dirty() const;
+      bool overdue(const int) const;
+
+      void insert(const size_t, const size_t, const char);
+      void erase(const size_t, const size_t);
+      void split(const size_t, const size_t);
+      void join(const size_t);
+      void copy(const textpos, const textpos);
+      void cut(const textpos, const textpos);
+      void paste(const textpos, const clipboard&);
+      void tidied(const size_t, const size_t, const string&);
+      void opened(const string&, const document&);
+      void switched(const size_t);
+      void rebase(bufferlist&, const clipboard&);
+
+      void sync();
+      void discard();
+      size_t replay(bufferlist&, clipboard&);
+      const vector<string>& changedFiles() const;
+};
+
+/**
+ * @constructs journal
+ * The journal does nothing until it is opened.
+ */
+journal::journal() {
+   fd = -1;
+   runOp = 0;
+   runLine = runChr = runCount = 0;
+   current = 0;
+   bufferCount = 1;
+   clipSource = JOURNAL_CLIP_WRITTEN;
+   lastSync = chrono::steady_clock::now();
+}
+
+/**
+ * @destructs journal
+ * Writes out anything still pending.
+ */
+journal::~journal() {
+   if (fd >= 0) {
+      sync();
+      close(fd);
+   }
+}
+
+/**
+ * @method open
+ * Opens (creating if needed) the journal file, and locks it for as long as
+ * this session runs.  A file left behind by an earlier session is kept so
+ * that it can be replayed; one another session still holds isn't touched.
+ * @param {const string&} filename - where to keep the journal
+ * @returns {bool} true if the journal could be opened and is this session's.
+ */
+bool journal::open(const string& filename) {
+   path = filename;
+   fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+   if ((fd >= 0) && (flock(fd, LOCK_EX | LOCK_NB) != 0)) {
+      close(fd);
+      fd = -1;
+   }
+   return fd >= 0;
+}
+
+/**
+ * @method enabled
+ * @returns {bool} true if edits are being recorded.
+ */
+bool journal::enabled() const {
+   return fd >= 0;
+}
+
+/**
+ * @method dirty
+ * @returns {bool} true if there are edits that haven't hit the disk yet.
+ */
+bool journal::dirty() const {
+   return (fd >= 0) && (runOp || !pending.empty());
+}
+
+/**
+ * @method overdue
+ * For when the keyboard never goes idle long enough to sync.
+ * @param {const int} ms - the longest edits may wait before being synced
+ * @returns {bool} true if the last sync was more than ms ago.
+ */
+bool journal::overdue(const int ms) const {
+   return chrono::steady_clock::now() - lastSync > chrono::milliseconds(ms);
+}
+
+/**
+ * @function splitLines
+ * Appends text to a document, one line per newline.
+ * @param {document&} doc - the document to append to
+ * @param {const string&} s - the text
+ */
+void splitLines(document& doc, const string& s) {
+   size_t start = 0, newline;
+   while ((newline = s.find('\n', start)) != string::npos) {
+      doc.insert(doc.size(), s.substr(start, newline - start));
+      start = newline + 1;
+   }
+   doc.insert(doc.size(), s.substr(start));
+}
+
+/**
+ * @function absolutePath
+ * Replay may happen from another directory, so files are journaled by
+ * their absolute path when there is one.
+ * @param {const string&} filename - the file
+ * @returns {string} the absolute path, or filename if it can't be resolved.
+ */
+string absolutePath(const string& filename) {
+   if (filename.empty()) return filename;
+   char* absolute = realpath(filename.c_str(), NULL);
+   string result = absolute ? string(absolute) : filename;
+   free(absolute);
+   return result;
+}
+
+/**
+ * @private
+ * @method endRun
+ * Encodes the run of typing or backspacing being collected, if any.
+ */
+void journal::endRun() {
+   if (runOp == JOURNAL_INSERT) {
+      pending += (char)JOURNAL_INSERT;
+      putNumber(runLine);
+      putNumber(runChr);
+      putText(runText);
+      runText.clear();
+   } else if (runOp == JOURNAL_ERASE) {
+      pending += (char)JOURNAL_ERASE;
+      putNumber(runLine);
+      putNumber(runChr);
+      putNumber(runCount);
+   }
+   runOp = 0;
+}
+
+/**
+ * @private
+ * @method putNumber
+ * Appends an unsigned LEB128 number to the pending records.
+ */
+void journal::putNumber(size_t n) {
+   while (n >= 0x80) {
+      pending += (char)((n & 0x7f) | 0x80);
+      n >>= 7;
+   }
+   pending += (char)n;
+}
+
+/**
+ * @private
+ * @method putText
+ * Appends a length prefixed string to the pending records.
+ */
+void journal::putText(const string& text) {
+   putNumber(text.length());
+   pending += text;
+}
+
+/**
+ * @private
+ * @method putFile
+ * Appends a record made of an opcode and a file, as the document found it.
+ * @param {const int} op - JOURNAL_BASE or JOURNAL_OPEN
+ * @param {const string&} filename - the file
+ * @param {const document&} doc - the document loaded from (or saved to) it
+ */
+void journal::putFile(const int op, const string& filename, const document& doc) {
+   const diskfile& disk = doc.origin();
+   bool known = !disk.name.empty();
+   pending += (char)op;
+   putText(absolutePath(filename));
+   putNumber(known ? (size_t)disk.size + 1 : 0);
+   putNumber(known ? (size_t)disk.mtime.tv_sec : 0);
+   putNumber(known ? (size_t)disk.mtime.tv_nsec : 0);
+}
+
+/**
+ * @private
+ * @method putRange
+ * Appends a record made of an opcode and a range.
+ */
+void journal::putRange(const int op, const textpos from, const textpos to) {
+   endRun();
+   pending += (char)op;
+   putNumber(from.line);
+   putNumber(from.chr);
+   putNumber(to.line);
+   putNumber(to.chr);
+}
+
+/**
+ * @method insert
+ * Records a typed character.
+ * @param {const size_t} line - the line it was typed on
+ * @param {const size_t} chr - where in the line it went
+ * @param {const char} c - the character
+ */
+void journal::insert(const size_t line, const size_t chr, const char c) {
+   if (fd < 0) return;
+   if ((runOp != JOURNAL_INSERT) || (line != runLine) || (chr != runChr + runText.length())) {
+      endRun();
+      runOp = JOURNAL_INSERT;
+      runLine = line;
+      runChr = chr;
+   }
+   runText += c;
+}
+
+/**
+ * @method erase
+ * Records a character removed by backspace.
+ * @param {const size_t} line - the line it was removed from
+ * @param {const size_t} chr - where in the line it was
+ */
+void journal::erase(const size_t line, const size_t chr) {
+   if (fd < 0) return;
+   if ((runOp == JOURNAL_ERASE) && (line == runLine) && (chr + 1 == runChr)) {
+      runChr = chr;
+      runCount++;
+      return;
+   }
+   endRun();
+   runOp = JOURNAL_ERASE;
+   runLine = line;
+   runChr = chr;
+   runCount = 1;
+}
+
+/**
+ * @method split
+ * Records a line being broken in two by the enter key.
+ * @param {const size_t} line - the line that was split
+ * @param {const size_t} chr - where it was split
+ */
+void journal::split(const size_t line, const size_t chr) {
+   if (fd < 0) return;
+   endRun();
+   pending += (char)JOURNAL_SPLIT;
+   putNumber(line);
+   putNumber(chr);
+}
+
+/**
+ * @method join
+ * Records a line being appended to the one before it.
+ * @param {const size_t} line - the line that was appended (and removed)
+ */
+void journal::join(const size_t line) {
+   if (fd < 0) return;
+   endRun();
+   pending += (char)JOURNAL_JOIN;
+   putNumber(line);
+}
+
+/**
+ * @method copy
+ * Records a copy; the copied text itself is not written, since replay can
+ * copy it again from the document.
+ */
+void journal::copy(const textpos from, const textpos to) {
+   if (fd < 0) return;
+   putRange(JOURNAL_COPY, from, to);
+   clipSource = current;
+}
+
+/**
+ * @method cut
+ * Records a cut; like copy, only the range is written.
+ */
+void journal::cut(const textpos from, const textpos to) {
+   if (fd < 0) return;
+   putRange(JOURNAL_CUT, from, to);
+   clipSource = current;
+}
+
+/**
+ * @method paste
+ * Records a paste; the pasted text is whatever replay has in its clipboard.
+ * Text copied from another buffer is written out first, so that this one's
+ * edits still replay once that buffer's are dropped.
+ * @param {const textpos} at - where the text went
+ * @param {const clipboard&} clip - the clipboard pasted from
+ */
+void journal::paste(const textpos at, const clipboard& clip) {
+   if (fd < 0) return;
+   endRun();
+   if ((clipSource == JOURNAL_CLIP_UNKNOWN) || ((clipSource >= 0) && (clipSource != (long)current))) {
+      pending += (char)JOURNAL_CLIP;
+      putText(clip.text());
+      clipSource = JOURNAL_CLIP_WRITTEN;
+   }
+   pending += (char)JOURNAL_PASTE;
+   putNumber(at.line);
+   putNumber(at.chr);
+}
+
+/**
+ * @method tidied
+ * Records lines being sorted, deduplicated or filtered; replay runs the
+ * same command on the same lines, which gives the same result.
+ * @param {const size_t} first - the first line
+ * @param {const size_t} last - one past the last line
+ * @param {const string&} command - the command, as given to tidy()
+ */
+void journal::tidied(const size_t first, const size_t last, const string& command) {
+   if (fd < 0) return;
+   endRun();
+   pending += (char)JOURNAL_TIDY;
+   putNumber(first);
+   putNumber(last);
+   putText(command);
+}
+
+/**
+ * @method opened
+ * Records a new buffer being opened (and becoming current).
+ * @param {const string&} filename - the file loaded into it
+ * @param {const document&} doc - the buffer's document
+ */
+void journal::opened(const string& filename, const document& doc) {
+   if (fd < 0) return;
+   endRun();
+   putFile(JOURNAL_OPEN, filename, doc);
+   current = bufferCount++;
+}
+
+/**
+ * @method switched
+ * Records switching to another buffer.
+ * @param {const size_t} index - the buffer that is now current
+ */
+void journal::switched(const size_t index) {
+   if (fd < 0) return;
+   endRun();
+   pending += (char)JOURNAL_SWITCH;
+   putNumber(index);
+   current = index;
+}
+
+/**
+ * @method rebase
+ * After the current buffer is saved, makes its edits moot: replay loads it
+ * from the file now, which has them.  When no other buffer has changes, the
+ * journal starts over with just the buffers' names; otherwise a record that
+ * loads the buffer again is added, and the journal is started over at a
+ * later save.  Either way this costs what the buffers' names (and the
+ * clipboard) take, never what the journal or the saved file do.
+ * @param {bufferlist&} buffers - the open buffers
+ * @param {const clipboard&} clip - the current clipboard
+ */
+void journal::rebase(bufferlist& buffers, const clipboard& clip) {
+   if (fd < 0) return;
+   endRun();
+   if (restart(buffers, clip)) return;
+
+   const size_t saved = buffers.index();
+   putFile(JOURNAL_BASE, buffers.current().filename, buffers.current().file);
+
+   // the clipboard may have come from the edits just made moot
+   if (!clip.empty() && ((clipSource == (long)saved) || (clipSource == JOURNAL_CLIP_UNKNOWN))) {
+      pending += (char)JOURNAL_CLIP;
+      putText(clip.text());
+      clipSource = JOURNAL_CLIP_WRITTEN;
+   }
+   sync();
+}
+
+/**
+ * @private
+ * @method restart
+ * Starts the journal over with the buffers as they are on disk, if none of
+ * them has changes (besides the current one, which was just saved).  The new
+ * journal is written aside, synced, and renamed over the old one.
+ * @param {bufferlist&} buffers - the open buffers
+ * @param {const clipboard&} clip - the current clipboard
+ * @returns {bool} true if the journal was started over.
+ */
+bool journal::restart(bufferlist& buffers, const clipboard& clip) {
+   const size_t saved = buffers.index();
+   for (size_t i = 0; i < buffers.size(); i++) {
+      if ((i != saved) && buffers.at(i).modified()) return false;
+   }
+
+   string taken;
+   taken.swap(pending);
+   pending = JOURNAL_MAGIC;
+   for (size_t i = 0; i < buffers.size(); i++) {
+      putFile((i == 0) ? JOURNAL_BASE : JOURNAL_OPEN, buffers.at(i).filename, buffers.at(i).file);
+   }
+   if (saved + 1 != buffers.size()) {
+      pending += (char)JOURNAL_SWITCH;
+      putNumber(saved);
+   }
+   if (!clip.empty()) {
+      pending += (char)JOURNAL_CLIP;
+      putText(clip.text());
+   }
+   string fresh;
+   fresh.swap(pending);
+   pending.swap(taken);
+
+   // the new journal is locked before it takes the old one's place, so
+   // another session never finds it free
+   string aside = path + ".tmp";
+   int out = ::open(aside.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+   bool ok = (out >= 0) && (flock(out, LOCK_EX | LOCK_NB) == 0);
+   for (size_t done = 0; ok && (done < fresh.length()); ) {
+      ssize_t written = write(out, fresh.data() + done, fresh.length() - done);
+      if (written <= 0) ok = false; else done += written;
+   }
+   if (ok) ok = (fdatasync(out) == 0) && (fcntl(out, F_SETFL, O_APPEND) == 0);
+   if (ok) ok = (rename(aside.c_str(), path.c_str()) == 0);
+
+   if (!ok) {
+      if (out >= 0) close(out);
+      unlink(aside.c_str());
+      return false;
+   }
+
+   // the rename has to be on disk as well
+   size_t slash = path.find_last_of('/');
+   int directory = ::open((slash == string::npos) ? "." : path.substr(0, slash + 1).c_str(), O_RDONLY | O_DIRECTORY);
+   if (directory >= 0) {
+      fsync(directory);
+      close(directory);
+   }
+   close(fd);
+   fd = out;
+   pending.clear();
+   clipSource = JOURNAL_CLIP_WRITTEN;
+   lastSync = chrono::steady_clock::now();
+   return true;
+}
+
+/**
+ * @method sync
+ * Writes the pending records and waits for them to reach the disk.
+ */
+void journal::sync() {
+   if (fd < 0) return;
+   endRun();
+
+   // a brand new journal starts with the magic number
+   struct stat info;
+   if ((fstat(fd, &info) == 0) && (info.st_size == 0) && (pending.compare(0, 4, JOURNAL_MAGIC) != 0)) {
+      pending.insert(0, JOURNAL_MAGIC);
+   }
+
+   size_t written = 0;
+   while (written < pending.length()) {
+      ssize_t n = write(fd, pending.data() + written, pending.length() - written);
+      if (n <= 0) break;
+      written += n;
+   }
+   pending.erase(0, written);
+   fdatasync(fd);
+   lastSync = chrono::steady_clock::now();
+}
+
+/**
+ * @method discard
+ * Removes the journal; used when the editor exits on purpose.
+ */
+void journal::discard() {
+   if (fd < 0) return;
+   close(fd);
+   fd = -1;
+   unlink(path.c_str());
+}
+
+/**
+ * @method replay
+ * Applies a journal left behind by an earlier session.  Stops quietly at
+ * the first record that is cut short or doesn't fit the document, which is
+ * what the tail of a journal looks like after a crash.  Edits to a buffer
+ * that it's loaded again after (it was saved) are skipped, and so are those
+ * to a file that isn't the size, or doesn't have the mtime, it had when they
+ * were made; changedFiles() lists those files, which are recorded again as
+ * they are now.
+ * The cursor of each buffer is left where its last edit happened.
+ * @param {bufferlist&} buffers - the buffers to apply the edits to
+ * @param {clipboard&} clip - the clipboard to apply the edits to
+ * @returns {size_t} the number of records applied.
+ */
+size_t journal::replay(bufferlist& buffers, clipboard& clip) {
+   if (fd < 0) return 0;
+
+   string data;
+   char chunk[4096];
+   ssize_t n;
+   off_t offset = 0;
+   while ((n = pread(fd, chunk, sizeof chunk, offset)) > 0) {
+      data.append(chunk, n);
+      offset += n;
+   }
+   if (data.compare(0, 4, JOURNAL_MAGIC) != 0) {
+      // not a journal we can read, start a new one
+      if (ftruncate(fd, 0) != 0) discard();
+      return 0;
+   }
+
+   size_t pos = 4;
+   bool ok = true;
+   auto number = [&]() -> size_t {
+      size_t result = 0;
+      for (int shift = 0; ok; shift += 7) {
+         if ((pos >= data.length()) || (shift > 63)) { ok = false; break; }
+         unsigned char byte = data[pos++];
+         result |= (size_t)(byte & 0x7f) << shift;
+         if (!(byte & 0x80)) break;
+      }
+      return result;
+   };
+   auto text = [&]() -> string {
+      size_t length = number();
+      if (!ok || (length > data.length() - pos)) { ok = false; return ""; }
+      pos += length;
+      return data.substr(pos - length, length);
+   };
+   auto skip = [&](const int op) {
+      if ((op == JOURNAL_INSERT) || (op == JOURNAL_TIDY)) {
+         number(); number(); text();
+      } else if (op == JOURNAL_ERASE) {
+         number(); number(); number();
+      } else if ((op == JOURNAL_SPLIT) || (op == JOURNAL_PASTE)) {
+         number(); number();
+      } else if ((op == JOURNAL_JOIN) || (op == JOURNAL_SWITCH)) {
+         number();
+      } else if ((op == JOURNAL_COPY) || (op == JOURNAL_CUT)) {
+         number(); number(); number(); number();
+      } else if ((op == JOURNAL_BASE) || (op == JOURNAL_OPEN)) {
+         text(); number(); number(); number();
+      } else if ((op == JOURNAL_TEXT) || (op == JOURNAL_CLIP)) {
+         text();
+      } else {
+         ok = false;
+      }
+   };
+
+   // first, where each buffer is last loaded (or given its whole text)
+   vector<size_t> loads(1, 0);
+   size_t which = 0;
+   while (ok && (pos < data.length())) {
+      size_t start = pos;
+      int op = data[pos++];
+      if (op == JOURNAL_OPEN) {
+         which = loads.size();
+         loads.push_back(start);
+      } else if ((op == JOURNAL_BASE) || (op == JOURNAL_TEXT)) {
+         loads[which] = start;
+      }
+      if (op == JOURNAL_SWITCH) {
+         which = number();
+         if (!ok || (which >= loads.size())) break;
+      } else {
+         skip(op);
+      }
+   }
+   pos = 4;
+   ok = true;
+
+   // whether a buffer's file is still the one its edits were made on
+   auto same = [&](const document& doc) {
+      size_t size = number();
+      size_t sec = number();
+      size_t nsec = number();
+      const diskfile& disk = doc.origin();
+      if (disk.name.empty()) return size == 0;
+      return (size == (size_t)disk.size + 1) && (sec == (size_t)disk.mtime.tv_sec) && (nsec == (size_t)disk.mtime.tv_nsec);
+   };
+   vector<bool> stale(buffers.size(), false);
+   changed.clear();
+
+   size_t applied = 0;
+   size_t good = pos;
+   while (ok && (pos < data.length())) {
+      size_t start = pos;
+      int op = data[pos++];
+
+      // edits to a buffer that's loaded again later are moot
+      bool global = (op == JOURNAL_OPEN) || (op == JOURNAL_SWITCH) || (op == JOURNAL_CLIP);
+      size_t index = buffers.index();
+      bool moot = (index < loads.size()) && (start < loads[index]);
+      if (!global && (moot || ((op != JOURNAL_BASE) && (op != JOURNAL_TEXT) && stale[index]))) {
+         skip(op);
+         if (!ok) break;
+         good = pos;
+         continue;
+      }
+
+      buffer& current = buffers.current();
+      document& doc = current.file;
+      textpos cursor = { current.virtualCursorLine, current.virtualCursorChar };
+      auto valid = [&](const textpos p) {
+         return (p.line < doc.size()) && (p.chr <= doc.at(p.line).length());
+      };
+
+      if (op == JOURNAL_INSERT) {
+         textpos at = { number(), number() };
+         string s = text();
+         if (!ok || !valid(at)) break;
+         doc.edit(at.line).insert(at.chr, s);
+         cursor = { at.line, at.chr + s.length() };
+      } else if (op == JOURNAL_ERASE) {
+         textpos at = { number(), number() };
+         size_t count = number();
+         if (!ok || !valid(at)) break;
+         doc.edit(at.line).erase(at.chr, count);
+         cursor = at;
+      } else if (op == JOURNAL_SPLIT) {
+         textpos at = { number(), number() };
+         if (!ok || !valid(at)) break;
+         doc.insert(at.line + 1, doc.at(at.line).substr(at.chr));
+         doc.edit(at.line).erase(at.chr);
+         cursor = { at.line + 1, 0 };
+      } else if (op == JOURNAL_JOIN) {
+         size_t line = number();
+         if (!ok || (line == 0) || (line >= doc.size())) break;
+         cursor = { line - 1, doc.at(line - 1).length() };
+         doc.edit(line - 1).append(doc.at(line));
+         doc.erase(line);
+      } else if ((op == JOURNAL_COPY) || (op == JOURNAL_CUT)) {
+         textpos from = { number(), number() };
+         textpos to = { number(), number() };
+         if (!ok || !valid(from) || !valid(to) || !(from < to)) break;
+         if (op == JOURNAL_COPY) {
+            clip.copy(doc, from, to);
+         } else {
+            clip.cut(doc, from, to);
+            cursor = from;
+         }
+      } else if (op == JOURNAL_PASTE) {
+         textpos at = { number(), number() };
+         if (!ok || !valid(at)) break;
+         cursor = clip.paste(doc, at);
+      } else if (op == JOURNAL_TIDY) {
+         size_t first = number();
+         size_t last = number();
+         string command = text();
+         if (!ok || !tidy(doc, first, last, command)) break;
+         cursor = { min(first, doc.size() - 1), 0 };
+      } else if (op == JOURNAL_BASE) {
+         string filename = text();
+         if (!ok) break;
+         current.filename = filename;
+         if (filename.empty() || !doc.load(filename)) {
+            doc.clear();
+            doc.insert(0, "");
+         }
+         stale[index] = !same(doc) && !filename.empty();
+         if (!ok) break;
+         if (stale[index]) changed.push_back(filename);
+         current.savedRevision = doc.revision;
+         current.highlight.choose(filename, doc);
+         cursor = { 0, 0 };
+      } else if (op == JOURNAL_TEXT) {
+         string s = text();
+         if (!ok) break;
+         doc.clear();
+         splitLines(doc, s);
+         stale[index] = false;
+         cursor = { 0, 0 };
+      } else if (op == JOURNAL_OPEN) {
+         string filename = text();
+         if (!ok) break;
+         // (one loaded again later is checked then)
+         bool fresh = same(buffers.add(filename).file) || ((stale.size() < loads.size()) && (start < loads[stale.size()]));
+         if (!ok) break;
+         stale.push_back(!fresh);
+         if (stale.back()) changed.push_back(filename);
+         applied++;
+         good = pos;
+         continue;
+      } else if (op == JOURNAL_SWITCH) {
+         size_t index = number();
+         if (!ok || !buffers.select(index)) break;
+         applied++;
+         good = pos;
+         continue;
+      } else if (op == JOURNAL_CLIP) {
+         string s = text();
+         if (!ok) break;
+         document scratch;
+         splitLines(scratch, s);
+         clip.copy(scratch, {0, 0}, {scratch.size() - 1, scratch.at(scratch.size() - 1).length()});
+      } else {
+         break;
+      }
+
+      current.virtualCursorLine = cursor.line;
+      current.virtualCursorChar = cursor.chr;
+      applied++;
+      good = pos;
+   }
+
+   // drop whatever couldn't be applied so new records follow good ones
+   if ((good < data.length()) && (ftruncate(fd, good) != 0)) discard();
+
+   // files that changed are taken as they are now, so that the edits made
+   // from here on are replayed next time
+   const size_t shown = buffers.index();
+   bool switched = false;
+   for (size_t i = 0; (fd >= 0) && (i < stale.size()); i++) {
+      if (!stale[i]) continue;
+      pending += (char)JOURNAL_SWITCH;
+      putNumber(i);
+      putFile(JOURNAL_BASE, buffers.at(i).filename, buffers.at(i).file);
+      switched = true;
+   }
+   if (switched) {
+      pending += (char)JOURNAL_SWITCH;
+      putNumber(shown);
+   }
+
+   // what comes next is recorded against where replay left things
+   current = shown;
+   bufferCount = buffers.size();
+   if (!clip.empty()) clipSource = JOURNAL_CLIP_UNKNOWN;
+
+   return applied;
+}
+
+/**
+ * @method changedFiles
+ * @returns {const vector<string>&} the files the last replay() left the
+ * edits to out of, as they had changed since.
+ */
+const vector<string>& journal::changedFiles() const {
+   return changed;
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Class: linepool
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Every line of every open document is a small fixed size node (the
+ *      string header plus its reference count).  Instead of a malloc() per
+ *      line, with its bookkeeping, nodes are carved out of large chunks
+ *      shared by all documents, and freed nodes go on a list for the next
+ *      line, whichever document it belongs to.  The text itself, when it is
+ *      too long to fit inside the string, is still allocated normally.
+ *
+ *      Like the rest of the editor, this is not thread safe.
+ */
+
+#ifndef LINEPOOL_H
+#define LINEPOOL_H
+
+#include <cstddef>
+#include <new>
+
+using namespace std;
+
+#define LINEPOOL_CHUNK 512 // nodes per chunk
+
+template <size_t Size>
+class linepool {
+   private:
+      union node {
+         node* next;
+         alignas(max_align_t) char storage[Size];
+      };
+
+      static node* freeList;
+
+   public:
+      static size_t used;     // nodes handed out
+      static size_t reserved; // nodes in all chunks
+
+      static void* allocate();
+      static void release(void*);
+};
+
+template <size_t Size> typename linepool<Size>::node* linepool<Size>::freeList = NULL;
+template <size_t Size> size_t linepool<Size>::used = 0;
+template <size_t Size> size_t linepool<Size>::reserved = 0;
+
+/**
+ * @method allocate
+ * @returns {void*} room for one node, taking a new chunk if the pool is empty.
+ */
+template <size_t Size>
+void* linepool<Size>::allocate() {
+   if (!freeList) {
+      node* chunk = static_cast<node*>(::operator new(sizeof(node) * LINEPOOL_CHUNK));
+      for (size_t i = 0; i < LINEPOOL_CHUNK; i++) {
+         chunk[i].next = (i + 1 < LINEPOOL_CHUNK) ? &chunk[i + 1] : NULL;
+      }
+      freeList = chunk;
+      reserved += LINEPOOL_CHUNK;
+   }
+
+   node* n = freeList;
+   freeList = n->next;
+   used++;
+   return n;
+}
+
+/**
+ * @method release
+ * Puts a node back for the next line.  Chunks are never handed back.
+ */
+template <size_t Size>
+void linepool<Size>::release(void* p) {
+   node* n = static_cast<node*>(p);
+   n->next = freeList;
+   freeList = n;
+   used--;
+}
+
+/**
+ * Allocator for allocate_shared() that takes single objects from the pool.
+ */
+template <typename T>
+struct lineallocator {
+   typedef T value_type;
+
+   lineallocator() {}
+   template <typename U> lineallocator(const lineallocator<U>&) {}
+
+   T* allocate(const size_t n) {
+      if (n == 1) return static_cast<T*>(linepool<sizeof(T)>::allocate());
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+   }
+
+   void deallocate(T* p, const size_t n) {
+      if (n == 1) linepool<sizeof(T)>::release(p);
+      else ::operator delete(p);
+   }
+};
+
+template <typename T, typename U>
+bool operator==(const lineallocator<T>&, const lineallocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const lineallocator<T>&, const lineallocator<U>&) { return false; }
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Class: linering
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      The most recent lines of a stream, up to a fixed number of them.  Once
+ *      it's full every new line takes the place of the oldest one, reusing
+ *      its string, so memory stays flat however much goes through.
+ *
+ *      Lines are numbered from the start of the stream, so a line keeps its
+ *      number while newer ones come in; first() is the oldest one still kept.
+ */
+
+#ifndef LINERING_H
+#define LINERING_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// a slot whose string grew past this much more than it holds gets a new one
+#define LINERING_SLACK 4096
+
+class linering {
+   private:
+      vector<string> slots;
+      size_t oldest; // the slot holding line first()
+      size_t count;
+      size_t dropped;
+
+   public:
+      linering(const size_t);
+
+      size_t capacity() const;
+      size_t size() const;
+      size_t first() const;
+      size_t end() const;
+
+      const string& at(const size_t) const;
+      void push(const char*, const size_t);
+};
+
+/**
+ * @constructs linering
+ * @param {const size_t} capacity - the most lines to keep (at least 1)
+ */
+linering::linering(const size_t capacity) {
+   slots.resize(capacity ? capacity : 1);
+   oldest = count = dropped = 0;
+}
+
+/**
+ * @method capacity
+ * @returns {size_t} the most lines that are kept.
+ */
+size_t linering::capacity() const {
+   return slots.size();
+}
+
+/**
+ * @method size
+ * @returns {size_t} the number of lines kept right now.
+ */
+size_t linering::size() const {
+   return count;
+}
+
+/**
+ * @method first
+ * @returns {size_t} the number of the oldest line kept (lines before it were dropped).
+ */
+size_t linering::first() const {
+   return dropped;
+}
+
+/**
+ * @method end
+ * @returns {size_t} one past the number of the newest line.
+ */
+size_t linering::end() const {
+   return dropped + count;
+}
+
+/**
+ * @method at
+ * @param {const size_t} line - the number of the line, from first() to end() - 1
+ * @returns {const string&} the text of the line.
+ */
+const string& linering::at(const size_t line) const {
+   return slots[(oldest + (line - dropped)) % slots.size()];
+}
+
+/**
+ * @method push
+ * Adds a line after the newest one, dropping the oldest if it's full.
+ * @param {const char*} text - the text of the line
+ * @param {const size_t} length - how long it is
+ */
+void linering::push(const char* text, const size_t length) {
+   string* slot;
+   if (count < slots.size()) {
+      slot = &slots[(oldest + count) % slots.size()];
+      count++;
+   } else {
+      slot = &slots[oldest];
+      oldest = (oldest + 1) % slots.size();
+      dropped++;
+   }
+
+   // one huge line shouldn't keep its memory forever
+   if (slot->capacity() > length + LINERING_SLACK) string().swap(*slot);
+   slot->assign(text, length);
+}
+
+#endif
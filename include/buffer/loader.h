@@ -0,0 +1,368 @@
+/*
+ * Class: loader
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Loads a big file in the background, so the editor can show the first
+ *      screen of it right away.  start() reads the first few KB itself and
+ *      puts those lines in the document; a thread reads the rest.
+ *
+ *      The thread only reads and splits lines into plain strings.  It never
+ *      touches the document or linepool, because neither is thread safe.
+ *      Batches of lines are handed over through a queue with one producer
+ *      and one consumer, which needs atomic loads and stores and no locks.
+ *      After each batch the thread writes a byte to a pipe, so the editor can
+ *      poll() for batches together with the keyboard.  collect() runs on the
+ *      editor's thread between keys and moves the lines into the document.
+ *      The thread stays at most LOADER_AHEAD batches ahead of collect(), so
+ *      memory the editor frees as it goes (by compressing lines, say) gets
+ *      reused for the next batches instead of the whole file piling up.
+ *
+ *      A load can start partway into the file, after lines that are already
+ *      in the document (attached from an index, see sidecar.h), and can
+ *      note the length of every line as it goes, for writing the index.
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "document.h"
+#include "sidecar.h"
+
+using namespace std;
+
+// files smaller than this are loaded in one go
+#define LOADER_THRESHOLD (4 * 1024 * 1024)
+
+// how much start() reads before the thread takes over, and how much the
+// thread reads at a time
+#define LOADER_FIRST 16384
+#define LOADER_CHUNK 65536
+
+// lines per batch handed over, how many batches can wait to be collected,
+// and how long the thread sleeps when that many are waiting
+#define LOADER_BATCH 8192
+#define LOADER_AHEAD 8
+#define LOADER_WAIT_US 1000
+
+struct loadbatch {
+   vector<string> lines;
+   atomic<loadbatch*> next;
+
+   loadbatch() : next(NULL) {}
+};
+
+class loader {
+   private:
+      int fd;
+      int wake; // written to after every batch
+      size_t total; // the size of the file, from where the load started
+      off_t from; // where it started
+      pthread_t thread;
+      bool threaded;
+
+      loadbatch* head; // already collected; the batches waiting come after it
+      loadbatch* tail; // the last batch handed over (the thread's)
+      atomic<size_t> bytesRead;
+      atomic<size_t> waiting; // batches handed over and not collected yet
+      size_t ahead; // how many can be waiting before the thread waits too
+      atomic<bool> finished;
+      atomic<bool> cancelled;
+
+      // the thread's
+      string partial;
+      size_t lineCount;
+      bool indexing;
+      string lengths; // of the lines read, as varints (see sidecar.h)
+      size_t lengthCount;
+
+      static void* run(void*);
+      void work();
+      void split(const char*, const size_t, vector<string>&);
+      void publish(loadbatch*);
+
+   public:
+      loader();
+      ~loader();
+
+      bool start(const string&, document&, const int, const off_t = 0, const bool = false);
+      size_t collect(document&);
+      void finish(document&);
+
+      bool done() const;
+      int percent() const;
+      off_t readTo() const;
+      const string& index() const;
+      size_t indexedLines() const;
+};
+
+/**
+ * @constructs loader
+ * Starts out loading nothing.
+ */
+loader::loader() : bytesRead(0), waiting(0), finished(false), cancelled(false) {
+   fd = wake = -1;
+   total = 0;
+   from = 0;
+   threaded = false;
+   head = tail = NULL;
+   lineCount = 0;
+   indexing = false;
+   lengthCount = 0;
+   ahead = LOADER_AHEAD;
+}
+
+/**
+ * Stops the thread (without reading the rest) and frees what it read.
+ */
+loader::~loader() {
+   cancelled.store(true, memory_order_relaxed);
+   if (threaded) pthread_join(thread, NULL);
+   while (head) {
+      loadbatch* next = head->next.load(memory_order_acquire);
+      delete head;
+      head = next;
+   }
+   if (fd >= 0) close(fd);
+}
+
+/**
+ * @method start
+ * Reads the first LOADER_FIRST bytes of a file into a document (which
+ * should be empty), or as much more as it takes to get a whole line, and
+ * starts a thread reading the rest.  If there's no
+ * thread to be had, reads the rest right here.
+ * @param {const string&} filename - the file to load
+ * @param {document&} doc - where the lines go (after those it has)
+ * @param {const int} wakeFd - a pipe to write a byte to whenever there's more to collect
+ * @param {const off_t} offset - where to start reading (just after the lines the document has)
+ * @param {const bool} index - true to note the length of every line read, for index()
+ * @returns {bool} true if the file could be read.
+ */
+bool loader::start(const string& filename, document& doc, const int wakeFd, const off_t offset, const bool index) {
+   fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0) return false;
+   if ((offset > 0) && (lseek(fd, offset, SEEK_SET) != offset)) return false;
+
+   struct stat info;
+   total = 0;
+   from = offset;
+   if (fstat(fd, &info) == 0) {
+      total = (info.st_size > offset) ? info.st_size - offset : 0;
+      doc.source(filename, info);
+   }
+   wake = wakeFd;
+   lineCount = doc.size();
+   indexing = index;
+
+   char first[LOADER_FIRST];
+   vector<string> lines;
+   ssize_t n;
+   while (lines.empty() && ((n = read(fd, first, sizeof first)) > 0)) {
+      split(first, n, lines);
+      bytesRead.store(bytesRead.load(memory_order_relaxed) + n, memory_order_relaxed);
+   }
+   if (lines.empty() && (!partial.empty() || (lineCount == 0))) {
+      // the whole file (or the rest of it) was one line
+      lines.push_back(move(partial));
+      partial.clear();
+      lineCount++;
+   }
+   for (string& line : lines) doc.append(move(line));
+
+   head = tail = new loadbatch();
+   ahead = LOADER_AHEAD;
+   threaded = (pthread_create(&thread, NULL, run, this) == 0);
+   if (!threaded) {
+      // nobody would collect while it waits
+      ahead = (size_t)-1;
+      work();
+   }
+   return true;
+}
+
+/**
+ * @method collect
+ * Moves the batches handed over so far into the document, up to
+ * LOADER_AHEAD of them (the thread would only hand over more meanwhile).
+ * @param {document&} doc - the document being loaded
+ * @returns {size_t} how many lines were added.
+ */
+size_t loader::collect(document& doc) {
+   size_t added = 0;
+   size_t batches = 0;
+   for (loadbatch* next; (batches < LOADER_AHEAD) && ((next = head->next.load(memory_order_acquire)) != NULL); batches++) {
+      for (string& line : next->lines) doc.append(move(line));
+      added += next->lines.size();
+      next->lines = vector<string>();
+
+      // the batch collected becomes the one the next comes after
+      delete head;
+      head = next;
+      waiting.fetch_sub(1, memory_order_release);
+   }
+
+   // whatever is left needs another wake up
+   if (head->next.load(memory_order_acquire)) {
+      char signal = 0;
+      if (write(wake, &signal, 1) < 0) {} // a full pipe already says so
+   }
+   return added;
+}
+
+/**
+ * @method finish
+ * Waits for the whole file to be read and collects all of it.
+ * @param {document&} doc - the document being loaded
+ */
+void loader::finish(document& doc) {
+   // the thread won't get far without batches being collected
+   while (threaded && !finished.load(memory_order_acquire)) {
+      collect(doc);
+      usleep(LOADER_WAIT_US);
+   }
+   if (threaded) {
+      pthread_join(thread, NULL);
+      threaded = false;
+   }
+   while (collect(doc) > 0) {}
+}
+
+/**
+ * @method done
+ * @returns {bool} true once the whole file has been read and collected.
+ */
+bool loader::done() const {
+   return finished.load(memory_order_acquire) && !head->next.load(memory_order_acquire);
+}
+
+/**
+ * @method percent
+ * @returns {int} how much of the file has been read, 0 to 100.
+ */
+int loader::percent() const {
+   if (total == 0) return 100;
+   return (int)(min(bytesRead.load(memory_order_relaxed), total) * 100 / total);
+}
+
+/**
+ * @method readTo
+ * @returns {off_t} how far into the file it has read.
+ */
+off_t loader::readTo() const {
+   return from + bytesRead.load(memory_order_relaxed);
+}
+
+/**
+ * @method index
+ * @returns {const string&} the lengths of the lines read that ended in a newline, newlines
+ * included, as varints; only once done(), and only if asked for.
+ */
+const string& loader::index() const {
+   return lengths;
+}
+
+/**
+ * @method indexedLines
+ * @returns {size_t} how many lines index() has.
+ */
+size_t loader::indexedLines() const {
+   return lengthCount;
+}
+
+/**
+ * @private
+ * @method run
+ * Where the thread starts.
+ */
+void* loader::run(void* self) {
+   static_cast<loader*>(self)->work();
+   return NULL;
+}
+
+/**
+ * @private
+ * @method work
+ * Reads the rest of the file in batches of lines (on the thread).
+ */
+void loader::work() {
+   char chunk[LOADER_CHUNK];
+   loadbatch* batch = new loadbatch();
+   ssize_t n;
+
+   while (!cancelled.load(memory_order_relaxed) && ((n = read(fd, chunk, sizeof chunk)) > 0)) {
+      split(chunk, n, batch->lines);
+      bytesRead.store(bytesRead.load(memory_order_relaxed) + n, memory_order_relaxed);
+
+      if (batch->lines.size() >= LOADER_BATCH) {
+         publish(batch);
+         batch = new loadbatch();
+         while ((waiting.load(memory_order_acquire) >= ahead) && !cancelled.load(memory_order_relaxed)) {
+            usleep(LOADER_WAIT_US);
+         }
+      }
+   }
+
+   // like document::load(): no blank line after a final newline, but
+   // always at least one line
+   if (!partial.empty() || (lineCount == 0)) batch->lines.push_back(move(partial));
+   publish(batch);
+   finished.store(true, memory_order_release);
+
+   // once more, now that done() can be true
+   char signal = 0;
+   if (write(wake, &signal, 1) < 0) {} // a full pipe already says so
+}
+
+/**
+ * @private
+ * @method split
+ * Splits text into lines; a line without its newline yet is kept for later.
+ * @param {const char*} text - what was read
+ * @param {const size_t} length - how much of it
+ * @param {vector<string>&} lines - where the complete lines go
+ */
+void loader::split(const char* text, const size_t length, vector<string>& lines) {
+   const char* start = text;
+   const char* end = text + length;
+   for (const char* newline; (newline = (const char*)memchr(start, '\n', end - start)) != NULL; start = newline + 1) {
+      partial.append(start, newline - start);
+      if (indexing) {
+         putVarint(lengths, partial.length() + 1);
+         lengthCount++;
+      }
+      lines.push_back(move(partial));
+      partial.clear();
+      lineCount++;
+   }
+   partial.append(start, end - start);
+}
+
+/**
+ * @private
+ * @method publish
+ * Hands a batch over to the editor's thread (from the thread).
+ * @param {loadbatch*} batch - the batch, which the loader owns from now on
+ */
+void loader::publish(loadbatch* batch) {
+   waiting.fetch_add(1, memory_order_relaxed);
+   tail->next.store(batch, memory_order_release);
+   tail = batch;
+
+   char signal = 0;
+   if (write(wake, &signal, 1) < 0) {} // a full pipe already says so
+}
+
+#endif
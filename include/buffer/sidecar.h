@@ -0,0 +1,485 @@
+/*
+ * Class: sidecar
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      An index of where the lines of a big file start, kept in a file of
+ *      its own (in a directory of them, named after a hash of the file's
+ *      full path), so that opening the file again doesn't mean reading all
+ *      of it to find the newlines.  It's keyed by the path, device, inode,
+ *      size and mtime of the file as it was indexed, and also remembers
+ *      where the user was in it (and at what width, for long lines).
+ *
+ *      After a fixed header and the path come a hash of every SIDECAR_PIECE
+ *      bytes indexed (the last piece may be shorter), and then the lengths
+ *      of the lines (newlines included) as varints, one after the other: a
+ *      byte or two a line.  Only lines that end in a newline are indexed.
+ *      If the file has grown since, and every piece still hashes the same,
+ *      the index still holds for that much, and only what comes after it
+ *      needs reading; the index is then written again with the new lines
+ *      added, and only the pieces from the last short one on hashed again.
+ *      A piece that doesn't match drops the index, which is written anew
+ *      once the whole file has been read.
+ */
+
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// what the index starts with, and how many bytes of the file each hash in it
+// is of
+#define SIDECAR_MAGIC "TEXTIDX2"
+#define SIDECAR_PIECE (1024 * 1024)
+
+/**
+ * Where the user was in the file.
+ */
+struct sidecarposition {
+   size_t width; // of the screen; startCursor only holds at the same width
+   size_t startLine;
+   size_t startCursor;
+   size_t cursorLine;
+   size_t cursorChar;
+};
+
+/**
+ * How an index file starts; the path follows, then the line lengths.
+ */
+struct sidecarheader {
+   char magic[8];
+   uint64_t dev;
+   uint64_t ino;
+   uint64_t size;
+   uint64_t mtimeSec;
+   uint64_t mtimeNsec;
+   uint64_t indexedBytes; // the indexed lines end here, just after a newline
+   uint64_t lines;
+   uint64_t pieces; // hashes of the indexed bytes after the path, a piece each
+   uint64_t width;
+   uint64_t startLine;
+   uint64_t startCursor;
+   uint64_t cursorLine;
+   uint64_t cursorChar;
+   uint64_t pathLength;
+};
+
+class sidecar {
+   private:
+      string indexPath;
+      const unsigned char* mapped;
+      size_t mappedLength;
+      sidecarheader header;
+
+      const unsigned char* lengths() const;
+      uint64_t piece(const size_t) const;
+
+      static uint64_t hash(const char*, const size_t, uint64_t);
+      static uint64_t sum(const char*, size_t);
+      static bool sumPieces(const int, off_t, const off_t, vector<uint64_t>&);
+
+   public:
+      sidecar();
+      ~sidecar();
+
+      static string location(const string&, const string&);
+      static bool write(const string&, const string&, const sidecar*, const string&, const size_t, const off_t, const sidecarposition&);
+
+      bool open(const string&, const string&);
+      void close();
+      bool valid() const;
+
+      off_t indexedBytes() const;
+      size_t lines() const;
+      void starts(const size_t, vector<off_t>&) const;
+      sidecarposition position() const;
+      bool remember(const sidecarposition&);
+};
+
+/**
+ * @function putVarint
+ * Adds a number to a string, seven bits a byte, lowest first; every byte
+ * but the last has its top bit set.
+ * @param {string&} bytes - where it goes
+ * @param {uint64_t} value - the number
+ */
+void putVarint(string& bytes, uint64_t value) {
+   while (value >= 0x80) {
+      bytes += (char)((value & 0x7f) | 0x80);
+      value >>= 7;
+   }
+   bytes += (char)value;
+}
+
+/**
+ * @function getVarint
+ * Reads a number putVarint() wrote.
+ * @param {const unsigned char*&} at - where it starts, moved past it
+ * @param {const unsigned char*} end - how far there is to read
+ * @returns {uint64_t} the number.
+ */
+uint64_t getVarint(const unsigned char*& at, const unsigned char* end) {
+   uint64_t value = 0;
+   for (int shift = 0; at < end; shift += 7) {
+      unsigned char byte = *at++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) break;
+   }
+   return value;
+}
+
+/**
+ * @constructs sidecar
+ * Starts out with no index.
+ */
+sidecar::sidecar() {
+   mapped = NULL;
+   mappedLength = 0;
+   memset(&header, 0, sizeof(header));
+}
+
+/**
+ * Unmaps the index.
+ */
+sidecar::~sidecar() {
+   close();
+}
+
+/**
+ * @method location
+ * @param {const string&} dir - the directory indexes are kept in
+ * @param {const string&} filename - a file
+ * @returns {string} where the index of the file goes ("" if the file isn't there).
+ */
+string sidecar::location(const string& dir, const string& filename) {
+   char* full = realpath(filename.c_str(), NULL);
+   if (!full) return "";
+   uint64_t h = hash(full, strlen(full), 0xcbf29ce484222325ULL);
+   free(full);
+
+   static const char* hexDigits = "0123456789abcdef";
+   string name(16, '0');
+   for (size_t i = 16; i-- > 0; h >>= 4) name[i] = hexDigits[h & 0xf];
+   return dir + "/" + name + ".idx";
+}
+
+/**
+ * @method write
+ * Writes the index of a file: the lines a previous index had (if there was
+ * one) and then the ones after them.  The index is written next to where
+ * it goes and renamed there, so it's never seen half written.
+ * @param {const string&} dir - the directory indexes are kept in
+ * @param {const string&} filename - the file indexed
+ * @param {const sidecar*} previous - the index the lines follow on from (NULL if none)
+ * @param {const string&} more - the lengths of the lines after those, as varints
+ * @param {const size_t} moreLines - how many lines that is
+ * @param {const off_t} readTo - how far the file was read (it was this big then)
+ * @param {const sidecarposition&} where - where the user is
+ * @returns {bool} true if it was written.
+ */
+bool sidecar::write(const string& dir, const string& filename, const sidecar* previous, const string& more,
+   const size_t moreLines, const off_t readTo, const sidecarposition& where) {
+   string path = location(dir, filename);
+   char* full = realpath(filename.c_str(), NULL);
+   struct stat info;
+   if (path.empty() || !full || (stat(full, &info) != 0)) {
+      free(full);
+      return false;
+   }
+   string fullPath = full;
+   free(full);
+
+   sidecarheader h;
+   memset(&h, 0, sizeof(h));
+   memcpy(h.magic, SIDECAR_MAGIC, sizeof(h.magic));
+   h.dev = info.st_dev;
+   h.ino = info.st_ino;
+   h.size = readTo;
+   h.mtimeSec = info.st_mtim.tv_sec;
+   h.mtimeNsec = info.st_mtim.tv_nsec;
+   h.lines = moreLines;
+   h.indexedBytes = 0;
+   const unsigned char* before = NULL;
+   size_t beforeLength = 0;
+   vector<uint64_t> sums;
+   if (previous && previous->valid()) {
+      h.lines += previous->header.lines;
+      h.indexedBytes = previous->header.indexedBytes;
+      before = previous->lengths();
+      beforeLength = previous->mapped + previous->mappedLength - before;
+      // whole pieces still hold; a short last one has more in it now
+      for (size_t k = 0; k < previous->header.indexedBytes / SIDECAR_PIECE; k++) sums.push_back(previous->piece(k));
+   }
+   const unsigned char* end = reinterpret_cast<const unsigned char*>(more.data()) + more.length();
+   for (const unsigned char* at = reinterpret_cast<const unsigned char*>(more.data()); at < end; ) {
+      h.indexedBytes += getVarint(at, end);
+   }
+   int file = ::open(fullPath.c_str(), O_RDONLY);
+   if (file < 0) return false;
+   bool summed = sumPieces(file, (off_t)sums.size() * SIDECAR_PIECE, h.indexedBytes, sums);
+   ::close(file);
+   if (!summed) return false;
+   h.pieces = sums.size();
+   h.width = where.width;
+   h.startLine = where.startLine;
+   h.startCursor = where.startCursor;
+   h.cursorLine = where.cursorLine;
+   h.cursorChar = where.cursorChar;
+   h.pathLength = fullPath.length();
+
+   string temporary = path + ".tmp";
+   int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd < 0) return false;
+   bool ok = true;
+   auto put = [&](const void* bytes, size_t length) {
+      const char* at = static_cast<const char*>(bytes);
+      while (ok && (length > 0)) {
+         ssize_t n = ::write(fd, at, length);
+         if (n <= 0) ok = false;
+         else at += n, length -= n;
+      }
+   };
+   put(&h, sizeof(h));
+   put(fullPath.data(), fullPath.length());
+   put(sums.data(), sums.size() * sizeof(uint64_t));
+   put(before, beforeLength);
+   put(more.data(), more.length());
+   ok = (::close(fd) == 0) && ok;
+   if (ok) ok = (rename(temporary.c_str(), path.c_str()) == 0);
+   if (!ok) unlink(temporary.c_str());
+   return ok;
+}
+
+/**
+ * @method open
+ * Maps the index of a file, if there's one and it still holds: the file
+ * has to be the same one (path, device and inode), at least as big as what
+ * was indexed, and either the same size and mtime or the same hash of
+ * every piece of what was indexed.  An index whose pieces don't all match
+ * is removed.
+ * @param {const string&} dir - the directory indexes are kept in
+ * @param {const string&} filename - the file
+ * @returns {bool} true if there's an index to use.
+ */
+bool sidecar::open(const string& dir, const string& filename) {
+   close();
+   indexPath = location(dir, filename);
+   if (indexPath.empty()) return false;
+
+   int fd = ::open(indexPath.c_str(), O_RDONLY);
+   struct stat indexInfo;
+   if ((fd < 0) || (fstat(fd, &indexInfo) != 0) || ((size_t)indexInfo.st_size < sizeof(sidecarheader))) {
+      if (fd >= 0) ::close(fd);
+      return false;
+   }
+   void* map = mmap(NULL, indexInfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   ::close(fd);
+   if (map == MAP_FAILED) return false;
+   mapped = static_cast<const unsigned char*>(map);
+   mappedLength = indexInfo.st_size;
+   memcpy(&header, mapped, sizeof(header));
+
+   char* full = realpath(filename.c_str(), NULL);
+   string fullPath = full ? full : "";
+   free(full);
+   struct stat info;
+   bool same = (memcmp(header.magic, SIDECAR_MAGIC, sizeof(header.magic)) == 0)
+      && (header.pathLength == fullPath.length()) && (sizeof(header) + header.pathLength <= mappedLength)
+      && (memcmp(mapped + sizeof(header), fullPath.data(), fullPath.length()) == 0)
+      && (stat(fullPath.c_str(), &info) == 0) && (header.dev == (uint64_t)info.st_dev) && (header.ino == (uint64_t)info.st_ino)
+      && ((uint64_t)info.st_size >= header.size) && (header.size >= header.indexedBytes)
+      && (header.pieces == (header.indexedBytes + SIDECAR_PIECE - 1) / SIDECAR_PIECE)
+      && (header.pieces <= (mappedLength - sizeof(header) - header.pathLength) / sizeof(uint64_t));
+   if (same && ((header.size != (uint64_t)info.st_size) || (header.mtimeSec != (uint64_t)info.st_mtim.tv_sec)
+      || (header.mtimeNsec != (uint64_t)info.st_mtim.tv_nsec))) {
+      // it has changed since; if it was only added to, every piece is the same
+      int file = ::open(fullPath.c_str(), O_RDONLY);
+      vector<uint64_t> sums;
+      same = (file >= 0) && sumPieces(file, 0, header.indexedBytes, sums);
+      for (size_t k = 0; same && (k < header.pieces); k++) same = (sums[k] == piece(k));
+      if (file >= 0) ::close(file);
+      if (!same) unlink(indexPath.c_str());
+   }
+   if (!same) close();
+   return same;
+}
+
+/**
+ * @method close
+ * Unmaps the index.
+ */
+void sidecar::close() {
+   if (mapped) munmap(const_cast<unsigned char*>(mapped), mappedLength);
+   mapped = NULL;
+   mappedLength = 0;
+   memset(&header, 0, sizeof(header));
+}
+
+/**
+ * @method valid
+ * @returns {bool} true if open() found an index that holds.
+ */
+bool sidecar::valid() const {
+   return mapped != NULL;
+}
+
+/**
+ * @method indexedBytes
+ * @returns {off_t} where the lines indexed end (what comes after has to be read).
+ */
+off_t sidecar::indexedBytes() const {
+   return header.indexedBytes;
+}
+
+/**
+ * @method lines
+ * @returns {size_t} how many lines were indexed.
+ */
+size_t sidecar::lines() const {
+   return header.lines;
+}
+
+/**
+ * @method starts
+ * Finds where every so many lines start.
+ * @param {const size_t} every - how many lines apart
+ * @param {vector<off_t>&} offsets - replaced by where lines 0, every, 2 * every... start
+ */
+void sidecar::starts(const size_t every, vector<off_t>& offsets) const {
+   offsets.clear();
+   offsets.reserve(header.lines / every + 1);
+   const unsigned char* at = lengths();
+   const unsigned char* end = mapped + mappedLength;
+   off_t offset = 0;
+   for (size_t line = 0; (line < header.lines) && (at < end); line++) {
+      if (line % every == 0) offsets.push_back(offset);
+      offset += getVarint(at, end);
+   }
+}
+
+/**
+ * @method position
+ * @returns {sidecarposition} where the user was when the index was last written.
+ */
+sidecarposition sidecar::position() const {
+   return { header.width, header.startLine, header.startCursor, header.cursorLine, header.cursorChar };
+}
+
+/**
+ * @method remember
+ * Writes where the user is into the index, in place.
+ * @param {const sidecarposition&} where - where the user is
+ * @returns {bool} true if it was written.
+ */
+bool sidecar::remember(const sidecarposition& where) {
+   if (!valid()) return false;
+   header.width = where.width;
+   header.startLine = where.startLine;
+   header.startCursor = where.startCursor;
+   header.cursorLine = where.cursorLine;
+   header.cursorChar = where.cursorChar;
+
+   int fd = ::open(indexPath.c_str(), O_WRONLY);
+   if (fd < 0) return false;
+   const size_t from = offsetof(sidecarheader, width);
+   const size_t length = offsetof(sidecarheader, pathLength) - from;
+   bool ok = (pwrite(fd, reinterpret_cast<const char*>(&header) + from, length, from) == (ssize_t)length);
+   return (::close(fd) == 0) && ok;
+}
+
+/**
+ * @private
+ * @method lengths
+ * @returns {const unsigned char*} where the line lengths start in the index.
+ */
+const unsigned char* sidecar::lengths() const {
+   return mapped + sizeof(header) + header.pathLength + header.pieces * sizeof(uint64_t);
+}
+
+/**
+ * @private
+ * @method piece
+ * @param {const size_t} k - a piece of what was indexed (below header.pieces)
+ * @returns {uint64_t} the hash of it in the index.
+ */
+uint64_t sidecar::piece(const size_t k) const {
+   uint64_t value;
+   memcpy(&value, mapped + sizeof(header) + header.pathLength + k * sizeof(uint64_t), sizeof(value));
+   return value;
+}
+
+/**
+ * @private
+ * @method hash
+ * FNV-1a, carried on from where another left off.
+ * @param {const char*} bytes - what to hash
+ * @param {const size_t} length - how many bytes
+ * @param {uint64_t} h - the hash so far
+ * @returns {uint64_t} the hash.
+ */
+uint64_t sidecar::hash(const char* bytes, const size_t length, uint64_t h) {
+   for (size_t i = 0; i < length; i++) {
+      h ^= (unsigned char)bytes[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+/**
+ * @private
+ * @method sum
+ * Hashes a piece of a file eight bytes at a time (FNV-1a over words, with
+ * the high bits folded back in after each), and the bytes left one by one.
+ * @param {const char*} bytes - the piece
+ * @param {size_t} length - how long it is
+ * @returns {uint64_t} the hash.
+ */
+uint64_t sidecar::sum(const char* bytes, size_t length) {
+   uint64_t h = 0xcbf29ce484222325ULL ^ length;
+   for (; length >= sizeof(uint64_t); bytes += sizeof(uint64_t), length -= sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, bytes, sizeof(word));
+      h = (h ^ word) * 0x100000001b3ULL;
+      h ^= h >> 32;
+   }
+   return hash(bytes, length, h);
+}
+
+/**
+ * @private
+ * @method sumPieces
+ * Hashes the pieces of a file from one on, up to a point.
+ * @param {const int} fd - the file
+ * @param {off_t} from - where the first piece starts (a multiple of SIDECAR_PIECE)
+ * @param {const off_t} to - where the last piece ends
+ * @param {vector<uint64_t>&} sums - the hashes are added to this
+ * @returns {bool} true if the file could be read that far.
+ */
+bool sidecar::sumPieces(const int fd, off_t from, const off_t to, vector<uint64_t>& sums) {
+   string bytes(SIDECAR_PIECE, '\0');
+   for (; from < to; from += SIDECAR_PIECE) {
+      size_t wanted = (size_t)min((off_t)SIDECAR_PIECE, to - from);
+      size_t done = 0;
+      for (ssize_t n; (done < wanted) && ((n = pread(fd, &bytes[done], wanted - done, from + done)) > 0); ) done += n;
+      if (done < wanted) return false;
+      sums.push_back(sum(bytes.data(), wanted));
+   }
+   return true;
+}
+
+#endif
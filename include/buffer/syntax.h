@@ -0,0 +1,275 @@
+/*
+ * Syntax definitions
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      The languages the highlighter knows.  A language is a lexer for one
+ *      line at a time: it starts in the state the line before ended in (0
+ *      for the first line), marks every character with a SYNTAX_ class, and
+ *      returns the state the line ends in.  States are small integers for
+ *      whatever spans lines, like C block comments or shell strings, so the
+ *      highlighter can tell when an edit stops making a difference.
+ *
+ *      Adding a language is a lexer plus an entry in languages[].
+ */
+
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+using namespace std;
+
+// what each character of a line is
+#define SYNTAX_NORMAL 0
+#define SYNTAX_COMMENT 1
+#define SYNTAX_STRING 2
+#define SYNTAX_KEYWORD 3
+#define SYNTAX_NUMBER 4
+#define SYNTAX_PREPROCESSOR 5
+#define SYNTAX_VARIABLE 6
+#define SYNTAX_CLASSES 7
+
+/**
+ * Lexes one line.
+ * @param {const string&} text - the line
+ * @param {const int} state - the state the line before ended in
+ * @param {unsigned char*} classes - filled with the class of every character (may be NULL)
+ * @returns {int} the state this line ends in.
+ */
+typedef int (*lexer)(const string&, const int, unsigned char*);
+
+struct language {
+   const char* name;
+   const char* const* extensions; // NULL terminated
+   lexer lex;
+};
+
+/**
+ * @function markClass
+ * Marks the characters [from, to) of a line as one class.
+ */
+void markClass(unsigned char* classes, const size_t from, const size_t to, const unsigned char type) {
+   if (classes && (to > from)) memset(classes + from, type, to - from);
+}
+
+/**
+ * @function wordEnd
+ * @returns {size_t} one past the end of the identifier starting at i.
+ */
+size_t wordEnd(const string& text, size_t i) {
+   while ((i < text.length()) && (isalnum((unsigned char)text[i]) || (text[i] == '_'))) i++;
+   return i;
+}
+
+/**
+ * @function isKeyword
+ * @param {const string&} text - the line
+ * @param {size_t} from - the start of the word
+ * @param {size_t} to - one past the end of the word
+ * @param {const char* const*} words - the keywords, NULL terminated
+ * @returns {bool} true if the word is one of the keywords.
+ */
+bool isKeyword(const string& text, const size_t from, const size_t to, const char* const* words) {
+   size_t length = to - from;
+   for (; *words; words++) {
+      if ((strlen(*words) == length) && (text.compare(from, length, *words) == 0)) return true;
+   }
+   return false;
+}
+
+/**
+ * @function quotedEnd
+ * @returns {size_t} one past the closing quote of the string starting at i,
+ * or npos if it isn't closed on this line.  Backslash escapes the next character.
+ */
+size_t quotedEnd(const string& text, size_t i, const char quote, const bool escapes) {
+   for (; i < text.length(); i++) {
+      if (escapes && (text[i] == '\\')) {
+         i++;
+      } else if (text[i] == quote) {
+         return i + 1;
+      }
+   }
+   return string::npos;
+}
+
+// C and C++: 0 normal, 1 in a block comment, 2 in a continued preprocessor line
+#define LEX_C_COMMENT 1
+#define LEX_C_PREPROCESSOR 2
+
+const char* const cKeywords[] = {
+   "auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr",
+   "continue", "default", "delete", "do", "double", "else", "enum", "extern", "false",
+   "float", "for", "goto", "if", "inline", "int", "long", "namespace", "new", "nullptr",
+   "private", "protected", "public", "register", "return", "short", "signed", "sizeof",
+   "static", "struct", "switch", "template", "this", "throw", "true", "try", "typedef",
+   "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "while", NULL
+};
+
+int lexC(const string& text, const int state, unsigned char* classes) {
+   size_t n = text.length();
+   size_t i = 0;
+   int current = state;
+
+   // a preprocessor line goes on for as long as lines end in a backslash
+   size_t first = text.find_first_not_of(" \t");
+   if ((current == LEX_C_PREPROCESSOR) || ((current == 0) && (first != string::npos) && (text[first] == '#'))) {
+      markClass(classes, 0, n, SYNTAX_PREPROCESSOR);
+      return ((n > 0) && (text[n - 1] == '\\')) ? LEX_C_PREPROCESSOR : 0;
+   }
+
+   while (i < n) {
+      if (current == LEX_C_COMMENT) {
+         size_t close = text.find("*/", i);
+         size_t end = (close == string::npos) ? n : close + 2;
+         markClass(classes, i, end, SYNTAX_COMMENT);
+         if (close == string::npos) return LEX_C_COMMENT;
+         i = end;
+         current = 0;
+         continue;
+      }
+
+      char c = text[i];
+      char next = (i + 1 < n) ? text[i + 1] : '\0';
+      if ((c == '/') && (next == '/')) {
+         markClass(classes, i, n, SYNTAX_COMMENT);
+         return 0;
+      } else if ((c == '/') && (next == '*')) {
+         markClass(classes, i, i + 2, SYNTAX_COMMENT);
+         i += 2;
+         current = LEX_C_COMMENT;
+      } else if ((c == '"') || (c == '\'')) {
+         size_t end = quotedEnd(text, i + 1, c, true);
+         if (end == string::npos) end = n;
+         markClass(classes, i, end, SYNTAX_STRING);
+         i = end;
+      } else if (isdigit((unsigned char)c)) {
+         size_t end = i;
+         while ((end < n) && (isalnum((unsigned char)text[end]) || (text[end] == '.'))) end++;
+         markClass(classes, i, end, SYNTAX_NUMBER);
+         i = end;
+      } else if (isalpha((unsigned char)c) || (c == '_')) {
+         size_t end = wordEnd(text, i);
+         markClass(classes, i, end, isKeyword(text, i, end, cKeywords) ? SYNTAX_KEYWORD : SYNTAX_NORMAL);
+         i = end;
+      } else {
+         markClass(classes, i, i + 1, SYNTAX_NORMAL);
+         i++;
+      }
+   }
+   return current;
+}
+
+// shell: 0 normal, 1 in a single quoted string, 2 in a double quoted one
+#define LEX_SHELL_SINGLE 1
+#define LEX_SHELL_DOUBLE 2
+
+const char* const shellKeywords[] = {
+   "case", "do", "done", "elif", "else", "esac", "export", "fi", "for", "function",
+   "if", "in", "local", "readonly", "return", "select", "then", "until", "while", NULL
+};
+
+int lexShell(const string& text, const int state, unsigned char* classes) {
+   size_t n = text.length();
+   size_t i = 0;
+   int current = state;
+
+   while (i < n) {
+      if ((current == LEX_SHELL_SINGLE) || (current == LEX_SHELL_DOUBLE)) {
+         bool single = (current == LEX_SHELL_SINGLE);
+         size_t end = quotedEnd(text, i, single ? '\'' : '"', !single);
+         if (end == string::npos) {
+            markClass(classes, i, n, SYNTAX_STRING);
+            return current;
+         }
+         markClass(classes, i, end, SYNTAX_STRING);
+         i = end;
+         current = 0;
+         continue;
+      }
+
+      char c = text[i];
+      if ((c == '#') && ((i == 0) || isspace((unsigned char)text[i - 1]))) {
+         markClass(classes, i, n, SYNTAX_COMMENT);
+         return 0;
+      } else if (c == '\'') {
+         markClass(classes, i, i + 1, SYNTAX_STRING);
+         i++;
+         current = LEX_SHELL_SINGLE;
+      } else if (c == '"') {
+         markClass(classes, i, i + 1, SYNTAX_STRING);
+         i++;
+         current = LEX_SHELL_DOUBLE;
+      } else if (c == '\\') {
+         markClass(classes, i, min(i + 2, n), SYNTAX_NORMAL);
+         i += 2;
+      } else if (c == '$') {
+         // $name, ${...}, or $ followed by one character ($1, $?, ...)
+         size_t end;
+         if ((i + 1 < n) && (text[i + 1] == '{')) {
+            end = text.find('}', i);
+            end = (end == string::npos) ? n : end + 1;
+         } else {
+            end = wordEnd(text, i + 1);
+            if (end == i + 1) end = min(i + 2, n);
+         }
+         markClass(classes, i, end, SYNTAX_VARIABLE);
+         i = end;
+      } else if (isalpha((unsigned char)c) || (c == '_')) {
+         size_t end = wordEnd(text, i);
+         markClass(classes, i, end, isKeyword(text, i, end, shellKeywords) ? SYNTAX_KEYWORD : SYNTAX_NORMAL);
+         i = end;
+      } else {
+         markClass(classes, i, i + 1, SYNTAX_NORMAL);
+         i++;
+      }
+   }
+   return current;
+}
+
+// INI: nothing spans lines
+int lexIni(const string& text, const int state, unsigned char* classes) {
+   (void)state;
+   size_t n = text.length();
+   size_t first = text.find_first_not_of(" \t");
+   if (first == string::npos) {
+      markClass(classes, 0, n, SYNTAX_NORMAL);
+      return 0;
+   }
+
+   markClass(classes, 0, first, SYNTAX_NORMAL);
+   if ((text[first] == ';') || (text[first] == '#')) {
+      markClass(classes, first, n, SYNTAX_COMMENT);
+   } else if (text[first] == '[') {
+      markClass(classes, first, n, SYNTAX_KEYWORD);
+   } else {
+      size_t equals = text.find('=', first);
+      if (equals == string::npos) {
+         markClass(classes, first, n, SYNTAX_NORMAL);
+      } else {
+         markClass(classes, first, equals, SYNTAX_VARIABLE);
+         markClass(classes, equals, equals + 1, SYNTAX_NORMAL);
+         markClass(classes, equals + 1, n, SYNTAX_STRING);
+      }
+   }
+   return 0;
+}
+
+const char* const cExtensions[] = { ".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", NULL };
+const char* const shellExtensions[] = { ".sh", ".bash", ".ksh", ".zsh", NULL };
+const char* const iniExtensions[] = { ".ini", ".conf", ".cfg", ".desktop", NULL };
+
+const language languages[] = {
+   { "C", cExtensions, lexC },
+   { "shell", shellExtensions, lexShell },
+   { "INI", iniExtensions, lexIni },
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Tidying up lines
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Sorting, deduplicating and filtering a run of lines of a document,
+ *      for tidying up host lists and log extracts without leaving the
+ *      editor.  The commands look like the shell tools they stand in for:
+ *
+ *         sort [-n] [-r]       by bytes, or by the number each line starts
+ *                              with (-n); reversed with -r.  Always stable.
+ *         uniq                 drops every line seen before in the run
+ *         grep [-v] pattern    keeps (or drops, with -v) the lines matching
+ *                              an extended regular expression
+ *
+ *      Only references to the lines are moved around, never their text, and
+ *      the result goes back into the document as one change.  Big runs are
+ *      sorted with the parallel merge sort in parallel.h, and filtered a
+ *      piece per thread.  The threads only move
+ *      references: making or dropping a line would touch linepool, which
+ *      isn't thread safe.
+ */
+
+#ifndef TIDY_H
+#define TIDY_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include <string_view>
+#include <regex.h>
+
+#include "document.h"
+#include "../misc/parallel.h"
+
+using namespace std;
+
+/**
+ * A line being sorted, with the number it starts with (for sort -n).
+ */
+struct tidyline {
+   double number;
+   lineref line;
+};
+
+/**
+ * @function leadingNumber
+ * @param {const string&} s - a line
+ * @returns {double} the number it starts with (after blanks), like sort -n;
+ * 0 if there isn't one.
+ */
+double leadingNumber(const string& s) {
+   size_t i = 0;
+   while ((i < s.length()) && ((s[i] == ' ') || (s[i] == '\t'))) i++;
+   bool negative = (i < s.length()) && (s[i] == '-');
+   if (negative) i++;
+
+   double n = 0;
+   for (; (i < s.length()) && (s[i] >= '0') && (s[i] <= '9'); i++) n = n * 10 + (s[i] - '0');
+   if ((i < s.length()) && (s[i] == '.')) {
+      double scale = 0.1;
+      for (i++; (i < s.length()) && (s[i] >= '0') && (s[i] <= '9'); i++, scale /= 10) n += (s[i] - '0') * scale;
+   }
+   return negative ? -n : n;
+}
+
+/**
+ * @function tidySort
+ * @param {vector<lineref>&} lines - the lines, sorted in place
+ * @param {const bool} numeric - by leading number instead of by bytes
+ * @param {const bool} reverse - largest first
+ */
+void tidySort(vector<lineref>& lines, const bool numeric, const bool reverse) {
+   const size_t count = lines.size();
+   const size_t parts = parallelThreads(count);
+   vector<tidyline> sorting(count);
+   parallelFor(parts, [&](size_t p) {
+      for (size_t i = count * p / parts; i < count * (p + 1) / parts; i++) {
+         sorting[i].line = move(lines[i]);
+         if (numeric) sorting[i].number = leadingNumber(*sorting[i].line);
+      }
+   });
+
+   if (numeric && reverse) {
+      parallelSort(sorting, [](const tidyline& a, const tidyline& b) { return b.number < a.number; });
+   } else if (numeric) {
+      parallelSort(sorting, [](const tidyline& a, const tidyline& b) { return a.number < b.number; });
+   } else if (reverse) {
+      parallelSort(sorting, [](const tidyline& a, const tidyline& b) { return *b.line < *a.line; });
+   } else {
+      parallelSort(sorting, [](const tidyline& a, const tidyline& b) { return *a.line < *b.line; });
+   }
+
+   for (size_t i = 0; i < count; i++) lines[i] = move(sorting[i].line);
+}
+
+/**
+ * @function tidyUnique
+ * Drops every line that's the same as one before it.
+ * @param {vector<lineref>&} lines - the lines, kept in order
+ */
+void tidyUnique(vector<lineref>& lines) {
+   unordered_set<string_view> seen;
+   seen.reserve(lines.size());
+   size_t kept = 0;
+   for (size_t i = 0; i < lines.size(); i++) {
+      if (seen.insert(string_view(*lines[i])).second) {
+         if (kept != i) lines[kept] = move(lines[i]);
+         kept++;
+      }
+   }
+   lines.resize(kept);
+}
+
+/**
+ * @function tidyFilter
+ * Keeps the lines that match a pattern (or the ones that don't).  Every
+ * thread compiles the pattern for itself, since glibc's regexec() only lets
+ * one thread at a time use a compiled one.
+ * @param {vector<lineref>&} lines - the lines, kept in order
+ * @param {const string&} pattern - an extended regular expression
+ * @param {const bool} invert - keep the lines that don't match instead
+ * @returns {bool} false if the pattern doesn't compile (nothing changes).
+ */
+bool tidyFilter(vector<lineref>& lines, const string& pattern, const bool invert) {
+   regex_t check;
+   if (regcomp(&check, pattern.c_str(), REG_EXTENDED | REG_NOSUB) != 0) return false;
+   regfree(&check);
+
+   const size_t count = lines.size();
+   const size_t parts = parallelThreads(count);
+   vector<char> keep(count);
+   parallelFor(parts, [&](size_t p) {
+      regex_t compiled;
+      regcomp(&compiled, pattern.c_str(), REG_EXTENDED | REG_NOSUB);
+      for (size_t i = count * p / parts; i < count * (p + 1) / parts; i++) {
+         keep[i] = ((regexec(&compiled, lines[i]->c_str(), 0, NULL, 0) == 0) != invert);
+      }
+      regfree(&compiled);
+   });
+
+   size_t kept = 0;
+   for (size_t i = 0; i < count; i++) {
+      if (keep[i]) {
+         if (kept != i) lines[kept] = move(lines[i]);
+         kept++;
+      }
+   }
+   lines.resize(kept);
+   return true;
+}
+
+/**
+ * @function tidy
+ * Sorts, deduplicates or filters lines [first, last) of a document.  A
+ * document left with no lines at all gets a blank one.
+ * @param {document&} doc - the document
+ * @param {const size_t} first - the first line
+ * @param {const size_t} last - one past the last line
+ * @param {const string&} command - what to do (see above)
+ * @returns {bool} false if the command doesn't make sense (nothing changes).
+ */
+bool tidy(document& doc, const size_t first, const size_t last, const string& command) {
+   // the name of the command, its flags, and whatever follows them
+   size_t start = command.find_first_not_of(' ');
+   if ((start == string::npos) || (first >= last) || (last > doc.size())) return false;
+   size_t end = command.find(' ', start);
+   string name = command.substr(start, end - start);
+   string flags;
+   string rest;
+   while (end != string::npos) {
+      start = command.find_first_not_of(' ', end);
+      if (start == string::npos) break;
+      end = command.find(' ', start);
+      if (command[start] != '-') {
+         rest = command.substr(start);
+         break;
+      }
+      flags += command.substr(start + 1, end - start - 1);
+   }
+
+   vector<lineref> lines;
+   if ((name == "sort") && rest.empty() && (flags.find_first_not_of("nr") == string::npos)) {
+      lines = doc.refs(first, last);
+      tidySort(lines, flags.find('n') != string::npos, flags.find('r') != string::npos);
+   } else if ((name == "uniq") && rest.empty() && flags.empty()) {
+      lines = doc.refs(first, last);
+      tidyUnique(lines);
+   } else if ((name == "grep") && !rest.empty() && ((flags == "") || (flags == "v"))) {
+      lines = doc.refs(first, last);
+      if (!tidyFilter(lines, rest, flags == "v")) return false;
+   } else {
+      return false;
+   }
+
+   if (lines.empty() && (last - first == doc.size())) lines.push_back(newLine());
+   doc.replace(first, last, move(lines));
+   return true;
+}
+
+#endif
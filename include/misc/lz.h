@@ -0,0 +1,158 @@
+/*
+ * LZ compression
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A small LZ77 codec in the style of LZ4, for keeping text that isn't
+ *      being looked at in less memory.  It's fast rather than tight: text
+ *      usually comes out at a third to a half of its size, and decompressing
+ *      is a loop of memcpy()s.
+ *
+ *      Format: a run of sequences, each a token byte (high four bits: the
+ *      number of literals, low four bits: the match length minus 4), more
+ *      length bytes for either when its four bits are 15 (each adds up to
+ *      255), the literals, and a two byte little endian offset back to the
+ *      match.  The last sequence is only literals.  The size of the original
+ *      isn't stored; whoever compressed it keeps that.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+/**
+ * @function lzLength
+ * Appends the rest of a length that didn't fit in its four bits.
+ */
+void lzLength(string& out, size_t length) {
+   while (length >= 255) {
+      out += (char)255;
+      length -= 255;
+   }
+   out += (char)length;
+}
+
+/**
+ * @function lzCompress
+ * @param {const char*} in - what to compress
+ * @param {const size_t} length - how much of it
+ * @param {string&} out - replaced by the compressed bytes
+ */
+void lzCompress(const char* in, const size_t length, string& out) {
+   uint32_t table[1 << LZ_HASH_BITS];
+   memset(table, 0xff, sizeof table);
+   out.clear();
+   out.reserve(length / 2 + 16);
+
+   size_t anchor = 0; // the first literal not written yet
+   size_t i = 0;
+   while (i + LZ_MIN_MATCH <= length) {
+      uint32_t word;
+      memcpy(&word, in + i, sizeof word);
+      uint32_t hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+      uint32_t candidate = table[hash];
+      table[hash] = i;
+
+      if ((candidate == 0xffffffffu) || (i - candidate > LZ_MAX_OFFSET) || (memcmp(in + candidate, in + i, LZ_MIN_MATCH) != 0)) {
+         i++;
+         continue;
+      }
+
+      size_t match = LZ_MIN_MATCH;
+      while ((i + match < length) && (in[candidate + match] == in[i + match])) match++;
+
+      size_t literals = i - anchor;
+      size_t extra = match - LZ_MIN_MATCH;
+      out += (char)((min(literals, (size_t)15) << 4) | min(extra, (size_t)15));
+      if (literals >= 15) lzLength(out, literals - 15);
+      out.append(in + anchor, literals);
+      out += (char)((i - candidate) & 0xff);
+      out += (char)((i - candidate) >> 8);
+      if (extra >= 15) lzLength(out, extra - 15);
+
+      i += match;
+      anchor = i;
+   }
+
+   // whatever is left goes out as literals
+   size_t literals = length - anchor;
+   out += (char)(min(literals, (size_t)15) << 4);
+   if (literals >= 15) lzLength(out, literals - 15);
+   out.append(in + anchor, literals);
+}
+
+/**
+ * @function lzDecompress
+ * @param {const string&} in - the compressed bytes
+ * @param {const size_t} length - how long the original was
+ * @param {string&} out - replaced by the original
+ * @returns {bool} false if the bytes don't make sense.
+ */
+bool lzDecompress(const string& in, const size_t length, string& out) {
+   out.resize(length);
+   const unsigned char* p = (const unsigned char*)in.data();
+   const unsigned char* end = p + in.length();
+   size_t o = 0;
+
+   while (p < end) {
+      unsigned char token = *p++;
+
+      size_t literals = token >> 4;
+      if (literals == 15) {
+         unsigned char more;
+         do {
+            if (p >= end) return false;
+            more = *p++;
+            literals += more;
+         } while (more == 255);
+      }
+      if (((size_t)(end - p) < literals) || (length - o < literals)) return false;
+      memcpy(&out[o], p, literals);
+      p += literals;
+      o += literals;
+
+      // the last sequence has no match
+      if (p >= end) break;
+
+      if (end - p < 2) return false;
+      size_t offset = p[0] | (p[1] << 8);
+      p += 2;
+
+      size_t match = (token & 15);
+      if (match == 15) {
+         unsigned char more;
+         do {
+            if (p >= end) return false;
+            more = *p++;
+            match += more;
+         } while (more == 255);
+      }
+      match += LZ_MIN_MATCH;
+      if ((offset == 0) || (offset > o) || (length - o < match)) return false;
+
+      // matches can overlap what they copy, so byte by byte when they're close
+      if (offset >= match) {
+         memcpy(&out[o], &out[o - offset], match);
+      } else {
+         for (size_t k = 0; k < match; k++) out[o + k] = out[o - offset + k];
+      }
+      o += match;
+   }
+
+   return o == length;
+}
+
+#endif
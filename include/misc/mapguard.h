@@ -0,0 +1,139 @@
+/*
+ * Class: mapguard
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Keeps a read-only file mapping from killing the program when another
+ *      process truncates the file under it.  Touching a page past the new
+ *      end raises SIGBUS; the handler puts a page of zeros in its place and
+ *      returns, so the read goes on (seeing zeros), and the mapping is
+ *      marked lost for the owner to notice.  A SIGBUS anywhere else is left
+ *      to kill the program as it always would.  Up to MAPGUARD_SLOTS mappings
+ *      are watched at once, in a table the handler reads without locks.
+ */
+
+#ifndef MAPGUARD_H
+#define MAPGUARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+#define MAPGUARD_SLOTS 8
+
+struct mapguardslot {
+   atomic<bool> used;
+   atomic<uintptr_t> start; // 0 while the slot isn't watching anything
+   atomic<size_t> length;
+   atomic<bool> lost;
+};
+
+mapguardslot mapGuards[MAPGUARD_SLOTS];
+uintptr_t mapGuardPage = 0;
+
+/**
+ * @function onBusError
+ * The SIGBUS handler: zero-fills the page of a watched mapping that was
+ * touched, or puts the default action back for anything else, which then
+ * happens when the instruction faults again.
+ */
+void onBusError(int, siginfo_t* info, void*) {
+   uintptr_t at = (uintptr_t)info->si_addr;
+   for (mapguardslot& slot : mapGuards) {
+      uintptr_t start = slot.start.load(memory_order_acquire);
+      if (!start || (at < start) || (at - start >= slot.length.load(memory_order_relaxed))) continue;
+      void* page = (void*)(at & ~(mapGuardPage - 1));
+      if (mmap(page, mapGuardPage, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+         slot.lost.store(true, memory_order_relaxed);
+         return;
+      }
+      break;
+   }
+   signal(SIGBUS, SIG_DFL);
+}
+
+class mapguard {
+   private:
+      int slot; // -1 if nothing is watched
+
+   public:
+      mapguard();
+      ~mapguard();
+
+      bool watch(const void*, const size_t);
+      void release();
+      bool lost() const;
+};
+
+/**
+ * @constructs mapguard
+ * Starts out watching nothing.
+ */
+mapguard::mapguard() {
+   slot = -1;
+}
+
+/**
+ * Stops watching; the mapping should be unmapped after this, not before.
+ */
+mapguard::~mapguard() {
+   release();
+}
+
+/**
+ * @method watch
+ * Starts watching a mapping (installing the handler the first time).
+ * @param {const void*} start - where it starts
+ * @param {const size_t} length - how long it is
+ * @returns {bool} true if there was a slot for it.
+ */
+bool mapguard::watch(const void* start, const size_t length) {
+   release();
+   if (!mapGuardPage) {
+      mapGuardPage = sysconf(_SC_PAGESIZE);
+      struct sigaction action = {};
+      action.sa_sigaction = onBusError;
+      action.sa_flags = SA_SIGINFO;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGBUS, &action, nullptr);
+   }
+   for (int s = 0; s < MAPGUARD_SLOTS; s++) {
+      bool free = false;
+      if (!mapGuards[s].used.compare_exchange_strong(free, true)) continue;
+      mapGuards[s].lost.store(false, memory_order_relaxed);
+      mapGuards[s].length.store(length, memory_order_relaxed);
+      mapGuards[s].start.store((uintptr_t)start, memory_order_release);
+      slot = s;
+      return true;
+   }
+   return false;
+}
+
+/**
+ * @method release
+ * Stops watching the mapping, if there is one.
+ */
+void mapguard::release() {
+   if (slot < 0) return;
+   mapGuards[slot].start.store(0, memory_order_release);
+   mapGuards[slot].used.store(false, memory_order_release);
+   slot = -1;
+}
+
+/**
+ * @method lost
+ * @returns {bool} true if some of the mapping was past the end of the file
+ * when it was read, and so read as zeros instead.
+ */
+bool mapguard::lost() const {
+   return (slot >= 0) && mapGuards[slot].lost.load(memory_order_relaxed);
+}
+
+#endif
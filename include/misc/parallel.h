@@ -0,0 +1,120 @@
+/*
+ * Parallel helpers
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Splitting work that runs over a lot of lines (or rows) between the
+ *      cores: parallelFor() runs the parts of a job on threads of their own
+ *      and waits for all of them, and parallelSort() is a stable merge sort
+ *      built on it (each thread sorts a piece, then pairs of sorted pieces
+ *      are merged in parallel until there's one).  Below PARALLEL_MIN items
+ *      it isn't worth starting threads, and everything runs on the caller's.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+// fewer items than this are done on the caller's thread alone
+#define PARALLEL_MIN 65536
+#define PARALLEL_MAX_THREADS 8
+
+struct paralleljob {
+   const function<void(size_t)>* work;
+   size_t part;
+};
+
+/**
+ * @function parallelThreads
+ * @param {const size_t} items - how many items there are to work on
+ * @returns {size_t} how many threads to split them between.
+ */
+size_t parallelThreads(const size_t items) {
+   if (items < PARALLEL_MIN) return 1;
+   long cores = sysconf(_SC_NPROCESSORS_ONLN);
+   return (cores > 1) ? min((size_t)cores, (size_t)PARALLEL_MAX_THREADS) : 1;
+}
+
+/**
+ * @function parallelRun
+ * Where the threads of parallelFor() start.
+ */
+void* parallelRun(void* arg) {
+   paralleljob* job = static_cast<paralleljob*>(arg);
+   (*job->work)(job->part);
+   return NULL;
+}
+
+/**
+ * @function parallelFor
+ * Runs work(0) to work(parts - 1) at the same time, work(0) on this thread.
+ * A part that can't get a thread of its own runs here too.
+ * @param {const size_t} parts - how many parts there are
+ * @param {const function<void(size_t)>&} work - does one part
+ */
+void parallelFor(const size_t parts, const function<void(size_t)>& work) {
+   vector<pthread_t> threads(parts);
+   vector<paralleljob> jobs(parts);
+   vector<bool> started(parts, false);
+   for (size_t p = 1; p < parts; p++) {
+      jobs[p] = { &work, p };
+      started[p] = (pthread_create(&threads[p], NULL, parallelRun, &jobs[p]) == 0);
+   }
+   if (parts > 0) work(0);
+   for (size_t p = 1; p < parts; p++) {
+      if (started[p]) pthread_join(threads[p], NULL);
+      else work(p);
+   }
+}
+
+/**
+ * @function parallelSort
+ * Stable merge sort, a piece per thread, then pairs of sorted pieces
+ * merged in parallel until there's one.  Items are moved, never copied.
+ * @param {vector<T>&} items - what to sort, in place
+ * @param {Before} before - true if an item goes before another
+ */
+template <typename T, typename Before>
+void parallelSort(vector<T>& items, Before before) {
+   const size_t count = items.size();
+   const size_t parts = parallelThreads(count);
+
+   // sorted pieces, by where each starts
+   vector<size_t> bounds;
+   for (size_t p = 0; p <= parts; p++) bounds.push_back(count * p / parts);
+   parallelFor(parts, [&](size_t p) {
+      stable_sort(items.begin() + bounds[p], items.begin() + bounds[p + 1], before);
+   });
+
+   vector<T> merged(parts > 1 ? count : 0);
+   while (bounds.size() > 2) {
+      const size_t pieces = bounds.size() - 1;
+      parallelFor((pieces + 1) / 2, [&](size_t pair) {
+         size_t from = bounds[2 * pair];
+         size_t middle = bounds[min(2 * pair + 1, pieces)];
+         size_t to = bounds[min(2 * pair + 2, pieces)];
+         merge(make_move_iterator(items.begin() + from), make_move_iterator(items.begin() + middle),
+            make_move_iterator(items.begin() + middle), make_move_iterator(items.begin() + to),
+            merged.begin() + from, before);
+      });
+      items.swap(merged);
+
+      vector<size_t> joined;
+      for (size_t b = 0; b < bounds.size(); b += 2) joined.push_back(bounds[b]);
+      if (joined.back() != count) joined.push_back(count);
+      bounds.swap(joined);
+   }
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Class: perfmeter
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Measures how long each keystroke takes to turn into a frame on the
+ *      terminal and how many bytes that frame was, for the performance HUD
+ *      and the trace log.  Does nothing (beyond one branch per key) until
+ *      either one is turned on.  Bytes come from the count kept by tout.
+ *
+ *      Trace file layout (native byte order):
+ *         header: "TXTR", uint32 version (1), uint32 record size (24)
+ *         record: uint64 time since start (ns), uint32 latency (ns),
+ *                 uint32 bytes written, uint32 rss (KiB), int16 key,
+ *                 uint8 update type, uint8 padding
+ *      Keys are the character typed, or 256 + the KEY_ index for special keys.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../terminal/writer.h"
+
+using namespace std;
+
+#define PERF_SAMPLES 256
+#define PERF_TRACE_VERSION 1
+
+struct tracerecord {
+   uint64_t time;
+   uint32_t latency;
+   uint32_t bytes;
+   uint32_t rss;
+   int16_t key;
+   uint8_t update;
+   uint8_t padding;
+};
+
+static_assert(sizeof(tracerecord) == 24, "trace records are 24 bytes on disk");
+
+class perfmeter {
+   private:
+      bool hud;
+      FILE* trace;
+      size_t bytesBefore;
+
+      chrono::steady_clock::time_point started;
+      chrono::steady_clock::time_point keyTime;
+
+      double samples[PERF_SAMPLES];
+      size_t nSamples;
+      size_t nextSample;
+
+   public:
+      double lastLatency; // ms
+      size_t lastBytes;
+      int lastUpdate;
+
+      perfmeter();
+      ~perfmeter();
+
+      bool active() const;
+      bool hudVisible() const;
+      void toggleHud();
+      bool openTrace(const char*);
+
+      void begin();
+      void end(const int, const int);
+
+      double p99() const;
+      size_t rss() const;
+};
+
+/**
+ * @constructs perfmeter
+ * Starts out with both the HUD and the trace off.
+ */
+perfmeter::perfmeter() {
+   hud = false;
+   trace = NULL;
+   bytesBefore = 0;
+   nSamples = nextSample = 0;
+   lastLatency = 0;
+   lastBytes = 0;
+   lastUpdate = 0;
+   started = chrono::steady_clock::now();
+}
+
+/**
+ * @destructs perfmeter
+ * Closes the trace.
+ */
+perfmeter::~perfmeter() {
+   if (trace) fclose(trace);
+}
+
+/**
+ * @method active
+ * @returns {bool} true if anything is being measured.
+ */
+bool perfmeter::active() const {
+   return hud || trace;
+}
+
+/**
+ * @method hudVisible
+ * @returns {bool} true if the HUD should be drawn.
+ */
+bool perfmeter::hudVisible() const {
+   return hud;
+}
+
+/**
+ * @method toggleHud
+ * Turns the HUD on or off.
+ */
+void perfmeter::toggleHud() {
+   hud = !hud;
+}
+
+/**
+ * @method openTrace
+ * Starts writing every frame to a trace file.
+ * @param {const char*} filename - where to write the trace
+ * @returns {bool} true if the trace file could be opened.
+ */
+bool perfmeter::openTrace(const char* filename) {
+   trace = fopen(filename, "wb");
+   if (!trace) return false;
+
+   uint32_t header[2] = { PERF_TRACE_VERSION, sizeof(tracerecord) };
+   fwrite("TXTR", 1, 4, trace);
+   fwrite(header, sizeof header, 1, trace);
+   return true;
+}
+
+/**
+ * @method begin
+ * Call as soon as a key has been read.
+ */
+void perfmeter::begin() {
+   keyTime = chrono::steady_clock::now();
+   bytesBefore = tout.count;
+}
+
+/**
+ * @method end
+ * Call once the frame for the key has been written.  Flushes tout so the
+ * time includes handing the frame to the terminal.
+ * @param {const int} key - the key that was pressed
+ * @param {const int} update - how much of the screen was updated
+ */
+void perfmeter::end(const int key, const int update) {
+   tout.flush();
+   auto now = chrono::steady_clock::now();
+
+   lastLatency = chrono::duration<double, milli>(now - keyTime).count();
+   lastBytes = tout.count - bytesBefore;
+   lastUpdate = update;
+
+   samples[nextSample] = lastLatency;
+   nextSample = (nextSample + 1) % PERF_SAMPLES;
+   if (nSamples < PERF_SAMPLES) nSamples++;
+
+   if (trace) {
+      tracerecord record = {};
+      record.time = chrono::duration_cast<chrono::nanoseconds>(now - started).count();
+      record.latency = chrono::duration_cast<chrono::nanoseconds>(now - keyTime).count();
+      record.bytes = lastBytes;
+      record.rss = rss();
+      record.key = key;
+      record.update = update;
+      fwrite(&record, sizeof record, 1, trace);
+   }
+}
+
+/**
+ * @method p99
+ * @returns {double} the 99th percentile latency of the recent keys in ms.
+ */
+double perfmeter::p99() const {
+   if (nSamples == 0) return 0;
+   double sorted[PERF_SAMPLES];
+   copy(samples, samples + nSamples, sorted);
+   size_t index = (nSamples * 99) / 100;
+   nth_element(sorted, sorted + index, sorted + nSamples);
+   return sorted[index];
+}
+
+/**
+ * @method rss
+ * @returns {size_t} the resident set size of this process in KiB.
+ */
+size_t perfmeter::rss() const {
+   FILE* statm = fopen("/proc/self/statm", "r");
+   if (!statm) return 0;
+   size_t pages = 0, resident = 0;
+   if (fscanf(statm, "%zu %zu", &pages, &resident) != 2) resident = 0;
+   fclose(statm);
+   return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+#endif
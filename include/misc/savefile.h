@@ -0,0 +1,150 @@
+/*
+ * Class: savefile
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A new copy of a file, written next to it and then renamed over it, so
+ *      a crash leaves either the old file or the new one whole.  A symlink is
+ *      followed, and the copy goes next to the file it points to (which keeps
+ *      the link a link).  The copy gets the old file's mode, and its owner if
+ *      this process may give it one.  commit() syncs the copy, renames it and
+ *      then syncs the directory, since the rename is only on disk once the
+ *      directory is.  A copy that isn't committed is removed.
+ */
+
+#ifndef SAVEFILE_H
+#define SAVEFILE_H
+
+#include <string>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+class savefile {
+   private:
+      string real;  // the file, with symlinks resolved
+      string aside; // the copy being written
+      int fd;
+
+   public:
+      savefile();
+      ~savefile();
+
+      bool open(const string&);
+      int descriptor() const;
+      bool write(const char*, size_t);
+      bool commit(struct stat* = NULL);
+      void abandon();
+};
+
+/**
+ * @constructs savefile
+ * Starts out with no copy.
+ */
+savefile::savefile() {
+   fd = -1;
+}
+
+/**
+ * Removes a copy that wasn't committed.
+ */
+savefile::~savefile() {
+   abandon();
+}
+
+/**
+ * @method open
+ * Starts a new copy of a file (which needn't exist yet).
+ * @param {const string&} filename - the file it will take the place of
+ * @returns {bool} true if the copy could be created.
+ */
+bool savefile::open(const string& filename) {
+   abandon();
+   real = filename;
+   char* resolved = realpath(filename.c_str(), NULL);
+   if (resolved) {
+      real = resolved;
+      free(resolved);
+   }
+   aside = real + ".tmp";
+
+   fd = ::open(aside.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0) return false;
+   struct stat existing;
+   if (stat(real.c_str(), &existing) == 0) {
+      fchmod(fd, existing.st_mode & 07777);
+      if (fchown(fd, existing.st_uid, existing.st_gid) != 0) { /* only root can give a file away */ }
+   }
+   return true;
+}
+
+/**
+ * @method descriptor
+ * @returns {int} the copy, open for writing (-1 if there isn't one).
+ */
+int savefile::descriptor() const {
+   return fd;
+}
+
+/**
+ * @method write
+ * Appends bytes to the copy, all of them.
+ * @param {const char*} bytes - what to write
+ * @param {size_t} count - how many
+ * @returns {bool} true if they were all written.
+ */
+bool savefile::write(const char* bytes, size_t count) {
+   while (count > 0) {
+      ssize_t n = ::write(fd, bytes, count);
+      if (n <= 0) return false;
+      bytes += n;
+      count -= n;
+   }
+   return true;
+}
+
+/**
+ * @method commit
+ * Syncs the copy, puts it in the file's place and syncs the directory.
+ * @param {struct stat*} info - set to what the new file looks like, if not NULL
+ * @returns {bool} true if the new file is on disk (the copy is removed otherwise).
+ */
+bool savefile::commit(struct stat* info) {
+   if (fd < 0) return false;
+   bool ok = (fsync(fd) == 0);
+   if (ok && info) ok = (fstat(fd, info) == 0);
+   ok = (close(fd) == 0) && ok;
+   fd = -1;
+   if (ok) ok = (rename(aside.c_str(), real.c_str()) == 0);
+   if (!ok) {
+      unlink(aside.c_str());
+      return false;
+   }
+
+   size_t slash = real.find_last_of('/');
+   int directory = ::open((slash == string::npos) ? "." : real.substr(0, slash + 1).c_str(), O_RDONLY | O_DIRECTORY);
+   if (directory >= 0) {
+      ok = (fsync(directory) == 0);
+      close(directory);
+   }
+   return ok;
+}
+
+/**
+ * @method abandon
+ * Closes and removes the copy, if there is one.
+ */
+void savefile::abandon() {
+   if (fd < 0) return;
+   close(fd);
+   unlink(aside.c_str());
+   fd = -1;
+}
+
+#endif
@@ -23,6 +23,12 @@
 #include <termios.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include "writer.h"
 
 using namespace std;
 
@@ -55,19 +61,25 @@ using namespace std;
 #define KEY_SHIFT_LEFT 20
 #define KEY_SHIFT_RIGHT 21
 #define KEY_DELETE 22
-//#define KEY 23
+#define KEY_UNKNOWN 23 // an escape sequence (or byte) that isn't a key we know
+#define KEY_HANGUP 24 // the terminal went away (see catchHangup())
 
 #define LITERAL_KEY_ESCAPE 27
 
+/*
+ * getKey() hands special keys back as KEY_SPECIAL plus one of the indices
+ * above, so that one int can hold any key.  Anything below KEY_SPECIAL is a
+ * byte that can be typed into the text.
+ */
+#define KEY_SPECIAL 256
+
 /**
- * @function getch
- * Gets a single keypress/character from the input buffer and
- * nothing else (no enter key or other thing required).
- * @returns {int} the character retrieved from the buffer.
+ * @function rawMode
+ * Switches the terminal to reading single keypresses.
+ * @param {struct termios&} oldattr - set to the attributes to restore later
  */
-int getch() {
-   struct termios oldattr, newattr;
-   int ch;
+void rawMode(struct termios& oldattr) {
+   struct termios newattr;
    tcgetattr(STDIN_FILENO, &oldattr);
    newattr = oldattr;
    //newattr.c_lflag &= ~(ICANON | ECHO);
@@ -80,10 +92,89 @@ int getch() {
    newattr.c_iflag &= ~(ICRNL | IXON);
    
    tcsetattr(STDIN_FILENO, TCSANOW, &newattr);
-   ch = getchar();
-   //read(STDIN_FILENO, &ch, 1);
+}
+
+/*
+ * Set once the terminal has gone away: the end of the input, a hangup, or
+ * SIGHUP or SIGTERM once catchHangup() has been called.  The signal can land
+ * on any thread, so the handler also writes to a pipe that every wait for a
+ * key polls along with the terminal.
+ */
+volatile sig_atomic_t hungUp = 0;
+int hangupPipe[2] = { -1, -1 };
+
+/**
+ * @function onHangup
+ * Handles SIGHUP and SIGTERM.
+ */
+void onHangup(int) {
+   hungUp = 1;
+   char signal = 0;
+   if (write(hangupPipe[1], &signal, 1) < 0) {} // a full pipe already says so
+}
+
+/**
+ * @function catchHangup
+ * Turns SIGHUP and SIGTERM into a KEY_HANGUP from getKey(), instead of
+ * ending the program on the spot, so that it can write out what it has to.
+ */
+void catchHangup() {
+   if (pipe(hangupPipe) != 0) return;
+   fcntl(hangupPipe[1], F_SETFL, O_NONBLOCK);
+   fcntl(hangupPipe[0], F_SETFD, FD_CLOEXEC);
+   fcntl(hangupPipe[1], F_SETFD, FD_CLOEXEC);
+
+   struct sigaction action = {};
+   action.sa_handler = onHangup;
+   sigemptyset(&action.sa_mask);
+   sigaction(SIGHUP, &action, nullptr);
+   sigaction(SIGTERM, &action, nullptr);
+}
+
+// how many bytes of keys one read() takes (an escape sequence, or a paste)
+#define KEY_BUFFER 256
+
+/*
+ * Keys read from the terminal and not handed out yet.  read() takes all of
+ * what's waiting at once, instead of going through stdio, so waitForInput()
+ * can tell when there's more here without knowing how stdio buffers.
+ */
+unsigned char keyBuffer[KEY_BUFFER];
+size_t keyBufferAt = 0;
+size_t keyBufferEnd = 0;
+
+/**
+ * @function getch
+ * Gets a single keypress/character from the input buffer and
+ * nothing else (no enter key or other thing required).
+ * @returns {int} the character retrieved from the buffer (-1 once the terminal has gone away).
+ */
+int getch() {
+   if (keyBufferAt < keyBufferEnd) return keyBuffer[keyBufferAt++];
+
+   struct termios oldattr;
+   tout.flush();
+   rawMode(oldattr);
+
+   // a hangup mustn't wait behind the read()
+   struct pollfd inputs[2] = { { STDIN_FILENO, POLLIN, 0 }, { hangupPipe[0], POLLIN, 0 } };
+   while ((hangupPipe[0] >= 0) && !hungUp && (poll(inputs, 2, -1) < 0) && (errno == EINTR)) {}
+
+   ssize_t n = -1;
+   if (!hungUp) {
+      do {
+         n = read(STDIN_FILENO, keyBuffer, KEY_BUFFER);
+      } while ((n < 0) && (errno == EINTR) && !hungUp);
+   }
    tcsetattr(STDIN_FILENO, TCSANOW, &oldattr);
-   return ch;
+
+   if (n <= 0) {
+      hungUp = 1;
+      return -1;
+   }
+   keyBufferAt = 1;
+   keyBufferEnd = n;
+   return keyBuffer[0];
 }
 /*
 int getch() {
@@ -99,6 +190,50 @@ int getch() {
 }
 */
 
+// what waitForInput() found
+#define WAIT_TIMEOUT 0
+#define WAIT_KEY 1
+#define WAIT_OTHER 2
+
+/**
+ * @function waitForInput
+ * Waits for a keypress (without taking it out of the input buffer) or for
+ * another file descriptor to become readable, whichever comes first.
+ * Characters that getch() has already read count as a keypress, and so does
+ * the terminal going away (getKey() then returns KEY_HANGUP).
+ * @param {const int} other - the other file descriptor (-1 for none)
+ * @param {const int} timeout - how long to wait in milliseconds (-1 forever)
+ * @returns {int} WAIT_KEY, WAIT_OTHER or WAIT_TIMEOUT.
+ */
+int waitForInput(const int other, const int timeout) {
+   if ((keyBufferAt < keyBufferEnd) || hungUp) return WAIT_KEY;
+
+   // whatever was drawn should be visible while we wait
+   tout.flush();
+
+   // keys only become readable one at a time in raw mode
+   struct termios oldattr;
+   rawMode(oldattr);
+   // (poll() skips the descriptors that are -1)
+   struct pollfd inputs[3] = { { STDIN_FILENO, POLLIN, 0 }, { other, POLLIN, 0 }, { hangupPipe[0], POLLIN, 0 } };
+   int ready = poll(inputs, 3, timeout);
+   tcsetattr(STDIN_FILENO, TCSANOW, &oldattr);
+
+   if (hungUp) return WAIT_KEY;
+   if (ready <= 0) return WAIT_TIMEOUT;
+   return (inputs[0].revents != 0) ? WAIT_KEY : WAIT_OTHER;
+}
+
+/**
+ * @function waitForKey
+ * Waits for a keypress without taking it out of the input buffer.
+ * @param {const int} timeout - how long to wait in milliseconds (-1 forever)
+ * @returns {bool} true if a key is waiting, false if the time ran out.
+ */
+bool waitForKey(const int timeout) {
+   return waitForInput(-1, timeout) == WAIT_KEY;
+}
+
 /**
  * @function resolveEscapeSequence
  * Detects a control sequence and determines if it matches any that we're interested in.
@@ -180,5 +315,23 @@ int resolveEscapeSequence() {
    return -1;
 }
 
-#endif
+/**
+ * @function getKey
+ * Gets a single keypress, resolving escape sequences.  Escape sequences that
+ * don't match anything, and bytes that can't be part of UTF-8, come back as
+ * KEY_SPECIAL + KEY_UNKNOWN, so they're never typed.  Once the terminal has
+ * gone away, every key is KEY_SPECIAL + KEY_HANGUP.
+ * @returns {int} the character typed, or KEY_SPECIAL + the index of the special key.
+ */
+int getKey() {
+   int c = getch();
+   if (hungUp) return KEY_SPECIAL + KEY_HANGUP;
+   if ((c == 0xc0) || (c == 0xc1) || (c >= 0xf5)) return KEY_SPECIAL + KEY_UNKNOWN;
+   if (c && c != LITERAL_KEY_ESCAPE) return c;
 
+   int special = resolveEscapeSequence();
+   if (hungUp) return KEY_SPECIAL + KEY_HANGUP;
+   return KEY_SPECIAL + ((special < 0) ? KEY_UNKNOWN : special);
+}
+
+#endif
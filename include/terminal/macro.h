@@ -0,0 +1,122 @@
+/*
+ * Class: macro
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A keyboard macro: the keys typed between start() and stop(), as
+ *      getKey() decoded them, so replaying one never goes near an escape
+ *      sequence again.  Only keys that edit or move around are kept; keys
+ *      that prompt, switch buffers or exit would stop a replay in its tracks
+ *      (or worse), so they're left out of the recording.
+ */
+
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <vector>
+
+#include "keyboard.h"
+
+using namespace std;
+
+class macro {
+   private:
+      vector<int> keys;
+      bool active;
+
+   public:
+      macro();
+
+      bool recording() const;
+      bool empty() const;
+      const vector<int>& sequence() const;
+
+      void start();
+      void stop();
+      void record(const int);
+
+      static bool replayable(const int);
+};
+
+/**
+ * @constructs macro
+ * Starts out empty and not recording.
+ */
+macro::macro() {
+   active = false;
+}
+
+/**
+ * @method recording
+ * @returns {bool} true between start() and stop().
+ */
+bool macro::recording() const {
+   return active;
+}
+
+/**
+ * @method empty
+ * @returns {bool} true if there are no keys to replay.
+ */
+bool macro::empty() const {
+   return keys.empty();
+}
+
+/**
+ * @method sequence
+ * @returns {const vector<int>&} the keys recorded, in order.
+ */
+const vector<int>& macro::sequence() const {
+   return keys;
+}
+
+/**
+ * @method start
+ * Forgets the last macro and starts recording a new one.
+ */
+void macro::start() {
+   keys.clear();
+   active = true;
+}
+
+/**
+ * @method stop
+ * Stops recording; what was recorded is kept for replaying.
+ */
+void macro::stop() {
+   active = false;
+}
+
+/**
+ * @method record
+ * Adds a key to the macro, if one is being recorded and the key can be
+ * replayed.
+ * @param {const int} key - the key, as returned by getKey()
+ */
+void macro::record(const int key) {
+   if (active && replayable(key)) keys.push_back(key);
+}
+
+/**
+ * @method replayable
+ * @param {const int} key - the key, as returned by getKey()
+ * @returns {bool} true for typing, moving, selecting, copying, cutting and pasting.
+ */
+bool macro::replayable(const int key) {
+   // control keys other than backspace, tab and enter may be commands
+   if (key < ' ') return (key == 0x08) || (key == '\t') || (key == 10) || (key == 13);
+   if (key < KEY_SPECIAL) return true;
+   switch (key - KEY_SPECIAL) {
+      case KEY_UP: case KEY_DOWN: case KEY_LEFT: case KEY_RIGHT:
+      case KEY_HOME: case KEY_END:
+      case KEY_SHIFT_LEFT: case KEY_SHIFT_RIGHT:
+      case KEY_F4: case KEY_F5: case KEY_F6: case KEY_F7:
+         return true;
+   }
+   return false;
+}
+
+#endif
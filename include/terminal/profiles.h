@@ -0,0 +1,148 @@
+/*
+ * Terminal Profiles
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      The control sequences for the terminals we actually run on, compiled
+ *      in, so that terminal doesn't have to ask tput for them (ten shell
+ *      invocations) on every start.  The sequences are the ones terminfo has
+ *      for each of them.  Cursor addressing is formatted by a template on the
+ *      profile, so for these terminals it's a couple of integer conversions
+ *      instead of interpreting the terminfo string every time.
+ *
+ *      Each profile lists the $TERM values it's right for, in full: a variant
+ *      of a listed terminal (xterm-mono, which has no colors, say) is not the
+ *      same terminal.  Anything not listed here still goes through tput.
+ */
+
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <string.h>
+
+#include "writer.h"
+
+using namespace std;
+
+/**
+ * What every profile here has in common: ANSI cursor addressing, one based,
+ * the DEC save/restore cursor sequences, and (unless a profile says
+ * otherwise) insert and delete line.
+ */
+struct ansiProfile {
+   static constexpr const char* csi = "\x1B[";
+   static constexpr int origin = 1;
+   static constexpr char cursorFinal = 'H';
+   static constexpr char scrollFinal = 'r';
+   static constexpr char insertLineFinal = 'L';
+   static constexpr char deleteLineFinal = 'M';
+   static constexpr bool lineEditing = true;
+   static constexpr bool colors = true; // the eight ANSI foreground colors
+   static constexpr const char* defaultForeground = "\x1B[39m";
+
+   static constexpr const char* reverse = "\x1B[7m";
+   static constexpr const char* saveCursor = "\x1B" "7";
+   static constexpr const char* restoreCursor = "\x1B" "8";
+};
+
+struct xtermProfile : ansiProfile {
+   static constexpr const char* names[] = { "xterm", "xterm-color", "xterm-256color", nullptr };
+   static constexpr const char* clear = "\x1B[H\x1B[2J\x1B[3J";
+   static constexpr const char* resetAttributes = "\x1B(B\x1B[m";
+   static constexpr const char* resetTerminal = "\x1B" "c\x1B]104\x07";
+   static constexpr const char* hideCursor = "\x1B[?25l";
+   static constexpr const char* showCursor = "\x1B[?12l\x1B[?25h";
+};
+
+struct vt100Profile : ansiProfile {
+   static constexpr const char* names[] = { "vt100", "vt102", nullptr };
+   static constexpr const char* clear = "\x1B[H\x1B[J";
+   static constexpr const char* resetAttributes = "\x1B[m\x0F";
+   static constexpr const char* resetTerminal = "\x1B<\x1B>\x1B[?3;4;5l\x1B[?7;8h\x1B[r";
+   static constexpr const char* hideCursor = "";
+   static constexpr const char* showCursor = "";
+   static constexpr bool lineEditing = false; // that came with the vt102
+   static constexpr bool colors = false;
+};
+
+struct linuxProfile : ansiProfile {
+   static constexpr const char* names[] = { "linux", nullptr };
+   static constexpr const char* clear = "\x1B[H\x1B[J\x1B[3J";
+   static constexpr const char* resetAttributes = "\x1B[m\x0F";
+   static constexpr const char* resetTerminal = "\x1B" "c\x1B]R";
+   static constexpr const char* hideCursor = "\x1B[?25l\x1B[?1c";
+   static constexpr const char* showCursor = "\x1B[?25h\x1B[?0c";
+};
+
+struct screenProfile : ansiProfile {
+   static constexpr const char* names[] = { "screen", "screen-256color", "tmux", "tmux-256color", nullptr };
+   static constexpr const char* clear = "\x1B[H\x1B[J";
+   static constexpr const char* resetAttributes = "\x1B[m\x0F";
+   static constexpr const char* resetTerminal = "\x1B" "c\x1B[?1000l\x1B[?25h";
+   static constexpr const char* hideCursor = "\x1B[?25l";
+   static constexpr const char* showCursor = "\x1B[34h\x1B[?25h";
+};
+
+/**
+ * @function profileMoveCursor
+ * Writes the cursor addressing sequence of profile P.
+ * @param {const int} line - the line to move the cursor to
+ * @param {const int} col - the column to move the cursor to
+ */
+template <typename P>
+void profileMoveCursor(const int line, const int col) {
+   tout << P::csi << (line + P::origin) << ';' << (col + P::origin) << P::cursorFinal;
+}
+
+/**
+ * @function profileChangeScrollRegion
+ * Writes the scroll region sequence of profile P.
+ * @param {const int} firstline - the first line of the region
+ * @param {const int} lastline - the last line of the region
+ */
+template <typename P>
+void profileChangeScrollRegion(const int firstline, const int lastline) {
+   tout << P::csi << (firstline + P::origin) << ';' << (lastline + P::origin) << P::scrollFinal;
+}
+
+/**
+ * @function profileInsertLines
+ * Writes the insert line sequence of profile P (the count is left out for one).
+ * @param {const int} count - how many lines to insert
+ */
+template <typename P>
+void profileInsertLines(const int count) {
+   tout << P::csi;
+   if (count != 1) tout << count;
+   tout << P::insertLineFinal;
+}
+
+/**
+ * @function profileDeleteLines
+ * Writes the delete line sequence of profile P (the count is left out for one).
+ * @param {const int} count - how many lines to delete
+ */
+template <typename P>
+void profileDeleteLines(const int count) {
+   tout << P::csi;
+   if (count != 1) tout << count;
+   tout << P::deleteLineFinal;
+}
+
+/**
+ * @function matchesProfile
+ * @param {const char*} term - the value of $TERM
+ * @returns {bool} true if term is one of the names profile P is for.
+ */
+template <typename P>
+bool matchesProfile(const char* term) {
+   for (const char* const* name = P::names; *name; name++) {
+      if (strcmp(term, *name) == 0) return true;
+   }
+   return false;
+}
+
+#endif
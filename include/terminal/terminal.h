@@ -7,8 +7,10 @@
  * Description:
  *
  *      This class provides a simple interface for manipulating the terminal.
- *      It uses terminfo/termcap to fetch the required sequences on initialization,
- *      but makes no further shell invocations.
+ *      Common terminals ($TERM of xterm, vt100, linux, screen or tmux) use the
+ *      sequences compiled into profiles.h.  Anything else uses terminfo/termcap
+ *      to fetch the required sequences on initialization, but makes no further
+ *      shell invocations.
  *
  *      Ideally I would have used ncurses or a similar implementation,
  *      but I was borrowing a Raspberry Pi which did not have the development
@@ -20,17 +22,29 @@
 #define TERMINAL_H
 
 #include <string>
-#include <iostream>
-#include <iomanip>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdexcept>
 #include <stack>
-#include <sstream>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "writer.h"
+#include "profiles.h"
+
 using namespace std;
 
+// colors for foreground()
+#define COLOR_DEFAULT -1
+#define COLOR_BLACK 0
+#define COLOR_RED 1
+#define COLOR_GREEN 2
+#define COLOR_YELLOW 3
+#define COLOR_BLUE 4
+#define COLOR_MAGENTA 5
+#define COLOR_CYAN 6
+#define COLOR_WHITE 7
+
 class terminal {
    private:
       string sClear;
@@ -43,18 +57,43 @@ class terminal {
       string sResetTerminal;
       string sHideCursor;
       string sShowCursor;
+      string sInsertLine;
+      string sInsertLines;
+      string sDeleteLine;
+      string sDeleteLines;
+      bool bLineEditing;
+      bool bScrollRegion;
+      string sForeground[9]; // COLOR_BLACK to COLOR_WHITE, then COLOR_DEFAULT
+      int currentForeground;
 
       stack<int> pStack;
+
+      // cursor addressing, scroll region and line editing, either from a profile or terminfo
+      void (terminal::*pMoveCursor)(const int, const int);
+      void (terminal::*pChangeScroll)(const int, const int);
+      void (terminal::*pInsertLines)(const int);
+      void (terminal::*pDeleteLines)(const int);
       
       string ToHex(const string&, const bool); /* for debugging */
-      string processUnescapedSequence(const string, const int, const int);
+
+      template <typename P> void useProfile();
+      template <typename P> void profileCursor(const int, const int);
+      template <typename P> void profileScroll(const int, const int);
+      template <typename P> void profileInsert(const int);
+      template <typename P> void profileDelete(const int);
+      void useTerminfo();
+      void terminfoCursor(const int, const int);
+      void terminfoScroll(const int, const int);
+      void terminfoInsert(const int);
+      void terminfoDelete(const int);
       
    public:
       size_t cols;
       size_t lines;
       
-      terminal();
+      terminal(const bool = true);
       string exec(const char*);
+      string processUnescapedSequence(const string, const int, const int);
       
       bool updateDimensions();
       void clear();
@@ -67,18 +106,104 @@ class terminal {
       void resetTerminal();
       void hideCursor();
       void showCursor();
+
+      bool canScroll() const;
+      bool canEditLines() const;
+      void insertLines(const int);
+      void deleteLines(const int);
+
+      bool hasColors() const;
+      void foreground(const int);
       
-      string getReverse();
-      string getResetAttributes();
-      string getSaveCursor();
-      string getRestoreCursor();
+      const string& getReverse() const;
+      const string& getResetAttributes() const;
+      const string& getSaveCursor() const;
+      const string& getRestoreCursor() const;
 };
 
 /**
  * @constructs terminal
  * Gets the necessary control sequences and the dimensions of the terminal.
+ * @param {const bool} profiles - false to always ask terminfo (for comparing the two)
  */
-terminal::terminal() {
+terminal::terminal(const bool profiles) {
+   // Use the compiled in sequences if we know the terminal, ask terminfo otherwise
+   const char* term = getenv("TERM");
+   if (!term || !profiles) term = "";
+   currentForeground = COLOR_DEFAULT;
+
+   if (matchesProfile<xtermProfile>(term)) {
+      useProfile<xtermProfile>();
+   } else if (matchesProfile<vt100Profile>(term)) {
+      useProfile<vt100Profile>();
+   } else if (matchesProfile<linuxProfile>(term)) {
+      useProfile<linuxProfile>();
+   } else if (matchesProfile<screenProfile>(term)) {
+      useProfile<screenProfile>();
+   } else {
+      useTerminfo();
+   }
+   
+   // Get the dimensions of the terminal
+   updateDimensions();
+}
+
+/**
+ * @private
+ * @method useProfile
+ * Takes every control sequence from a compiled in profile.
+ */
+template <typename P>
+void terminal::useProfile() {
+   sClear = P::clear;
+   sReverse = P::reverse;
+   sResetAttributes = P::resetAttributes;
+   sSaveCursor = P::saveCursor;
+   sRestoreCursor = P::restoreCursor;
+   sResetTerminal = P::resetTerminal;
+   sHideCursor = P::hideCursor;
+   sShowCursor = P::showCursor;
+
+   pMoveCursor = &terminal::profileCursor<P>;
+   pChangeScroll = &terminal::profileScroll<P>;
+
+   for (int i = 0; i < 8; i++) {
+      sForeground[i] = P::colors ? string(P::csi) + '3' + (char)('0' + i) + 'm' : "";
+   }
+   sForeground[8] = P::colors ? P::defaultForeground : "";
+
+   bScrollRegion = true;
+   bLineEditing = P::lineEditing;
+   pInsertLines = &terminal::profileInsert<P>;
+   pDeleteLines = &terminal::profileDelete<P>;
+}
+
+template <typename P>
+void terminal::profileCursor(const int line, const int col) {
+   profileMoveCursor<P>(line, col);
+}
+
+template <typename P>
+void terminal::profileScroll(const int firstline, const int lastline) {
+   profileChangeScrollRegion<P>(firstline, lastline);
+}
+
+template <typename P>
+void terminal::profileInsert(const int count) {
+   profileInsertLines<P>(count);
+}
+
+template <typename P>
+void terminal::profileDelete(const int count) {
+   profileDeleteLines<P>(count);
+}
+
+/**
+ * @private
+ * @method useTerminfo
+ * Asks tput for every control sequence.
+ */
+void terminal::useTerminfo() {
    // Get the control sequence for clear
    sClear = exec("tput clear");
    
@@ -108,9 +233,57 @@ terminal::terminal() {
 
    // Get the control sequence for showing the cursor
    sShowCursor = exec("tput cnorm");
-   
-   // Get the dimensions of the terminal
-   updateDimensions();
+
+   // Get the control sequences for inserting and deleting one line, and the
+   // unescaped ones for inserting and deleting several
+   sInsertLine = exec("tput il1");
+   sInsertLines = exec("tput il");
+   sDeleteLine = exec("tput dl1");
+   sDeleteLines = exec("tput dl");
+   // without a scroll region, inserting or deleting lines would move the
+   // function labels along with the text
+   bScrollRegion = !sChangeScroll.empty();
+   bLineEditing = bScrollRegion && (!sInsertLine.empty() || !sInsertLines.empty()) && (!sDeleteLine.empty() || !sDeleteLines.empty());
+
+   // Get the control sequences for every foreground color and the default
+   // one, all in one go (one per line)
+   string colors = exec("for c in 0 1 2 3 4 5 6 7; do tput setaf $c; echo; done; tput op");
+   size_t start = 0;
+   for (int i = 0; i < 9; i++) {
+      size_t newline = (i < 8) ? colors.find('\n', start) : string::npos;
+      sForeground[i] = colors.substr(start, (newline == string::npos) ? string::npos : newline - start);
+      if (newline == string::npos) break;
+      start = newline + 1;
+   }
+
+   pMoveCursor = &terminal::terminfoCursor;
+   pChangeScroll = &terminal::terminfoScroll;
+   pInsertLines = &terminal::terminfoInsert;
+   pDeleteLines = &terminal::terminfoDelete;
+}
+
+void terminal::terminfoCursor(const int line, const int col) {
+   tout << processUnescapedSequence(sMoveCursor, line, col);
+}
+
+void terminal::terminfoScroll(const int firstline, const int lastline) {
+   tout << processUnescapedSequence(sChangeScroll, firstline, lastline);
+}
+
+void terminal::terminfoInsert(const int count) {
+   if (((count == 1) || sInsertLines.empty()) && !sInsertLine.empty()) {
+      for (int i = 0; i < count; i++) tout << sInsertLine;
+   } else {
+      tout << processUnescapedSequence(sInsertLines, count, 0);
+   }
+}
+
+void terminal::terminfoDelete(const int count) {
+   if (((count == 1) || sDeleteLines.empty()) && !sDeleteLine.empty()) {
+      for (int i = 0; i < count; i++) tout << sDeleteLine;
+   } else {
+      tout << processUnescapedSequence(sDeleteLines, count, 0);
+   }
 }
 
 /**
@@ -163,13 +336,13 @@ bool terminal::updateDimensions() {
  * @todo Check for valid coordinates given current terminal dimensions.
  */
 void terminal::moveCursor(const int line, const int col) {
-   cout << processUnescapedSequence(sMoveCursor, line, col);
+   (this->*pMoveCursor)(line, col);
 }
 
 /**
- * @private
  * @method processUnescapedSequence
- * Processes the sequence with the provided parameters
+ * Processes the sequence with the provided parameters (terminfo's %i, %p1,
+ * %p2 and %d), as the terminfo backend does for every cursor move.
  * @param {const string} originalSequence - the sequence to process
  * @param {const int} param1 - the first parameter
  * @param {const int} param2 - the second parameter
@@ -220,7 +393,7 @@ string terminal::processUnescapedSequence(const string originalSequence, const i
  * Clear the screen.
  */
 void terminal::clear() {
-   cout << sClear;
+   tout << sClear;
 }
 
 /**
@@ -231,7 +404,7 @@ void terminal::clear() {
  * @see resetAttributes for undoing this command.
  */
 void terminal::reverse() {
-   cout << sReverse;
+   tout << sReverse;
 }
 
 /**
@@ -240,7 +413,28 @@ void terminal::reverse() {
  * with terminal default attributes.
  */
 void terminal::resetAttributes() {
-   cout << sResetAttributes;
+   tout << sResetAttributes;
+   currentForeground = COLOR_DEFAULT;
+}
+
+/**
+ * @method hasColors
+ * @returns {bool} true if the terminal can change the foreground color.
+ */
+bool terminal::hasColors() const {
+   return !sForeground[COLOR_RED].empty();
+}
+
+/**
+ * @method foreground
+ * Sets the color of future text.  Nothing is written if that's the color
+ * already set, so runs of text can ask for their color every time.
+ * @param {const int} color - COLOR_BLACK to COLOR_WHITE, or COLOR_DEFAULT
+ */
+void terminal::foreground(const int color) {
+   if (color == currentForeground) return;
+   tout << sForeground[((color < COLOR_BLACK) || (color > COLOR_WHITE)) ? 8 : color];
+   currentForeground = color;
 }
 
 /**
@@ -248,7 +442,7 @@ void terminal::resetAttributes() {
  * Saves the position of the cursor (nonstackable).
  */
 void terminal::saveCursor() {
-   cout << sSaveCursor;
+   tout << sSaveCursor;
 }
 
 /**
@@ -256,7 +450,7 @@ void terminal::saveCursor() {
  * Restores the position of the cursor (nonstackable).
  */
 void terminal::restoreCursor() {
-   cout << sRestoreCursor;
+   tout << sRestoreCursor;
 }
 
 /**
@@ -266,7 +460,7 @@ void terminal::restoreCursor() {
  * @param {const int} lastline - the last line to be in the scroll region
  */
 void terminal::changeScrollRegion(const int firstline, const int lastline) {
-   cout << processUnescapedSequence(sChangeScroll, firstline, lastline);
+   (this->*pChangeScroll)(firstline, lastline);
 }
 
 /**
@@ -274,7 +468,8 @@ void terminal::changeScrollRegion(const int firstline, const int lastline) {
  * Resets the terminal to system defaults for all parameters.
  */
 void terminal::resetTerminal() {
-   cout << sResetTerminal;
+   tout << sResetTerminal;
+   currentForeground = COLOR_DEFAULT;
 }
 
 /**
@@ -282,7 +477,7 @@ void terminal::resetTerminal() {
  * Hides the cursor.
  */
 void terminal::hideCursor() {
-   cout << sHideCursor;
+   tout << sHideCursor;
 }
 
 /**
@@ -290,7 +485,44 @@ void terminal::hideCursor() {
  * Shows the cursor.
  */
 void terminal::showCursor() {
-   cout << sShowCursor;
+   tout << sShowCursor;
+}
+
+/**
+ * @method canScroll
+ * @returns {bool} true if the terminal has a scroll region, so a newline on
+ * its last row scrolls only the rows inside it.
+ */
+bool terminal::canScroll() const {
+   return bScrollRegion;
+}
+
+/**
+ * @method canEditLines
+ * @returns {bool} true if the terminal can insert and delete lines.
+ */
+bool terminal::canEditLines() const {
+   return bLineEditing;
+}
+
+/**
+ * @method insertLines
+ * Inserts blank lines at the cursor, pushing the lines below it down
+ * (and off the bottom of the scroll region).  Only if canEditLines().
+ * @param {const int} count - how many lines to insert
+ */
+void terminal::insertLines(const int count) {
+   (this->*pInsertLines)(count);
+}
+
+/**
+ * @method deleteLines
+ * Deletes lines at the cursor, pulling the lines below it up and leaving
+ * blank lines at the bottom of the scroll region.  Only if canEditLines().
+ * @param {const int} count - how many lines to delete
+ */
+void terminal::deleteLines(const int count) {
+   (this->*pDeleteLines)(count);
 }
 
 /**
@@ -300,7 +532,7 @@ void terminal::showCursor() {
  * you in string form.  Useful for cout inlining of output manipulation.
  * @returns {string} the control sequence for reversing colors.
  */
-string terminal::getReverse() {
+const string& terminal::getReverse() const {
    return sReverse;
 }
 
@@ -311,7 +543,7 @@ string terminal::getReverse() {
  * it to you in string form.  Useful for cout inlining of output manipulation.
  * @returns {string} the control sequence for reseting attributes.
  */
-string terminal::getResetAttributes() {
+const string& terminal::getResetAttributes() const {
    return sResetAttributes;
 }
 
@@ -322,7 +554,7 @@ string terminal::getResetAttributes() {
  * to you in string form.  Useful for cout inlining of output manipulation.
  * @returns {string} the control sequence for saving the cursor.
  */
-string terminal::getSaveCursor() {
+const string& terminal::getSaveCursor() const {
    return sSaveCursor;
 }
 
@@ -333,7 +565,7 @@ string terminal::getSaveCursor() {
  * it to you in string form.  Useful for cout inlining of output manipulation.
  * @returns {string} the control sequence for restoring the cursor.
  */
-string terminal::getRestoreCursor() {
+const string& terminal::getRestoreCursor() const {
    return sRestoreCursor;
 }
 
@@ -345,13 +577,15 @@ string terminal::getRestoreCursor() {
  * @returns {string} the hex representation of the string.
  */
 string terminal::ToHex(const string& s, const bool upper_case = true) {
-   ostringstream ret;
+   const char* digits = upper_case ? "0123456789ABCDEF" : "0123456789abcdef";
+   string ret;
 
    for (string::size_type i = 0; i < s.length(); ++i) {
-      ret << hex << setfill('0') << setw(2) << (upper_case ? uppercase : nouppercase) << (int)s[i];
+      ret += digits[(unsigned char)s[i] >> 4];
+      ret += digits[(unsigned char)s[i] & 0x0F];
    }
 
-   return ret.str();
+   return ret;
 }
 
 #endif
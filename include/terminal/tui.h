@@ -6,15 +6,18 @@
  * 
  * Description:
  *
- *      Wraps around a terminal and provides more advanced graphics functions.
+ *      Wraps around a terminal and provides more advanced graphics functions,
+ *      and the one-line prompt all of the editors ask for text with.
  */
 
 #ifndef TUI_H
 #define TUI_H
 
 #include <string>
+#include <algorithm>
 
 #include "terminal.h"
+#include "keyboard.h"
 
 using namespace std;
 
@@ -37,6 +40,8 @@ class tui {
       void drawFunctionLabels(const string labels[8]);
       void drawFunctionLabels(const string, const string, const string,
          const string, const string, const string, const string, const string);
+
+      bool prompt(const string&, string&);
 };
 
 /**
@@ -114,7 +119,7 @@ void tui::drawFunctionLabels(const string labels[8]) {
    for (size_t i = 0; i < 8; i++) {
       rt->moveCursor(rt->lines - 1, (rt->cols * i) / 8);
       // prepend a space unless it's long enough to fill the whole label space
-      cout << (labels[i].length() >= labellength ? labels[i] : (" " + labels[i]));
+      tout << (labels[i].length() >= labellength ? labels[i] : (" " + labels[i]));
    }
 
    rt->restoreCursor();
@@ -132,4 +137,36 @@ void tui::drawFunctionLabels(const string f1, const string f2, const string f3,
    drawFunctionLabels(composed);
 }
 
+/**
+ * @method prompt
+ * Reads a line of text on the line above the function labels.  Only
+ * printable characters are taken; a hangup cancels it like F8 does.
+ * @param {const string&} label - what is being asked for
+ * @param {string&} answer - the suggested answer, replaced by what was typed
+ * @returns {bool} false if the prompt was cancelled (F8).
+ */
+bool tui::prompt(const string& label, string& answer) {
+   rt->moveCursor(rt->lines - 2, 0);
+   tout << padRight(label + answer, rt->cols);
+   rt->moveCursor(rt->lines - 2, min(label.length() + answer.length(), rt->cols - 1));
+
+   while (true) {
+      int key = getKey();
+
+      if ((key == 0x08) || (key == 0x7f)) {
+         if (answer.length() > 0) {
+            answer.pop_back();
+            tout << (char)0x08 << ' ' << (char)0x08;
+         }
+      } else if ((key == 10) || (key == 13)) {
+         return true;
+      } else if ((key == KEY_SPECIAL + KEY_F8) || (key == KEY_SPECIAL + KEY_HANGUP)) {
+         return false;
+      } else if ((key >= ' ') && (key < KEY_SPECIAL)) {
+         answer.push_back(key);
+         tout << (char)key;
+      }
+   }
+}
+
 #endif
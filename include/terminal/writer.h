@@ -0,0 +1,373 @@
+/*
+ * Class: writer
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Everything that goes to the screen goes through tout, so the programs
+ *      don't need iostream just to print strings and a few numbers.  By
+ *      default tout hands everything to cout.  Built with -DMINIMAL_RUNTIME it
+ *      keeps its own buffer and write()s it to stdout when flushed instead, and
+ *      <iostream> is never included, along with its static initialization.
+ *
+ *      tout is flushed by getch() before waiting for a key, so a frame goes
+ *      out in (usually) one write.
+ *
+ *      background() moves the write()s onto a thread of their own: flush()
+ *      then only hands the frame over and returns, so a terminal that takes
+ *      its time (a slow serial line, a congested ssh connection) never holds
+ *      up whoever is drawing.  busy() says whether the thread is still
+ *      writing, for skipping frames until it catches up.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+#ifndef MINIMAL_RUNTIME
+#include <iostream>
+#endif
+
+using namespace std;
+
+// a program can ask for a bigger buffer (-DWRITER_BUFFER=...) so a frame is one write
+#ifndef WRITER_BUFFER
+#define WRITER_BUFFER 8192
+#endif
+
+/**
+ * Text padded with spaces (on the right) to a width, like setw() << left.
+ * Text longer than the width is printed whole.
+ */
+struct padded {
+   const string& text;
+   size_t width;
+};
+
+padded padRight(const string& text, const size_t width) {
+   return { text, width };
+}
+
+class writer {
+   private:
+      int fd;
+#ifdef MINIMAL_RUNTIME
+      size_t used;
+      char buffer[WRITER_BUFFER];
+#endif
+
+      // with the thread: the frame being drawn, and what has been handed
+      // over and not written yet (guarded by lock)
+      bool threaded;
+      string frame;
+      string queued;
+      bool writing;
+      bool stopping;
+      pthread_t thread;
+      pthread_mutex_t lock;
+      pthread_cond_t handed;
+
+      static void* run(void*);
+      void work();
+      void send(const char*, const size_t);
+
+   public:
+      size_t count; // bytes written so far, for anyone measuring
+
+      writer(const int);
+      ~writer();
+
+      void write(const char*, const size_t);
+      void spaces(size_t);
+      void flush();
+
+      bool background();
+      void foreground();
+      bool busy();
+
+      writer& operator<<(const string&);
+      writer& operator<<(const char*);
+      writer& operator<<(const char);
+      writer& operator<<(const padded&);
+
+      template <typename T>
+      typename enable_if<is_integral<T>::value, writer&>::type operator<<(const T);
+};
+
+/**
+ * @function toDecimal
+ * Formats a number with a fixed number of decimal places, like
+ * fixed << setprecision(places).
+ * @param {double} value - the number to format
+ * @param {int} places - digits after the decimal point
+ * @returns {string} the formatted number.
+ */
+string toDecimal(double value, const int places) {
+   string result;
+   if (value < 0) {
+      result += '-';
+      value = -value;
+   }
+
+   unsigned long long scale = 1;
+   for (int i = 0; i < places; i++) scale *= 10;
+   unsigned long long scaled = (unsigned long long)(value * scale + 0.5);
+
+   result += to_string(scaled / scale);
+   if (places > 0) {
+      string fraction = to_string(scaled % scale);
+      result += '.';
+      result.append(places - fraction.length(), '0');
+      result += fraction;
+   }
+   return result;
+}
+
+/**
+ * @constructs writer
+ * @param {const int} newfd - the file descriptor to write to
+ */
+writer::writer(const int newfd) {
+   count = 0;
+   fd = newfd;
+#ifdef MINIMAL_RUNTIME
+   used = 0;
+#endif
+   threaded = writing = stopping = false;
+}
+
+/**
+ * @destructs writer
+ * Flushes whatever is left, so exit() doesn't lose the last frame.
+ */
+writer::~writer() {
+   foreground();
+   flush();
+}
+
+/**
+ * @method write
+ * Writes raw bytes.
+ * @param {const char*} data - the bytes to write
+ * @param {const size_t} length - how many bytes
+ */
+void writer::write(const char* data, const size_t length) {
+   count += length;
+   if (threaded) {
+      frame.append(data, length);
+      return;
+   }
+#ifdef MINIMAL_RUNTIME
+   if (used + length > WRITER_BUFFER) {
+      flush();
+      if (length > WRITER_BUFFER) {
+         // too big to be worth buffering
+         send(data, length);
+         return;
+      }
+   }
+   for (size_t i = 0; i < length; i++) buffer[used + i] = data[i];
+   used += length;
+#else
+   cout.write(data, length);
+#endif
+}
+
+/**
+ * @method spaces
+ * Writes the provided number of spaces.
+ */
+void writer::spaces(size_t n) {
+   static const char blanks[] = "                                ";
+   while (n > 0) {
+      size_t chunk = (n < sizeof(blanks) - 1) ? n : sizeof(blanks) - 1;
+      write(blanks, chunk);
+      n -= chunk;
+   }
+}
+
+/**
+ * @method flush
+ * Hands everything written so far to the terminal.
+ */
+void writer::flush() {
+   if (threaded) {
+      if (frame.empty()) return;
+      pthread_mutex_lock(&lock);
+      if (queued.empty()) queued.swap(frame); else queued += frame;
+      frame.clear();
+      pthread_cond_signal(&handed);
+      pthread_mutex_unlock(&lock);
+      return;
+   }
+#ifdef MINIMAL_RUNTIME
+   send(buffer, used);
+   used = 0;
+#else
+   cout.flush();
+#endif
+}
+
+/**
+ * @method background
+ * Starts a thread to do the write()s from now on.
+ * @returns {bool} true if there is one (otherwise nothing changes).
+ */
+bool writer::background() {
+   if (threaded) return true;
+   flush();
+
+   pthread_mutex_init(&lock, NULL);
+   pthread_cond_init(&handed, NULL);
+   writing = stopping = false;
+   threaded = (pthread_create(&thread, NULL, run, this) == 0);
+   if (!threaded) {
+      pthread_cond_destroy(&handed);
+      pthread_mutex_destroy(&lock);
+   }
+   return threaded;
+}
+
+/**
+ * @method foreground
+ * Waits for the thread to write everything handed over, and goes back to
+ * writing on the spot.
+ */
+void writer::foreground() {
+   if (!threaded) return;
+   flush();
+
+   pthread_mutex_lock(&lock);
+   stopping = true;
+   pthread_cond_signal(&handed);
+   pthread_mutex_unlock(&lock);
+   pthread_join(thread, NULL);
+
+   threaded = false;
+   pthread_cond_destroy(&handed);
+   pthread_mutex_destroy(&lock);
+}
+
+/**
+ * @method busy
+ * @returns {bool} true while the thread still has something to write.
+ */
+bool writer::busy() {
+   if (!threaded) return false;
+   pthread_mutex_lock(&lock);
+   bool result = writing || !queued.empty();
+   pthread_mutex_unlock(&lock);
+   return result;
+}
+
+/**
+ * @private
+ * @method run
+ * Where the thread starts.
+ */
+void* writer::run(void* self) {
+   static_cast<writer*>(self)->work();
+   return NULL;
+}
+
+/**
+ * @private
+ * @method work
+ * Writes whatever gets handed over (on the thread), until foreground().
+ * Frames handed over while one is being written go out together.
+ */
+void writer::work() {
+   string out;
+   pthread_mutex_lock(&lock);
+   while (true) {
+      while (queued.empty() && !stopping) pthread_cond_wait(&handed, &lock);
+      if (queued.empty()) break;
+
+      out.swap(queued);
+      writing = true;
+      pthread_mutex_unlock(&lock);
+
+      send(out.data(), out.length());
+      out.clear();
+
+      pthread_mutex_lock(&lock);
+      writing = false;
+   }
+   pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @private
+ * @method send
+ * write()s all of it, straight to the descriptor.  Interrupted and partial
+ * writes carry on, a descriptor that's full (non-blocking) is waited on, and
+ * only an error that won't go away (the terminal hung up) gives up.
+ * @param {const char*} data - the bytes
+ * @param {const size_t} length - how many
+ */
+void writer::send(const char* data, const size_t length) {
+   size_t done = 0;
+   while (done < length) {
+      ssize_t n = ::write(fd, data + done, length - done);
+      if (n > 0) {
+         done += n;
+      } else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+         struct pollfd out = { fd, POLLOUT, 0 };
+         while ((poll(&out, 1, -1) < 0) && (errno == EINTR)) {}
+      } else if ((n == 0) || (errno != EINTR)) {
+         return;
+      }
+   }
+}
+
+writer& writer::operator<<(const string& text) {
+   write(text.data(), text.length());
+   return *this;
+}
+
+writer& writer::operator<<(const char* text) {
+   size_t length = 0;
+   while (text[length]) length++;
+   write(text, length);
+   return *this;
+}
+
+writer& writer::operator<<(const char c) {
+   write(&c, 1);
+   return *this;
+}
+
+writer& writer::operator<<(const padded& p) {
+   write(p.text.data(), p.text.length());
+   if (p.text.length() < p.width) spaces(p.width - p.text.length());
+   return *this;
+}
+
+template <typename T>
+typename enable_if<is_integral<T>::value, writer&>::type writer::operator<<(const T n) {
+   // digits come out backwards, so fill from the end
+   char digits[24];
+   size_t i = sizeof digits;
+   bool negative = false;
+   if constexpr (is_signed<T>::value) negative = n < 0;
+   unsigned long long value = negative ? 0 - (unsigned long long)n : (unsigned long long)n;
+   do {
+      digits[--i] = '0' + (value % 10);
+      value /= 10;
+   } while (value > 0);
+   if (negative) digits[--i] = '-';
+   write(digits + i, sizeof digits - i);
+   return *this;
+}
+
+writer tout(STDOUT_FILENO);
+
+#endif
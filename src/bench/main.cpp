@@ -0,0 +1,548 @@
+/*
+ * Program: bench
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Keystroke replay benchmark for text.  Runs the editor on a pseudo
+ *      terminal, feeds it a script one key at a time, and waits for it to go
+ *      back to reading the keyboard before sending the next key.  The time in
+ *      between is the latency of that key.  Everything the editor prints runs
+ *      through a small VT parser which counts bytes, escape sequences and
+ *      cursor moves, and /proc/<pid>/io gives the read and write syscalls.
+ *      The editor's RSS is taken once its scenario is over.
+ *
+ *      Usage: bench [-s COLSxLINES] [-e path/to/text] [script.keys ...]
+ *
+ *      Without scripts the built-in scenarios are run (typing, long line
+ *      editing, scrolling, pasting and saving).  A script is a file of raw
+ *      keystrokes, as the terminal would send them.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <pty.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// keys, as an xterm sends them
+#define KEYS_UP "\x1B[A"
+#define KEYS_DOWN "\x1B[B"
+#define KEYS_RIGHT "\x1B[C"
+#define KEYS_LEFT "\x1B[D"
+#define KEYS_HOME "\x1BOH"
+#define KEYS_END "\x1BOF"
+#define KEYS_F3 "\x1BOR"
+#define KEYS_F4 "\x1BOS"
+#define KEYS_F5 "\x1B[15~"
+#define KEYS_F7 "\x1B[18~"
+#define KEYS_F8 "\x1B[19~"
+#define KEYS_BACKSPACE "\x7F"
+
+// how long to wait for the editor before giving up on a key
+#define KEY_TIMEOUT_MS 5000
+
+// how often to look at the editor while it is busy
+#define POLL_INTERVAL_US 20
+
+/**
+ * One keystroke of a script.  Setup keys are sent the same way, but they
+ * don't count towards the results.
+ */
+struct keystroke {
+   string bytes;
+   bool measured;
+};
+
+/**
+ * A named list of keystrokes.
+ */
+struct scenario {
+   string name;
+   vector<keystroke> keys;
+
+   void add(const string &bytes, const bool measured = true) {
+      keys.push_back({bytes, measured});
+   }
+   void type(const string &text, const bool measured = true) {
+      for (char c : text) add(string(1, c), measured);
+   }
+   void repeat(const string &bytes, const size_t times, const bool measured = true) {
+      for (size_t i = 0; i < times; i++) add(bytes, measured);
+   }
+};
+
+/**
+ * Counts what the editor prints.  Just enough of a VT parser to tell text
+ * apart from escape sequences.
+ */
+class vtcounter {
+   private:
+      enum { GROUND, ESCAPE, CSI, STRING, CHARSET } state;
+
+   public:
+      size_t bytes;
+      size_t printable;
+      size_t sequences;
+      size_t moves;
+      size_t attributes;
+
+      vtcounter() {
+         state = GROUND;
+         reset();
+      }
+
+      void reset() {
+         bytes = printable = sequences = moves = attributes = 0;
+      }
+
+      void feed(const char *data, const size_t length) {
+         bytes += length;
+         for (size_t i = 0; i < length; i++) {
+            unsigned char c = data[i];
+            if (state == GROUND) {
+               if (c == 0x1B) state = ESCAPE;
+               else if (c >= 0x20) printable++;
+            } else if (state == ESCAPE) {
+               if (c == '[') state = CSI;
+               else if ((c == ']') || (c == 'P')) state = STRING;
+               else if ((c == '(') || (c == ')')) state = CHARSET;
+               else { sequences++; state = GROUND; }
+            } else if (state == CSI) {
+               if ((c >= 0x40) && (c <= 0x7E)) {
+                  sequences++;
+                  if ((c == 'H') || (c == 'f')) moves++;
+                  if (c == 'm') attributes++;
+                  state = GROUND;
+               }
+            } else if (state == STRING) {
+               // ends with BEL or ST (the ESC of ST is close enough)
+               if ((c == 0x07) || (c == 0x1B)) { sequences++; state = GROUND; }
+            } else if (state == CHARSET) {
+               sequences++;
+               state = GROUND;
+            }
+         }
+      }
+};
+
+/**
+ * The editor running on a pseudo terminal.
+ */
+class session {
+   private:
+      int master;
+      int slave;
+      pid_t pid;
+
+   public:
+      vtcounter output;
+
+      session() {
+         master = slave = -1;
+         pid = -1;
+      }
+
+      ~session() {
+         stop();
+      }
+
+      bool start(const string &program, const int cols, const int lines) {
+         struct winsize size = {};
+         size.ws_col = cols;
+         size.ws_row = lines;
+         if (openpty(&master, &slave, NULL, NULL, &size) != 0) return false;
+
+         pid = fork();
+         if (pid < 0) return false;
+         if (pid == 0) {
+            setsid();
+            ioctl(slave, TIOCSCTTY, 0);
+            dup2(slave, STDIN_FILENO);
+            dup2(slave, STDOUT_FILENO);
+            dup2(slave, STDERR_FILENO);
+            close(master);
+            close(slave);
+            execl(program.c_str(), program.c_str(), (char*)NULL);
+            _exit(127);
+         }
+         return true;
+      }
+
+      void stop() {
+         if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            pid = -1;
+         }
+         if (master >= 0) close(master);
+         if (slave >= 0) close(slave);
+         master = slave = -1;
+      }
+
+      /**
+       * @method idle
+       * @returns {bool} true once the editor has read all of its input and is
+       * blocked waiting on the keyboard again.
+       */
+      bool idle() {
+         int unread = 0;
+         ioctl(slave, FIONREAD, &unread);
+         if (unread > 0) return false;
+
+         char buffer[128] = {};
+         int fd = open(("/proc/" + to_string(pid) + "/syscall").c_str(), O_RDONLY);
+         if (fd < 0) return false;
+         ssize_t n = read(fd, buffer, sizeof buffer - 1);
+         close(fd);
+         if (n <= 0) return false;
+
+         // "running" while it's busy, otherwise the syscall number and its arguments
+         char *arguments;
+         long number = strtol(buffer, &arguments, 10);
+         if (arguments == buffer) return false;
+         if ((number == SYS_read) && (strncmp(arguments, " 0x0 ", 5) == 0)) return true;
+#ifdef SYS_poll
+         if (number == SYS_poll) return true;
+#endif
+#ifdef SYS_ppoll
+         if (number == SYS_ppoll) return true;
+#endif
+         return false;
+      }
+
+      /**
+       * @method drain
+       * Reads output until the editor has read everything sent to it and is
+       * idle again.  Input written to the pty shows up on the other side a
+       * little later, so the bytes the editor has read (rchar) are what tell
+       * us it actually got the key.
+       * @param {size_t} readTarget - rchar to wait for (0 for none)
+       * @returns {bool} false if it never got there.
+       */
+      bool drain(const size_t readTarget = 0) {
+         char buffer[16384];
+         auto deadline = chrono::steady_clock::now() + chrono::milliseconds(KEY_TIMEOUT_MS);
+         while (chrono::steady_clock::now() < deadline) {
+            struct pollfd out = { master, POLLIN, 0 };
+            if (poll(&out, 1, 0) > 0) {
+               ssize_t n = read(master, buffer, sizeof buffer);
+               if (n <= 0) return false;
+               output.feed(buffer, n);
+               continue;
+            }
+            if (idle()) {
+               size_t bytesRead, reads, writes;
+               counters(bytesRead, reads, writes);
+               if (bytesRead >= readTarget) return true;
+            }
+
+            // a millisecond of poll() would swamp the latencies we're measuring
+            usleep(POLL_INTERVAL_US);
+         }
+         return false;
+      }
+
+      void send(const string &bytes) {
+         if (write(master, bytes.data(), bytes.length()) < 0) perror("write");
+      }
+
+      /**
+       * @method rss
+       * @returns {size_t} the editor's resident set size in KiB.
+       */
+      size_t rss() {
+         ifstream status("/proc/" + to_string(pid) + "/status");
+         string key;
+         while (status >> key) {
+            if (key == "VmRSS:") {
+               size_t value = 0;
+               status >> value;
+               return value;
+            }
+         }
+         return 0;
+      }
+
+      /**
+       * @method counters
+       * @param {size_t&} bytesRead - set to the bytes read so far
+       * @param {size_t&} reads - set to the read syscalls made so far
+       * @param {size_t&} writes - set to the write syscalls made so far
+       */
+      void counters(size_t &bytesRead, size_t &reads, size_t &writes) {
+         bytesRead = reads = writes = 0;
+         ifstream io("/proc/" + to_string(pid) + "/io");
+         string key;
+         size_t value;
+         while (io >> key >> value) {
+            if (key == "rchar:") bytesRead = value;
+            if (key == "syscr:") reads = value;
+            if (key == "syscw:") writes = value;
+         }
+      }
+};
+
+/**
+ * @function percentile
+ * @param {vector<double>} sorted - the samples, sorted
+ * @param {double} p - the percentile to get (0 to 100)
+ */
+double percentile(const vector<double> &sorted, const double p) {
+   if (sorted.empty()) return 0;
+   size_t index = (size_t)((p / 100.0) * (sorted.size() - 1) + 0.5);
+   return sorted[min(index, sorted.size() - 1)];
+}
+
+/**
+ * @function run
+ * Runs one scenario in a fresh editor and prints a row of results.
+ */
+bool run(const string &program, const scenario &script, const int cols, const int lines) {
+   session editor;
+   if (!editor.start(program, cols, lines)) {
+      cerr << "could not start " << program << endl;
+      return false;
+   }
+
+   auto started = chrono::steady_clock::now();
+   if (!editor.drain()) {
+      cerr << script.name << ": editor never became idle" << endl;
+      return false;
+   }
+   double startup = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+   vector<double> latencies;
+   size_t bytes = 0, sequences = 0, moves = 0;
+   size_t reads = 0, writes = 0;
+
+   for (const keystroke &key : script.keys) {
+      size_t rcharBefore, readsBefore, writesBefore;
+      editor.counters(rcharBefore, readsBefore, writesBefore);
+      editor.output.reset();
+
+      auto sent = chrono::steady_clock::now();
+      editor.send(key.bytes);
+      if (!editor.drain(rcharBefore + key.bytes.length())) {
+         cerr << script.name << ": editor stopped responding" << endl;
+         return false;
+      }
+
+      if (key.measured) {
+         latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+         bytes += editor.output.bytes;
+         sequences += editor.output.sequences;
+         moves += editor.output.moves;
+
+         size_t rcharAfter, readsAfter, writesAfter;
+         editor.counters(rcharAfter, readsAfter, writesAfter);
+         reads += readsAfter - readsBefore;
+         writes += writesAfter - writesBefore;
+      }
+   }
+
+   sort(latencies.begin(), latencies.end());
+   double n = latencies.empty() ? 1 : latencies.size();
+   cout << left << setw(12) << script.name << right
+      << setw(7) << latencies.size()
+      << fixed << setprecision(1)
+      << setw(10) << startup
+      << setw(10) << percentile(latencies, 50)
+      << setw(10) << percentile(latencies, 99)
+      << setw(10) << (latencies.empty() ? 0 : latencies.back())
+      << setw(10) << bytes / n
+      << setw(9) << sequences / n
+      << setw(8) << moves / n
+      << setw(8) << reads / n
+      << setw(8) << writes / n
+      << setw(8) << editor.rss()
+      << endl;
+   return true;
+}
+
+/**
+ * @function scratchFile
+ * @returns {string} where the save scenario writes to.
+ */
+string scratchFile() {
+   return "/tmp/text-bench-" + to_string(getpid()) + ".txt";
+}
+
+/**
+ * @function builtins
+ * The scenarios that run when no scripts are given.
+ */
+vector<scenario> builtins(const int cols, const int lines) {
+   vector<scenario> all;
+   string sentence = "The quick brown fox jumps over the lazy dog.";
+
+   // plain typing, one line after another
+   scenario typing;
+   typing.name = "typing";
+   for (int i = 0; i < 20; i++) {
+      typing.type(sentence);
+      typing.add("\r");
+   }
+   all.push_back(typing);
+
+   // a line several screens wide, edited in the middle
+   scenario longline;
+   longline.name = "longline";
+   for (int i = 0; i < cols * 6 / (int)sentence.length() + 1; i++) longline.type(sentence + " ", false);
+   longline.add(KEYS_HOME, false);
+   longline.repeat(KEYS_RIGHT, cols * 3, false);
+   longline.type("inserted ");
+   longline.repeat("\x7F", 9);
+   longline.add(KEYS_END);
+   longline.type(" appended");
+   all.push_back(longline);
+
+   // moving through a file taller than the screen
+   scenario scroll;
+   scroll.name = "scroll";
+   for (int i = 0; i < lines * 4; i++) {
+      scroll.type(to_string(i) + " " + sentence, false);
+      scroll.add("\r", false);
+   }
+   scroll.repeat(KEYS_UP, lines * 4);
+   scroll.repeat(KEYS_DOWN, lines * 4);
+   all.push_back(scroll);
+
+   // copying a block and pasting it over and over
+   scenario paste;
+   paste.name = "paste";
+   for (int i = 0; i < lines * 2; i++) {
+      paste.type(sentence, false);
+      paste.add("\r", false);
+   }
+   paste.repeat(KEYS_UP, lines * 2, false);
+   paste.add(KEYS_F7, false);
+   paste.repeat(KEYS_DOWN, lines * 2, false);
+   paste.add(KEYS_F5);
+   paste.repeat(KEYS_F4, 20);
+   all.push_back(paste);
+
+   // saving a file of a few hundred lines
+   scenario save;
+   save.name = "save";
+   for (int i = 0; i < 300; i++) {
+      save.type(sentence, false);
+      save.add("\r", false);
+   }
+   string path = scratchFile();
+   for (int i = 0; i < 10; i++) {
+      // the prompt comes filled in with the buffer's name from the second save on
+      save.add(KEYS_F3);
+      save.repeat(KEYS_BACKSPACE, path.length(), false);
+      save.type(path);
+      save.add("\r");
+   }
+   all.push_back(save);
+
+   return all;
+}
+
+/**
+ * @function load
+ * Reads a script of raw keystrokes.  Escape sequences are kept together
+ * as one key; everything else is one key per byte.
+ */
+bool load(const string &filename, scenario &script) {
+   ifstream in(filename, ios::binary);
+   if (!in) return false;
+   string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+   script.name = filename.substr(filename.find_last_of('/') + 1);
+   for (size_t i = 0; i < data.length();) {
+      size_t end = i + 1;
+      if ((data[i] == 0x1B) && (end < data.length())) {
+         // ESC [ ... final, or ESC O x
+         if (data[end] == '[') {
+            end++;
+            while ((end < data.length()) && !((data[end] >= 0x40) && (data[end] <= 0x7E) && (data[end] != '['))) end++;
+            end++;
+         } else {
+            end += 2;
+         }
+         end = min(end, data.length());
+      }
+      script.add(data.substr(i, end - i));
+      i = end;
+   }
+   return true;
+}
+
+int main(int argc, char *argv[]) {
+   string program = "build/text";
+   int cols = 80;
+   int lines = 24;
+   vector<scenario> scripts;
+
+   for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if ((arg == "-s") && (i + 1 < argc)) {
+         if (sscanf(argv[++i], "%dx%d", &cols, &lines) != 2) {
+            cerr << "bad size: " << argv[i] << endl;
+            return 1;
+         }
+      } else if ((arg == "-e") && (i + 1 < argc)) {
+         program = argv[++i];
+      } else {
+         scenario script;
+         if (!load(arg, script)) {
+            cerr << "could not read " << arg << endl;
+            return 1;
+         }
+         scripts.push_back(script);
+      }
+   }
+   if (scripts.empty()) scripts = builtins(cols, lines);
+
+   // the editor needs to know what it's talking to, and shouldn't journal
+   setenv("TERM", "xterm", 0);
+   setenv("TEXT_JOURNAL", "", 0);
+
+   // every key drawn on the spot: with frames paced (and written on a thread)
+   // the editor is back in poll() before the key's frame is out, and idle()
+   // would count it as done
+   setenv("TEXT_FPS", "0", 1);
+
+   cout << "text on a " << cols << "x" << lines << " pty (latency in us, rest per key)" << endl;
+   cout << left << setw(12) << "scenario" << right
+      << setw(7) << "keys"
+      << setw(10) << "start ms"
+      << setw(10) << "p50"
+      << setw(10) << "p99"
+      << setw(10) << "max"
+      << setw(10) << "bytes"
+      << setw(9) << "seqs"
+      << setw(8) << "moves"
+      << setw(8) << "reads"
+      << setw(8) << "writes"
+      << setw(8) << "rss KB"
+      << endl;
+
+   bool ok = true;
+   for (const scenario &script : scripts) {
+      ok = run(program, script, cols, lines) && ok;
+   }
+   unlink(scratchFile().c_str());
+   return ok ? 0 : 1;
+}
@@ -34,7 +34,7 @@ int main(void) {
 
       if (c && c != LITERAL_KEY_ESCAPE) {
          // do nothing
-         cout << (size_t) c << endl;
+         tout << (size_t) c << '\n';
       } else {
          int resultant = resolveEscapeSequence();
 
@@ -42,15 +42,15 @@ int main(void) {
             rt.resetTerminal();
             exit(0);
          } else if (resultant == KEY_HOME) {
-            cout << "Home!" << endl;
+            tout << "Home!" << '\n';
          } else if (resultant == KEY_END) {
-            cout << "End!" << endl;
+            tout << "End!" << '\n';
          } else if (resultant == KEY_PGUP) {
-            cout << "Page Up!" << endl;
+            tout << "Page Up!" << '\n';
          } else if (resultant == KEY_PGDN) {
-            cout << "Page Down!" << endl;
+            tout << "Page Down!" << '\n';
          } else if (resultant == KEY_F1) {
-            cout << "F1!" << endl;
+            tout << "F1!" << '\n';
          }
       }
    }
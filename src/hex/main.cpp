@@ -0,0 +1,322 @@
+/*
+ * Program: hex
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A hex editor.  Bytes are shown in hex and as characters side by side,
+ *      and typed over in either; changes are kept aside (see hexfile.h) until
+ *      they're saved back into the file in place.  Only the page on screen
+ *      is ever read, so a file of any size opens right away.
+ */
+
+#include <string>
+#include <cstdlib>
+
+#include "../../include/terminal/terminal.h"
+#include "../../include/terminal/tui.h"
+#include "../../include/terminal/keyboard.h"
+#include "../../include/buffer/hexfile.h"
+
+using namespace std;
+
+terminal rt;
+tui ui(&rt);
+hexfile file;
+
+// how the rows are laid out: the offset, then the bytes in hex, then as characters
+size_t offsetDigits = 8;
+size_t rowBytes = 16;
+
+// rows of the screen used for bytes (the function labels take the last one)
+size_t pageRows;
+
+// the first byte on screen, the byte the cursor is on, whether the high
+// nibble of it has been typed already, and whether typing goes to the
+// characters instead of the hex
+off_t top = 0;
+off_t cursor = 0;
+bool lowNibble = false;
+bool asciiPane = false;
+
+// what the last command had to say, shown over the row above the function
+// labels (as prompts are) until the next key
+string message;
+
+// what the labels say now, so that they're only drawn again when it changes
+string shownLabels;
+
+// Function prototypes
+void layout();
+void drawPage();
+void drawRow(const size_t row);
+void drawFunctionLabels();
+void drawMessage();
+void placeCursor();
+bool scrollToCursor();
+string hexNumber(unsigned long long value, const size_t digits);
+int hexValue(const int c);
+
+int main(int argc, char *argv[]) {
+   if (argc != 2) {
+      tout << "usage: hex file" << '\n';
+      return 1;
+   }
+   if (!file.open(argv[1])) {
+      tout << "hex: can't open " << argv[1] << '\n';
+      return 1;
+   }
+
+   rt.clear();
+   layout();
+   drawFunctionLabels();
+   drawPage();
+   placeCursor();
+
+   while (true) {
+      int key = getKey();
+      if (key == KEY_SPECIAL + KEY_HANGUP) {
+         // the terminal went away, and there's no one left to ask about changes
+         rt.resetTerminal();
+         exit(1);
+      }
+      off_t editedRow = -1; // the row to draw again, if only one changed
+      bool redraw = !message.empty(); // the message covers a row
+      message.clear();
+
+      if (key == '\t') {
+         // switch between the hex and the characters
+         asciiPane = !asciiPane;
+         lowNibble = false;
+      } else if (key < KEY_SPECIAL) {
+         // type over the byte under the cursor
+         if (cursor < file.size()) {
+            int nibble = hexValue(key);
+            if (asciiPane && (key >= ' ') && (key < 0x7f)) {
+               file.set(cursor, key);
+               editedRow = (cursor - top) / rowBytes;
+               cursor++;
+            } else if (!asciiPane && (nibble >= 0)) {
+               unsigned char byte = file.at(cursor);
+               byte = lowNibble ? ((byte & 0xf0) | nibble) : ((nibble << 4) | (byte & 0x0f));
+               file.set(cursor, byte);
+               editedRow = (cursor - top) / rowBytes;
+               if (lowNibble) cursor++;
+               lowNibble = !lowNibble;
+            }
+            if (cursor >= file.size()) cursor = file.size() - 1;
+         }
+      } else {
+         int resultant = key - KEY_SPECIAL;
+         off_t page = (off_t)(rowBytes * pageRows);
+         lowNibble = false;
+
+         if (resultant == KEY_LEFT) {
+            if (cursor > 0) cursor--;
+         } else if (resultant == KEY_RIGHT) {
+            if (cursor + 1 < file.size()) cursor++;
+         } else if (resultant == KEY_UP) {
+            if (cursor >= (off_t)rowBytes) cursor -= rowBytes;
+         } else if (resultant == KEY_DOWN) {
+            if (cursor + (off_t)rowBytes < file.size()) cursor += rowBytes;
+         } else if (resultant == KEY_PGUP) {
+            cursor = (cursor >= page) ? cursor - page : cursor % rowBytes;
+            top = (top >= page) ? top - page : 0;
+            redraw = true;
+         } else if (resultant == KEY_PGDN) {
+            if (cursor + page < file.size()) {
+               cursor += page;
+               top += page;
+               redraw = true;
+            }
+         } else if (resultant == KEY_HOME) {
+            cursor -= cursor % rowBytes;
+         } else if (resultant == KEY_END) {
+            cursor = min(cursor - cursor % (off_t)rowBytes + (off_t)rowBytes, file.size()) - 1;
+            if (cursor < 0) cursor = 0;
+         } else if (resultant == KEY_F7) {
+            asciiPane = !asciiPane;
+         } else if (resultant == KEY_F2) {
+            // go to an offset (decimal, or hex after 0x)
+            string answer;
+            if (ui.prompt("Go to offset: ", answer) && !answer.empty()) {
+               bool hex = (answer.compare(0, 2, "0x") == 0);
+               off_t offset = strtoll(answer.c_str() + (hex ? 2 : 0), NULL, hex ? 16 : 10);
+               if ((offset >= 0) && (offset < file.size())) {
+                  cursor = offset;
+                  top = cursor - cursor % rowBytes;
+               }
+            }
+
+            // the prompt overlapped a row
+            redraw = true;
+         } else if (resultant == KEY_F3) {
+            // write the changes into the file
+            message = file.save() ? "Saved" : "Couldn't save";
+            redraw = true;
+         } else if (resultant == KEY_F8) {
+            // exit, making sure about changes that weren't saved
+            string answer;
+            if (!file.modified() || (ui.prompt("Changes not saved, exit anyway? (y/n) ", answer) && (answer == "y"))) {
+               rt.resetTerminal();
+               exit(0);
+            }
+            redraw = true;
+         }
+      }
+
+      // a page that scrolled is drawn in full, otherwise just an edited row
+      if (scrollToCursor() || redraw) {
+         drawPage();
+      } else if (editedRow >= 0) {
+         drawRow(editedRow);
+      }
+      drawFunctionLabels();
+      drawMessage();
+      placeCursor();
+   }
+}
+
+/**
+ * @function layout
+ * Fits as many bytes in a row as the screen allows (16, 8 or 4) and as many
+ * digits in the offsets as the size of the file needs.
+ */
+void layout() {
+   offsetDigits = 8;
+   for (off_t size = file.size() >> 32; size > 0; size >>= 4) offsetDigits++;
+
+   rowBytes = 16;
+   while ((rowBytes > 4) && (offsetDigits + 3 + 4 * rowBytes > rt.cols)) rowBytes /= 2;
+   pageRows = rt.lines - 1;
+}
+
+/**
+ * @function drawPage
+ * Draws every row of bytes on the screen.
+ * As a side effect, destroys cursor location.
+ */
+void drawPage() {
+   rt.hideCursor();
+   for (size_t row = 0; row < pageRows; row++) drawRow(row);
+   rt.showCursor();
+}
+
+/**
+ * @function drawRow
+ * Draws one row of bytes: the offset, the hex and the characters.  Bytes
+ * that were changed and not saved yet are shown in reverse.
+ * As a side effect, destroys cursor location.
+ * @param {size_t} row - the row of the screen
+ */
+void drawRow(const size_t row) {
+   off_t offset = top + (off_t)(row * rowBytes);
+   string bytes;
+   file.read(offset, rowBytes, bytes);
+
+   string line;
+   string text;
+   if (!bytes.empty()) {
+      line = hexNumber(offset, offsetDigits) + "  ";
+      for (size_t i = 0; i < rowBytes; i++) {
+         if (i >= bytes.length()) {
+            line += "   ";
+            continue;
+         }
+         unsigned char byte = bytes[i];
+         string shown = ((byte >= ' ') && (byte < 0x7f)) ? string(1, (char)byte) : ".";
+         if (file.changed(offset + i)) {
+            line += rt.getReverse() + hexNumber(byte, 2) + rt.getResetAttributes() + " ";
+            text += rt.getReverse() + shown + rt.getResetAttributes();
+         } else {
+            line += hexNumber(byte, 2) + " ";
+            text += shown;
+         }
+      }
+      line += " " + text;
+   }
+
+   rt.moveCursor(row, 0);
+   tout << line;
+   size_t width = bytes.empty() ? 0 : offsetDigits + 3 + 3 * rowBytes + bytes.length();
+   if (width < rt.cols) tout.spaces(rt.cols - width);
+}
+
+/**
+ * @function drawFunctionLabels
+ * Draws the labels, unless they'd come out the same as they are; F1's place
+ * says whether there are changes to save.
+ */
+void drawFunctionLabels() {
+   string state = file.readOnly() ? "ReadOnly" : (file.modified() ? "Modified" : "");
+   string labels = state + (asciiPane ? 'h' : 't');
+   if (labels == shownLabels) return;
+   shownLabels = labels;
+   rt.moveCursor(rt.lines - 1, 0);
+   tout.spaces(rt.cols / 8);
+   ui.drawFunctionLabels(state, "F2=Goto", "F3=Save", "", "", "", asciiPane ? "F7=Hex " : "F7=Text", "F8=Exit");
+}
+
+/**
+ * @function drawMessage
+ * Draws the message, if there is one, on the row above the function labels.
+ */
+void drawMessage() {
+   if (message.empty()) return;
+   rt.moveCursor(rt.lines - 2, 0);
+   tout << padRight(message, rt.cols);
+}
+
+/**
+ * @function placeCursor
+ * Puts the cursor on the byte it's at, in the hex or in the characters.
+ */
+void placeCursor() {
+   size_t row = (cursor - top) / rowBytes;
+   size_t column = (cursor - top) % rowBytes;
+   if (asciiPane) {
+      rt.moveCursor(row, offsetDigits + 3 + 3 * rowBytes + column);
+   } else {
+      rt.moveCursor(row, offsetDigits + 2 + 3 * column + (lowNibble ? 1 : 0));
+   }
+}
+
+/**
+ * @function scrollToCursor
+ * Moves the page so that the cursor is on it.
+ * @returns {bool} true if the page moved.
+ */
+bool scrollToCursor() {
+   off_t page = (off_t)(rowBytes * pageRows);
+   off_t shown = top;
+   if (cursor < top) top = cursor - cursor % rowBytes;
+   if (cursor >= top + page) top = cursor - cursor % rowBytes - page + rowBytes;
+   return top != shown;
+}
+
+/**
+ * @function hexNumber
+ * @param {unsigned long long} value - a number
+ * @param {size_t} digits - how many digits to show (with leading zeros)
+ * @returns {string} the number in hex.
+ */
+string hexNumber(unsigned long long value, const size_t digits) {
+   static const char* hexDigits = "0123456789abcdef";
+   string shown(digits, '0');
+   for (size_t i = digits; i-- > 0; value >>= 4) shown[i] = hexDigits[value & 0xf];
+   return shown;
+}
+
+/**
+ * @function hexValue
+ * @param {int} c - a character typed
+ * @returns {int} the hex digit it stands for, or -1.
+ */
+int hexValue(const int c) {
+   if ((c >= '0') && (c <= '9')) return c - '0';
+   if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+   if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+   return -1;
+}
@@ -0,0 +1,346 @@
+/*
+ * Program: microbench
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Microbenchmarks for the small helpers every key and every frame goes
+ *      through: processUnescapedSequence() with the terminfo strings for
+ *      cursor moves, scroll regions and line insertion, getch() and
+ *      resolveEscapeSequence() reading real keys off a pseudo terminal (so
+ *      the termios calls they make per read() are counted too), the function
+ *      labels drawn with the xterm profile, and the UTF-8 helpers on an
+ *      ASCII line and on a line with two, three and four byte characters.
+ *
+ *      Each benchmark runs in batches until its time is up, after one batch
+ *      to warm up.  Only the batches are timed: feeding keys into the pty,
+ *      say, is not.  operator new is replaced in this program to count the
+ *      allocations (and bytes) made inside the batches.  Output is tab
+ *      separated, one line per benchmark under a header, with ns/op,
+ *      allocs/op, bytes/op and how many ops were timed.  The "overhead" line
+ *      is what calling an empty op costs, which the others include.
+ *
+ *      Built with the same flags as text, so the numbers are the ones the
+ *      editor sees.  Everything drawn goes to /dev/null.
+ *
+ *      Usage: microbench [-d seconds per benchmark] [name prefix ...]
+ */
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "../../include/terminal/terminal.h"
+#include "../../include/terminal/tui.h"
+#include "../../include/terminal/keyboard.h"
+#include "../../include/misc/basic_utf8.h"
+
+using namespace std;
+
+// ops per timed batch
+#define BATCH_OPS 1000
+// bytes of keys fed per batch; the pty holds 4KB before the reader has to keep up
+#define FEED_BYTES 2048
+
+struct result {
+   string name;
+   size_t ops;
+   double seconds;
+   size_t allocations;
+   size_t bytes;
+};
+
+// counted by the operator new below
+atomic<size_t> allocations(0);
+atomic<size_t> allocatedBytes(0);
+
+double seconds = 0.25;
+vector<string> only;
+vector<result> results;
+vector<string> failures; // benchmarks that didn't do what they measure
+int keys = -1; // the pty master, keys written here come out of stdin
+volatile size_t sink; // keeps results from being thrown away
+
+// Function prototypes
+bool wanted(const string &name);
+void feed(const string &bytes);
+void keyboardBenchmarks();
+void sequenceBenchmarks();
+void labelBenchmarks();
+void utf8Benchmarks();
+void report();
+
+void* operator new(size_t size) {
+   allocations.fetch_add(1, memory_order_relaxed);
+   allocatedBytes.fetch_add(size, memory_order_relaxed);
+   void* p = malloc(size ? size : 1);
+   if (!p) throw bad_alloc();
+   return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+/**
+ * @function measure
+ * Runs a benchmark in timed batches until the time is up, and adds it to the
+ * results (unless it wasn't asked for).
+ * @param {const string&} name - what the benchmark is called
+ * @param {const size_t} batch - ops per batch
+ * @param {Prepare} prepare - called before each batch, not timed
+ * @param {Op} op - does one op, given its number
+ */
+template <typename Prepare, typename Op>
+void measure(const string &name, const size_t batch, Prepare prepare, Op op) {
+   if (!wanted(name)) return;
+   result r = { name, 0, 0, 0, 0 };
+
+   prepare();
+   for (size_t i = 0; i < batch; i++) op(i);
+
+   while (r.seconds < seconds) {
+      prepare();
+      size_t allocationsBefore = allocations.load();
+      size_t bytesBefore = allocatedBytes.load();
+      auto begun = chrono::steady_clock::now();
+      for (size_t i = 0; i < batch; i++) op(r.ops + i);
+      auto done = chrono::steady_clock::now();
+
+      r.allocations += allocations.load() - allocationsBefore;
+      r.bytes += allocatedBytes.load() - bytesBefore;
+      r.seconds += chrono::duration<double>(done - begun).count();
+      r.ops += batch;
+   }
+
+   results.push_back(r);
+}
+
+int main(int argc, char *argv[]) {
+   for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if ((arg == "-d") && (i + 1 < argc) && (atof(argv[i + 1]) > 0)) {
+         seconds = atof(argv[++i]);
+      } else if (arg[0] != '-') {
+         only.push_back(arg);
+      } else {
+         tout << "usage: microbench [-d seconds per benchmark] [name prefix ...]" << '\n';
+         return 1;
+      }
+   }
+
+   // the compiled in xterm profile, so runs compare across machines
+   setenv("TERM", "xterm", 1);
+
+   // keys come from a pty in raw mode, as they would from the terminal
+   int pty;
+   if (openpty(&keys, &pty, NULL, NULL, NULL) != 0) {
+      tout << "microbench: can't open a pseudo terminal" << '\n';
+      return 1;
+   }
+   struct termios raw;
+   tcgetattr(pty, &raw);
+   cfmakeraw(&raw);
+   tcsetattr(pty, TCSANOW, &raw);
+   int input = dup(STDIN_FILENO);
+   dup2(pty, STDIN_FILENO);
+
+   int output = dup(STDOUT_FILENO);
+   int devnull = open("/dev/null", O_WRONLY);
+   if (devnull < 0) {
+      tout << "microbench: can't open /dev/null" << '\n';
+      return 1;
+   }
+   dup2(devnull, STDOUT_FILENO);
+
+   measure("overhead", BATCH_OPS, []() {}, [](size_t i) { sink = i; });
+   keyboardBenchmarks();
+   sequenceBenchmarks();
+   labelBenchmarks();
+   utf8Benchmarks();
+
+   tout.flush();
+   dup2(output, STDOUT_FILENO);
+   dup2(input, STDIN_FILENO);
+   close(devnull);
+   close(output);
+   close(input);
+   close(pty);
+   close(keys);
+
+   report();
+   for (const string &failure : failures) tout << "microbench: " << failure << '\n';
+   tout.flush();
+   return failures.empty() ? 0 : 1;
+}
+
+/**
+ * @function wanted
+ * @param {const string&} name - the name of a benchmark
+ * @returns {bool} true if no names were given, or one of them starts this one.
+ */
+bool wanted(const string &name) {
+   if (only.empty()) return true;
+   for (const string &prefix : only) {
+      if (name.compare(0, prefix.length(), prefix) == 0) return true;
+   }
+   return false;
+}
+
+/**
+ * @function feed
+ * Types keys into the pty, and waits until all of them can be read.
+ * @param {const string&} bytes - the keys, as the terminal sends them
+ */
+void feed(const string &bytes) {
+   size_t written = 0;
+   while (written < bytes.length()) {
+      ssize_t n = write(keys, bytes.data() + written, bytes.length() - written);
+      if (n <= 0) break;
+      written += n;
+   }
+
+   int waiting = 0;
+   while ((ioctl(STDIN_FILENO, FIONREAD, &waiting) == 0) && ((size_t)waiting < written)) {
+      usleep(100);
+   }
+}
+
+/**
+ * @function keyboardBenchmarks
+ * getch() on plain keys, and resolveEscapeSequence() on the rest of the
+ * sequences an xterm sends (getKey() has read the escape already).
+ */
+void keyboardBenchmarks() {
+   const string typed(FEED_BYTES, 'a');
+   measure("getch", FEED_BYTES, [&]() { feed(typed); }, [](size_t) { sink = getch(); });
+
+   struct sequence { const char* name; const char* rest; int key; };
+   const sequence sequences[] = {
+      { "escape/up", "[A", KEY_UP },
+      { "escape/f1", "OP", KEY_F1 },
+      { "escape/home", "OH", KEY_HOME },
+      { "escape/f5", "[15~", KEY_F5 },
+      { "escape/shift-left", "[1;2D", KEY_SHIFT_LEFT }
+   };
+
+   for (const sequence &s : sequences) {
+      string rest = s.rest;
+      string fed;
+      while (fed.length() + rest.length() <= FEED_BYTES) fed += rest;
+      const int key = s.key;
+
+      size_t wrong = 0;
+      measure(s.name, fed.length() / rest.length(), [&]() { feed(fed); }, [&](size_t) {
+         if (resolveEscapeSequence() != key) wrong++;
+      });
+      if (wrong) failures.push_back(string(s.name) + " resolved to the wrong key " + to_string(wrong) + " times");
+   }
+}
+
+/**
+ * @function sequenceBenchmarks
+ * processUnescapedSequence() on xterm's terminfo strings (the profile the
+ * terminal was made with doesn't matter to it).
+ */
+void sequenceBenchmarks() {
+   terminal rt;
+   const string cup = "\x1B[%i%p1%d;%p2%dH";
+   const string csr = "\x1B[%i%p1%d;%p2%dr";
+   const string il = "\x1B[%p1%dL";
+
+   measure("sequence/cup", BATCH_OPS, []() {}, [&](size_t i) {
+      sink = rt.processUnescapedSequence(cup, i % 24, i % 80).length();
+   });
+   measure("sequence/csr", BATCH_OPS, []() {}, [&](size_t i) {
+      sink = rt.processUnescapedSequence(csr, 0, 22 - i % 8).length();
+   });
+   measure("sequence/il", BATCH_OPS, []() {}, [&](size_t i) {
+      sink = rt.processUnescapedSequence(il, 1 + i % 4, 0).length();
+   });
+}
+
+/**
+ * @function labelBenchmarks
+ * drawFunctionLabels() on an 80x24 xterm, with text's labels, both from an
+ * array and (as the editors call it) from eight strings.
+ */
+void labelBenchmarks() {
+   terminal rt;
+   rt.cols = 80;
+   rt.lines = 24;
+   tui ui(&rt);
+
+   const string labels[8] = { "F1=Macro", "F2=Load", "F3=Save", "F4=Paste", "F5=Copy", "F6=Cut", "F7=Select", "F8=Exit" };
+   measure("labels/array", BATCH_OPS, []() { tout.flush(); }, [&](size_t) {
+      ui.drawFunctionLabels(labels);
+   });
+   measure("labels/strings", BATCH_OPS, []() { tout.flush(); }, [&](size_t) {
+      ui.drawFunctionLabels(labels[0], "F2=Load", "F3=Save", "F4=Paste", "F5=Copy", "F6=Cut", "F7=Select", "F8=Exit");
+   });
+}
+
+/**
+ * @function utf8Benchmarks
+ * The UTF-8 helpers on a line of code and on a line of mixed text, 80
+ * characters each.
+ */
+void utf8Benchmarks() {
+   const string ascii = "   for (size_t i = 0; i < lines.size(); i++) total += lines[i].length(); // sum";
+   string mixed = "Grüße aus Köln, naïve café — 日本語のテキスト 😀 ";
+   while (length_utf8(mixed) < 80) mixed += mixed;
+   mixed = substr_utf8(mixed, 0, 80);
+
+   const string lines[2] = { ascii, mixed };
+   const char* kinds[2] = { "ascii", "mixed" };
+
+   for (int k = 0; k < 2; k++) {
+      const string &line = lines[k];
+      const string kind = kinds[k];
+
+      measure("utf8/length/" + kind, BATCH_OPS, []() {}, [&](size_t) {
+         sink = length_utf8(line);
+      });
+      measure("utf8/substr/" + kind, BATCH_OPS, []() {}, [&](size_t i) {
+         sink = substr_utf8(line, i % 40, 40).length();
+      });
+      measure("utf8/substr-rest/" + kind, BATCH_OPS, []() {}, [&](size_t i) {
+         sink = substr_utf8(line, i % 40).length();
+      });
+
+      // popped down from a line long enough for a whole batch
+      string popped;
+      measure("utf8/pop_back/" + kind, BATCH_OPS, [&]() {
+         popped.clear();
+         while (popped.length() < BATCH_OPS * 4) popped += line;
+         for (size_t extra = length_utf8(popped) - BATCH_OPS; extra > 0; extra--) pop_back_utf8(popped);
+      }, [&](size_t) {
+         pop_back_utf8(popped);
+      });
+   }
+}
+
+/**
+ * @function report
+ * Prints the results, tab separated under a header.
+ */
+void report() {
+   tout << "benchmark\tns/op\tallocs/op\tbytes/op\tops" << '\n';
+   for (const result &r : results) {
+      double ops = r.ops ? r.ops : 1;
+      tout << r.name << '\t' << toDecimal(r.seconds * 1e9 / ops, 1) << '\t'
+         << toDecimal(r.allocations / ops, 2) << '\t'
+         << toDecimal((double)r.bytes / ops, 1) << '\t' << to_string(r.ops) << '\n';
+   }
+}
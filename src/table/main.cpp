@@ -0,0 +1,418 @@
+/*
+ * Program: table
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      A grid editor for CSV and TSV files.  The first row stays at the top
+ *      as the header; fields are only split out of the rows on screen (see
+ *      csvfile.h), so a file of any size opens right away and can be paged
+ *      through while its rows are still being indexed.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+#include "../../include/terminal/terminal.h"
+#include "../../include/terminal/tui.h"
+#include "../../include/terminal/keyboard.h"
+#include "../../include/buffer/csvfile.h"
+
+using namespace std;
+
+terminal rt;
+tui ui(&rt);
+csvfile file;
+
+// how wide each column is shown, and whether it's right aligned; measured
+// from the rows drawn until the file has been measured as a whole
+vector<size_t> widths;
+vector<bool> numbers;
+bool measuredAll = false;
+
+// rows of the screen: the header, a rule, then rows of fields up to the
+// status row and the function labels
+#define FIRST_ROW 2
+size_t pageRows;
+
+// how many rows had been indexed when the page was last drawn
+size_t drawnRows = 0;
+
+// the first row and column on screen (rows as shown, below the header),
+// the cell the cursor is on, and the column the rows were last sorted by
+size_t topRow = 1;
+size_t leftColumn = 0;
+size_t cursorRow = 1;
+size_t cursorColumn = 0;
+size_t sortedColumn = (size_t)-1;
+bool sortedReverse = false;
+
+// what the status row says until the next key
+string message;
+
+// Function prototypes
+void layout();
+size_t lastColumn();
+void measure(const vector<string> &cells);
+void drawPage();
+void drawRow(const size_t row);
+void drawStatus();
+void drawFunctionLabels();
+void placeCursor();
+bool scrollToCursor();
+string cell(const string &text, const size_t column);
+
+int main(int argc, char *argv[]) {
+   if (argc != 2) {
+      tout << "usage: table file.csv" << '\n';
+      return 1;
+   }
+   if (!file.open(argv[1])) {
+      tout << "table: can't open " << argv[1] << '\n';
+      return 1;
+   }
+
+   rt.clear();
+   layout();
+   drawFunctionLabels();
+   drawPage();
+   drawStatus();
+   placeCursor();
+
+   while (true) {
+      // the file wakes us up as rows are indexed, and once it's measured
+      if (waitForInput(file.wakeFd(), -1) == WAIT_OTHER) {
+         file.drain();
+         if (!measuredAll && file.measured()) {
+            // lay the columns out for the whole file from now on
+            measuredAll = true;
+            vector<csvcolumn> columns = file.columns();
+            widths.assign(columns.size(), 1);
+            numbers.assign(columns.size(), false);
+            for (size_t c = 0; c < columns.size(); c++) {
+               widths[c] = max(columns[c].width, (size_t)1);
+               numbers[c] = columns[c].numeric;
+            }
+            scrollToCursor();
+            drawPage();
+         } else if ((drawnRows < topRow + pageRows) && (file.rows() != drawnRows)) {
+            // rows that were blank have been indexed
+            drawPage();
+         }
+         drawStatus();
+         placeCursor();
+         continue;
+      }
+
+      int key = getKey();
+      if (key == KEY_SPECIAL + KEY_HANGUP) {
+         // the terminal went away, and there's no one left to ask about changes
+         rt.resetTerminal();
+         exit(1);
+      }
+      size_t previousRow = cursorRow;
+      bool redraw = false;
+      message.clear();
+
+      if ((key == 10) || (key == 13) || (key == KEY_SPECIAL + KEY_F2)) {
+         // edit the cell under the cursor
+         if (cursorRow < file.rows()) {
+            string value = file.field(cursorRow, cursorColumn);
+            if (ui.prompt("Edit: ", value)) {
+               file.set(cursorRow, cursorColumn, value);
+               if (widths.size() <= cursorColumn) {
+                  widths.resize(cursorColumn + 1, 1);
+                  numbers.resize(cursorColumn + 1, false);
+               }
+               widths[cursorColumn] = max(widths[cursorColumn], min(value.length(), (size_t)CSVFILE_MAX_WIDTH));
+            }
+            redraw = true;
+         }
+      } else if (key == '\t') {
+         if (cursorColumn + 1 < widths.size()) cursorColumn++;
+      } else if (key >= KEY_SPECIAL) {
+         int resultant = key - KEY_SPECIAL;
+         size_t rows = file.rows();
+
+         if (resultant == KEY_UP) {
+            if (cursorRow > 0) cursorRow--;
+         } else if (resultant == KEY_DOWN) {
+            if (cursorRow + 1 < rows) cursorRow++;
+         } else if (resultant == KEY_LEFT) {
+            if (cursorColumn > 0) cursorColumn--;
+         } else if (resultant == KEY_RIGHT) {
+            if (cursorColumn + 1 < widths.size()) cursorColumn++;
+         } else if (resultant == KEY_PGUP) {
+            cursorRow = (cursorRow > pageRows) ? cursorRow - pageRows : 0;
+            topRow = (topRow > pageRows + 1) ? topRow - pageRows : 1;
+            redraw = true;
+         } else if (resultant == KEY_PGDN) {
+            if (cursorRow + pageRows < rows) {
+               cursorRow += pageRows;
+               topRow += pageRows;
+            } else if (rows > 0) {
+               cursorRow = rows - 1;
+            }
+            redraw = true;
+         } else if (resultant == KEY_HOME) {
+            cursorColumn = 0;
+         } else if (resultant == KEY_END) {
+            cursorColumn = widths.empty() ? 0 : widths.size() - 1;
+         } else if (resultant == KEY_F1) {
+            // find text in this column, below the cursor
+            string text;
+            if (ui.prompt("Find in column: ", text) && !text.empty()) {
+               if (!file.indexed()) {
+                  message = "Indexing...";
+                  drawStatus();
+               }
+               size_t found;
+               if (file.find(cursorColumn, text, cursorRow, found)) {
+                  cursorRow = found;
+               } else {
+                  message = "Not found";
+               }
+            }
+            redraw = true;
+         } else if (resultant == KEY_F3) {
+            // write the rows out as they're shown
+            message = "Saving...";
+            drawStatus();
+            if (file.save()) message = "Saved";
+            else message = file.truncated() ? "Couldn't save: the file was cut short on disk" : "Couldn't save";
+            measuredAll = false;
+            sortedColumn = (size_t)-1;
+            redraw = true;
+         } else if (resultant == KEY_F4) {
+            // sort by this column, the other way round if it's sorted by it already
+            sortedReverse = (sortedColumn == cursorColumn) && !sortedReverse;
+            sortedColumn = cursorColumn;
+            message = file.indexed() ? "Sorting..." : "Indexing...";
+            drawStatus();
+            file.sort(cursorColumn, sortedReverse);
+            message = sortedReverse ? "Sorted, largest first" : "Sorted";
+            redraw = true;
+         } else if (resultant == KEY_F5) {
+            // add up this column
+            if (!file.indexed()) {
+               message = "Indexing...";
+               drawStatus();
+            }
+            double total;
+            size_t count;
+            if (file.sum(cursorColumn, total, count)) {
+               char shown[64];
+               snprintf(shown, sizeof(shown), "Sum %.15g of %zu numbers", total, count);
+               message = shown;
+            } else {
+               message = "No numbers in this column";
+            }
+         } else if (resultant == KEY_F8) {
+            // exit, making sure about changes that weren't saved
+            string answer;
+            if (!file.modified() || (ui.prompt("Changes not saved, exit anyway? (y/n) ", answer) && (answer == "y"))) {
+               rt.resetTerminal();
+               exit(0);
+            }
+            redraw = true;
+         }
+      }
+
+      // a page that scrolled is drawn in full, otherwise just the rows the cursor left and went to
+      if (scrollToCursor() || redraw) {
+         drawPage();
+      } else {
+         drawRow(previousRow);
+         drawRow(cursorRow);
+      }
+      drawStatus();
+      drawFunctionLabels();
+      placeCursor();
+   }
+}
+
+/**
+ * @function layout
+ * Works out how many rows of fields fit on the screen.
+ */
+void layout() {
+   pageRows = (rt.lines > FIRST_ROW + 2) ? rt.lines - FIRST_ROW - 2 : 1;
+}
+
+/**
+ * @function lastColumn
+ * @returns {size_t} the column after the last one that fits on the screen from leftColumn.
+ */
+size_t lastColumn() {
+   size_t used = 0;
+   size_t column = leftColumn;
+   while (true) {
+      size_t width = (column < widths.size()) ? widths[column] : 1;
+      if ((used > 0) && (used + width > rt.cols)) break;
+      used += width + 1;
+      column++;
+      if (used >= rt.cols) break;
+   }
+   return column;
+}
+
+/**
+ * @function measure
+ * Widens the columns to fit the fields of a row drawn, until the whole file
+ * has been measured.
+ * @param {const vector<string>&} cells - the fields of the row
+ */
+void measure(const vector<string> &cells) {
+   if (measuredAll) return;
+   if (widths.size() < cells.size()) {
+      widths.resize(cells.size(), 1);
+      numbers.resize(cells.size(), false);
+   }
+   for (size_t c = 0; c < cells.size(); c++) {
+      widths[c] = max(widths[c], min(cells[c].length(), (size_t)CSVFILE_MAX_WIDTH));
+   }
+}
+
+/**
+ * @function drawPage
+ * Draws the header, the rule under it and every row of fields on the screen.
+ * The columns are measured first, so the rows all line up.
+ * As a side effect, destroys cursor location.
+ */
+void drawPage() {
+   drawnRows = file.rows();
+   if (!measuredAll) {
+      vector<string> cells;
+      for (size_t row = 0; row < FIRST_ROW - 1 + pageRows; row++) {
+         size_t shown = (row == 0) ? 0 : topRow + row - 1;
+         if (shown >= file.rows()) break;
+         file.fields(shown, (size_t)-1, cells);
+         measure(cells);
+      }
+      scrollToCursor();
+   }
+
+   rt.hideCursor();
+   drawRow(0);
+   rt.moveCursor(1, 0);
+   tout << string(rt.cols, '-');
+   for (size_t row = 0; row < pageRows; row++) drawRow(topRow + row);
+   rt.showCursor();
+}
+
+/**
+ * @function drawRow
+ * Draws one row (as shown) where it is on the screen, if it is.  The cell
+ * under the cursor is shown in reverse.
+ * As a side effect, destroys cursor location.
+ * @param {size_t} row - the row as shown (0 is the header)
+ */
+void drawRow(const size_t row) {
+   size_t line;
+   if (row == 0) {
+      line = 0;
+   } else if ((row >= topRow) && (row < topRow + pageRows)) {
+      line = FIRST_ROW + row - topRow;
+   } else {
+      return;
+   }
+
+   string text;
+   size_t used = 0;
+   if (row < file.rows()) {
+      size_t last = lastColumn();
+      vector<string> cells;
+      file.fields(row, last, cells);
+      for (size_t column = leftColumn; (column < last) && (used < rt.cols); column++) {
+         string shown = cell((column < cells.size()) ? cells[column] : string(), column);
+         if (used + shown.length() > rt.cols) shown.resize(rt.cols - used);
+         if ((row == cursorRow) && (column == cursorColumn)) {
+            text += rt.getReverse() + shown + rt.getResetAttributes();
+         } else {
+            text += shown;
+         }
+         used += shown.length();
+         if (used < rt.cols) {
+            text += ' ';
+            used++;
+         }
+      }
+   }
+
+   rt.moveCursor(line, 0);
+   tout << text;
+   if (used < rt.cols) tout.spaces(rt.cols - used);
+}
+
+/**
+ * @function drawStatus
+ * Draws the row above the function labels: where the cursor is, and the
+ * message if there is one.
+ */
+void drawStatus() {
+   string status = "Row " + to_string(cursorRow) + " of " + to_string(file.rows() ? file.rows() - 1 : 0);
+   if (!file.indexed()) status += "+";
+   status += ", column " + to_string(cursorColumn + 1);
+   if (!message.empty()) status += "  " + message;
+   rt.moveCursor(rt.lines - 2, 0);
+   if (status.length() > rt.cols) status.resize(rt.cols);
+   tout << padRight(status, rt.cols);
+}
+
+/**
+ * @function drawFunctionLabels
+ * Draws the labels.
+ */
+void drawFunctionLabels() {
+   rt.moveCursor(rt.lines - 1, 0);
+   ui.drawFunctionLabels("F1=Find", "F2=Edit", "F3=Save", "F4=Sort", "F5=Sum", "", "", "F8=Exit");
+}
+
+/**
+ * @function placeCursor
+ * Puts the cursor at the start of the cell it's on.
+ */
+void placeCursor() {
+   size_t line = (cursorRow == 0) ? 0 : FIRST_ROW + cursorRow - topRow;
+   size_t at = 0;
+   for (size_t column = leftColumn; column < cursorColumn; column++) {
+      at += ((column < widths.size()) ? widths[column] : 1) + 1;
+   }
+   rt.moveCursor(line, min(at, rt.cols - 1));
+}
+
+/**
+ * @function scrollToCursor
+ * Moves the page (down and across) so that the cursor is on it.
+ * @returns {bool} true if the page moved.
+ */
+bool scrollToCursor() {
+   size_t shownRow = topRow;
+   size_t shownColumn = leftColumn;
+   if ((cursorRow > 0) && (cursorRow < topRow)) topRow = cursorRow;
+   if (cursorRow >= topRow + pageRows) topRow = cursorRow - pageRows + 1;
+   if (cursorColumn < leftColumn) leftColumn = cursorColumn;
+   while ((leftColumn < cursorColumn) && (cursorColumn >= lastColumn())) leftColumn++;
+   return (topRow != shownRow) || (leftColumn != shownColumn);
+}
+
+/**
+ * @function cell
+ * @param {const string&} text - a field
+ * @param {const size_t} column - its column
+ * @returns {string} the field fitted to the width of the column (numbers on the right), with control characters as dots.
+ */
+string cell(const string &text, const size_t column) {
+   size_t width = (column < widths.size()) ? widths[column] : 1;
+   string shown = text.substr(0, width);
+   for (char &c : shown) if ((unsigned char)c < ' ') c = '.';
+   if (shown.length() < width) {
+      bool right = (column < numbers.size()) && numbers[column];
+      shown.insert(right ? 0 : shown.length(), width - shown.length(), ' ');
+   }
+   return shown;
+}
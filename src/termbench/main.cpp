@@ -0,0 +1,257 @@
+/*
+ * Program: termbench
+ * Project: reneeverly/trivial-retro-style-editors
+ * License: Apache 2.0
+ * Author: Renee Waverly Sonntag
+ *
+ * Description:
+ *
+ *      Rendering benchmark for the terminal and tui classes.  Draws the same
+ *      kinds of frames the editors do (full screen repaints, single rows,
+ *      scrolling inside the scroll region, function labels and lots of
+ *      cursor moves) as fast as it can for a fixed time each, and reports
+ *      frames per second, bytes per frame, and how the time per frame splits
+ *      between building the frame and write()ing it.
+ *
+ *      Every scenario is run with the compiled in profile for $TERM and again
+ *      with the terminfo sequences, where building the frame is mostly
+ *      processUnescapedSequence().  All of that is done once on the terminal
+ *      and once more with stdout pointed at /dev/null, which leaves only the
+ *      cost of the program itself.  Comparing the two says how much the
+ *      terminal emulator (or serial link) is holding things up.
+ *
+ *      Usage: termbench [-d seconds per run]
+ *
+ *      Built with -DMINIMAL_RUNTIME and a writer buffer big enough that a
+ *      frame always goes out in one write.
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../../include/terminal/terminal.h"
+#include "../../include/terminal/tui.h"
+
+using namespace std;
+
+// moves (and characters) per cursor storm frame
+#define STORM_MOVES 256
+
+struct result {
+   string scenario;
+   string backend;
+   string output;
+   size_t frames;
+   size_t bytes;
+   double seconds;
+   double formatSeconds;
+   double writeSeconds;
+};
+
+// Function prototypes
+result run(terminal &rt, const string &scenario, const double seconds);
+vector<string> frameText(const terminal &rt, const string &scenario, const size_t frame);
+void drawFrame(terminal &rt, tui &ui, const string &scenario, const size_t frame, const vector<string> &text);
+string rowText(const size_t width, const size_t seed);
+void report(const vector<result> &results, const size_t cols, const size_t lines);
+
+int main(int argc, char *argv[]) {
+   double seconds = 1;
+
+   for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if ((arg == "-d") && (i + 1 < argc) && (atof(argv[i + 1]) > 0)) {
+         seconds = atof(argv[++i]);
+      } else {
+         tout << "usage: termbench [-d seconds per run]" << '\n';
+         return 1;
+      }
+   }
+
+   if (!isatty(STDOUT_FILENO)) {
+      tout << "termbench: stdout has to be a terminal (the /dev/null runs are done as well)" << '\n';
+      return 1;
+   }
+
+   // the same frames go to both outputs, so both use the terminal's size
+   terminal profiled(true);
+   terminal terminfo(false);
+   terminfo.cols = profiled.cols;
+   terminfo.lines = profiled.lines;
+
+   const string scenarios[] = { "full", "row", "scroll", "labels", "cursor" };
+   vector<result> results;
+
+   int tty = dup(STDOUT_FILENO);
+   int devnull = open("/dev/null", O_WRONLY);
+   if (devnull < 0) {
+      tout << "termbench: can't open /dev/null" << '\n';
+      return 1;
+   }
+
+   for (int pass = 0; pass < 2; pass++) {
+      dup2((pass == 0) ? tty : devnull, STDOUT_FILENO);
+      for (const string &scenario : scenarios) {
+         result r = run(profiled, scenario, seconds);
+         r.backend = "profile";
+         r.output = (pass == 0) ? "tty" : "/dev/null";
+         results.push_back(r);
+
+         r = run(terminfo, scenario, seconds);
+         r.backend = "terminfo";
+         r.output = (pass == 0) ? "tty" : "/dev/null";
+         results.push_back(r);
+      }
+   }
+
+   dup2(tty, STDOUT_FILENO);
+   close(devnull);
+   close(tty);
+
+   profiled.resetTerminal();
+   report(results, profiled.cols, profiled.lines);
+   tout.flush();
+   return 0;
+}
+
+/**
+ * @function run
+ * Draws frames of one scenario until the time is up.
+ * @param {terminal&} rt - the terminal (and so the control sequences) to use
+ * @param {const string&} scenario - which frames to draw
+ * @param {const double} seconds - how long to keep drawing
+ * @returns {result} what was measured.
+ */
+result run(terminal &rt, const string &scenario, const double seconds) {
+   tui ui(&rt);
+   result r = { scenario, "", "", 0, 0, 0, 0, 0 };
+
+   rt.clear();
+   if (scenario == "scroll") ui.scrollSpecial();
+   tout.flush();
+
+   size_t bytesBefore = tout.count;
+   auto started = chrono::steady_clock::now();
+
+   while (r.seconds < seconds) {
+      // the text is made up front, so formatting is only the drawing
+      vector<string> text = frameText(rt, scenario, r.frames);
+      auto begun = chrono::steady_clock::now();
+      drawFrame(rt, ui, scenario, r.frames, text);
+      auto built = chrono::steady_clock::now();
+      tout.flush();
+      auto written = chrono::steady_clock::now();
+
+      r.formatSeconds += chrono::duration<double>(built - begun).count();
+      r.writeSeconds += chrono::duration<double>(written - built).count();
+      r.seconds = chrono::duration<double>(written - started).count();
+      r.frames++;
+   }
+
+   r.bytes = tout.count - bytesBefore;
+
+   if (scenario == "scroll") ui.scrollDefault();
+   tout.flush();
+   return r;
+}
+
+/**
+ * @function frameText
+ * @param {const terminal&} rt - the terminal
+ * @param {const string&} scenario - which frame it's for
+ * @param {const size_t} frame - the number of the frame, so they differ
+ * @returns {vector<string>} the rows (or label) a frame of the scenario shows.
+ */
+vector<string> frameText(const terminal &rt, const string &scenario, const size_t frame) {
+   vector<string> text;
+   if (scenario == "full") {
+      for (size_t line = 0; line + 1 < rt.lines; line++) text.push_back(rowText(rt.cols, frame + line));
+   } else if (scenario == "row") {
+      text.push_back(rowText(rt.cols, frame));
+   } else if (scenario == "scroll") {
+      text.push_back(rowText(rt.cols - 1, frame));
+   } else if (scenario == "labels") {
+      text.push_back(to_string(frame % 1000));
+   }
+   return text;
+}
+
+/**
+ * @function drawFrame
+ * Writes one frame of a scenario into tout (without flushing it).
+ * @param {terminal&} rt - the terminal
+ * @param {tui&} ui - the tui wrapped around it
+ * @param {const string&} scenario - which frame to draw
+ * @param {const size_t} frame - the number of the frame, so they differ
+ * @param {const vector<string>&} text - what frameText() made for it
+ */
+void drawFrame(terminal &rt, tui &ui, const string &scenario, const size_t frame, const vector<string> &text) {
+   size_t textLines = rt.lines - 1;
+
+   if (scenario == "full") {
+      // what updateDisplay() does: every line of text, padded out
+      for (size_t line = 0; line < textLines; line++) {
+         rt.moveCursor(line, 0);
+         tout << text[line];
+      }
+   } else if (scenario == "row") {
+      // one line changes, as when typing
+      rt.moveCursor(frame % textLines, 0);
+      tout << text[0];
+   } else if (scenario == "scroll") {
+      // a new line comes in at the bottom of the scroll region
+      ui.moveCursorToBottom();
+      tout << '\n' << text[0];
+   } else if (scenario == "labels") {
+      ui.drawFunctionLabels("F1", "F2=Load", "F3=Save", "F4=Paste", "F5=Copy", "F6=Cut", "F7=Select", text[0]);
+   } else if (scenario == "cursor") {
+      // a small LCG, so every run moves to the same places
+      size_t seed = frame * 2654435761u + 1;
+      for (size_t i = 0; i < STORM_MOVES; i++) {
+         seed = seed * 6364136223846793005u + 1442695040888963407u;
+         rt.moveCursor((seed >> 33) % textLines, (seed >> 17) % rt.cols);
+         tout << (char)('a' + (seed >> 40) % 26);
+      }
+   }
+}
+
+/**
+ * @function rowText
+ * @param {const size_t} width - how long the row is
+ * @param {const size_t} seed - which letter to start the row with
+ * @returns {string} a row of letters, different for each seed.
+ */
+string rowText(const size_t width, const size_t seed) {
+   string text(width, ' ');
+   for (size_t i = 0; i < width; i++) {
+      if ((i + seed) % 7 != 0) text[i] = 'a' + ((i + seed) % 26);
+   }
+   return text;
+}
+
+/**
+ * @function report
+ * Prints a table of the results.
+ * @param {const vector<result>&} results - every run, in order
+ * @param {const size_t} cols - the width of the terminal
+ * @param {const size_t} lines - the height of the terminal
+ */
+void report(const vector<result> &results, const size_t cols, const size_t lines) {
+   tout << "terminal rendering on a " << cols << "x" << lines << " screen (times in us per frame)" << '\n';
+   tout << padRight("scenario", 10) << padRight("backend", 10) << padRight("output", 11)
+      << padRight("frames/s", 12) << padRight("bytes/frame", 13)
+      << padRight("format", 10) << padRight("write", 10) << '\n';
+
+   for (const result &r : results) {
+      double frames = r.frames ? r.frames : 1;
+      tout << padRight(r.scenario, 10) << padRight(r.backend, 10) << padRight(r.output, 11)
+         << padRight(toDecimal(r.frames / r.seconds, 0), 12)
+         << padRight(toDecimal(r.bytes / frames, 0), 13)
+         << padRight(toDecimal(r.formatSeconds * 1e6 / frames, 2), 10)
+         << padRight(toDecimal(r.writeSeconds * 1e6 / frames, 2), 10) << '\n';
+   }
+}
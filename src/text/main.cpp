@@ -10,270 +10,929 @@
  */
 
 #include <string>
+#include <cstdlib>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "../../include/terminal/terminal.h"
 #include "../../include/terminal/tui.h"
 #include "../../include/terminal/keyboard.h"
+#include "../../include/terminal/macro.h"
+#include "../../include/buffer/document.h"
+#include "../../include/buffer/clipboard.h"
+#include "../../include/buffer/buffers.h"
+#include "../../include/buffer/journal.h"
+#include "../../include/buffer/tidy.h"
+#include "../../include/buffer/linering.h"
+#include "../../include/buffer/follower.h"
+#include "../../include/misc/perf.h"
 
 // ifnore utf8 for now :(
 //#include "../../include/misc/basic_utf8.h"
 
 // basics
 #include <vector>
-#include <sstream>
-
-// file io
-#include <fstream>
 
 using namespace std;
 
 // flags for the file edit / screen update loop
 #define UPDATE_NONE 0
 #define UPDATE_ALL 1
-#define UPDATE_LINE 2 // unimplemented
-#define UPDATE_SUBLINE 3
+#define UPDATE_LINE 2 // just what the last edit damaged
 
 #define SUGGEST_NONE 4
 
+// ctrl+t asks for a command to sort, dedupe or filter lines with (see tidy.h)
+#define KEY_TIDY 0x14
+
+// how long the keyboard has to be quiet before the journal is synced,
+// and the longest the journal is allowed to go without a sync
+#define JOURNAL_IDLE_MS 1000
+#define JOURNAL_MAX_MS 10000
+// sessions running in one directory at a time, each with a journal of its own
+#define JOURNAL_SESSIONS 16
+
+// how many lines the pager keeps by default
+#define PAGER_LINES 10000
+
+// with $TEXT_COMPRESS, lines this far from the screen and the cursor get
+// compressed once the keyboard goes quiet, a pass of at most COLD_PASS_MS at
+// a time (or COLD_LOAD_MS, to keep up with a file loading)
+#define COLD_MARGIN 2048
+#define COLD_PASS_MS 5
+#define COLD_LOAD_MS 50
+
+// frames are written on a thread of their own, and drawn at most
+// $TEXT_FPS times a second ($TEXT_FPS=0 draws every one on the spot, on
+// this thread); a frame waiting for the thread to catch up checks back
+// every FRAME_RETRY_MS
+#define FRAME_RATE 60
+#define FRAME_RETRY_MS 5
+
 terminal rt;
 tui ui(&rt);
+journal edits;
+perfmeter perf;
+macro recorder;
+
+// while a macro is being replayed, keys are applied without drawing anything
+// (the screen is drawn once at the end)
+bool headless = false;
+
+bufferlist buffers;
+clipboard clip;
+
+// rows of the screen used for text (the HUD takes one away)
+size_t textLines;
+
+// the selection that should be on screen, and the one that currently is
+textpos selectionStart = {0, 0};
+textpos selectionEnd = {0, 0};
+textpos shownSelectionStart = {0, 0};
+textpos shownSelectionEnd = {0, 0};
+
+// what the last edit changed, for UPDATE_LINE: the text from damageFrom to
+// the end of line damageTo, and how many screen rows the lines after that
+// moved down (negative for up)
+textpos damageFrom = {0, 0};
+size_t damageTo = 0;
+int damageShift = 0;
+
+// keys that came in since the last frame was drawn: what they need updated,
+// whether there's damage not drawn yet, and whether all of it could be kept
+// as one damage (otherwise the frame is drawn in full)
+bool framePending = false;
+int pendingUpdate = UPDATE_NONE;
+bool damagePending = false;
+bool damageCombined = true;
+
+// when the last frame was drawn, and how long the next one has to wait
+chrono::steady_clock::time_point lastFrame;
+chrono::microseconds frameInterval(0);
+
+// whether to compress lines far from the screen, and whether there may be
+// some to compress (and if the last pass ran out of time)
+bool coldStorage = false;
+bool coldPending = false;
+bool coldMore = false;
+
+// syntax highlighting, unless the terminal can't or $NO_COLOR says not to
+bool useColor = false;
+const int syntaxColors[SYNTAX_CLASSES] = {
+   COLOR_DEFAULT, // SYNTAX_NORMAL
+   COLOR_CYAN,    // SYNTAX_COMMENT
+   COLOR_GREEN,   // SYNTAX_STRING
+   COLOR_YELLOW,  // SYNTAX_KEYWORD
+   COLOR_MAGENTA, // SYNTAX_NUMBER
+   COLOR_RED,     // SYNTAX_PREPROCESSOR
+   COLOR_BLUE     // SYNTAX_VARIABLE
+};
 
 // Function prototypes
+int handleKey(const int key);
+int refresh(int updateType);
+void setTextLines(const size_t lines);
 void drawFunctionLabels();
-void updateDisplay(const size_t &startLine, const size_t &startCursor, const vector<string> &file);
-void updateLine(const size_t &screen_lines_from_top, const size_t &virtualCursorLine, const size_t &virtualCursorChar, vector<string> &file);
+void drawProgress();
+void collectLoaded();
+bool openJournal();
+void hangUp();
+bool compressCold(const int budget);
+size_t replayMacro(const size_t times);
+string macroLabel();
+void requestFrame(const int updateType);
+int frameWait();
+int drawFrame();
+void drawHud();
+void updateDisplay(const size_t &startLine, const size_t &startCursor, const document &file);
+void updateDamage(const size_t &startLine, const document &file, const size_t &recolorTo);
+void updateRows(const size_t &startLine, const size_t &startCursor, const document &file, const size_t &firstRow, const size_t &firstCol, const size_t &endRow);
+void markDamage(const size_t &line, const size_t &chr, const size_t &lastLine, const int &shift);
+size_t screenRows(const size_t &length);
+void updateSelection(const size_t &startLine, const size_t &startCursor, const document &file);
+void printRow(const document &file, const size_t &line, const size_t &offset, const size_t &col);
+void printSpan(const string &text, const size_t &line, const size_t &begin, const size_t &end);
+void printColored(const string &text, const size_t &line, const size_t &begin, const size_t &end);
+bool spanOnLine(const textpos &from, const textpos &to, const size_t &line, const size_t &length, size_t &begin, size_t &end);
+int page(follower &source, const size_t capacity);
+size_t pageTop(const linering &ring);
+void pageRows(const linering &ring, const size_t &top, const size_t &firstRow, const size_t &endRow);
+void pageLabels(const bool following, const bool ended);
+
+int main(int argc, char *argv[]) {
+   // text [-n lines] -f file follows a file, and text [-n lines] - (or with
+   // stdin not a terminal) pages through stdin; both are read only
+   string followPath;
+   bool pager = !isatty(STDIN_FILENO);
+   size_t capacity = PAGER_LINES;
+   for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if ((arg == "-f") && (i + 1 < argc)) {
+         followPath = argv[++i];
+         pager = true;
+      } else if ((arg == "-n") && (i + 1 < argc) && (atol(argv[i + 1]) > 0)) {
+         capacity = atol(argv[++i]);
+      } else if (arg == "-") {
+         pager = true;
+      } else {
+         tout << "usage: text [-n lines] [-f file | -]" << '\n';
+         return 1;
+      }
+   }
+
+   if (pager) {
+      follower source;
+      if (!followPath.empty()) {
+         if (!source.open(followPath)) {
+            tout << "text: can't open " << followPath << '\n';
+            return 1;
+         }
+      } else {
+         // the stream keeps its own descriptor; keys come from the terminal
+         int tty = open("/dev/tty", O_RDONLY);
+         if (tty < 0) {
+            tout << "text: no terminal to read keys from" << '\n';
+            return 1;
+         }
+         source.attach(dup(STDIN_FILENO));
+         dup2(tty, STDIN_FILENO);
+         close(tty);
+      }
+      return page(source, capacity);
+   }
 
-int main(void) {
    rt.clear();
    rt.moveCursor(rt.lines - 1, 0);
    drawFunctionLabels();
    rt.moveCursor(0, 0);
+   setTextLines(rt.lines - 1);
+   useColor = rt.hasColors() && !getenv("NO_COLOR");
+
+   // $TEXT_TRACE names a file to log the timing of every keystroke to
+   const char* tracePath = getenv("TEXT_TRACE");
+   if (tracePath && *tracePath) perf.openTrace(tracePath);
+
+   const char* compress = getenv("TEXT_COMPRESS");
+   coldStorage = compress && *compress;
+
+   const char* fps = getenv("TEXT_FPS");
+   int frameRate = (fps && *fps) ? atoi(fps) : FRAME_RATE;
+   if ((frameRate > 0) && tout.background()) frameInterval = chrono::microseconds(1000000 / frameRate);
+
+   // $TEXT_INDEX names a directory to keep indexes of big files in, so they open again right away
+   const char* indexDir = getenv("TEXT_INDEX");
+   if (indexDir && *indexDir) buffers.keepIndexes(indexDir, rt.cols);
 
-   vector<string> file;
+   buffers.add("");
 
-   file.emplace(file.begin(), "");
+   // a hangup (or SIGHUP, SIGTERM) writes out the journal before exiting
+   catchHangup();
 
-   size_t startLine = 0;
-   size_t startCursor = 0; // for use when line length exceeds terminal width, will be a multiple of the screen width
-   size_t virtualCursorLine = 0;
-   size_t virtualCursorChar = 0;
+   // recover whatever a crashed session left behind ($TEXT_JOURNAL="" turns this off)
+   const char* journalPath = getenv("TEXT_JOURNAL");
+   bool journaling = journalPath ? (*journalPath && edits.open(journalPath)) : openJournal();
+   if (journaling && (edits.replay(buffers, clip) > 0)) {
+      refresh(UPDATE_ALL);
+   }
 
-   int updateType;
+   // edits to files changed since are left out rather than applied to the
+   // wrong lines; say so before anything else happens
+   if (!edits.changedFiles().empty()) {
+      string label = "Changed since, edits not recovered:", answer;
+      for (const string &name : edits.changedFiles()) label += " " + name;
+      if (label.length() + 12 > rt.cols) label = label.substr(0, rt.cols - 15) + "...";
+      ui.prompt(label + " (Enter) ", answer);
+      refresh(UPDATE_ALL);
+   }
 
    // File editing loop
-   int c;
    while(true) {
-      c = getch();
-      
-      // by default, assume the whole screen has to be updated
-      updateType = UPDATE_ALL;
+      // wait for a key, taking in lines loaded in the background meanwhile,
+      // and write the journal out (and compress what's far away) once the
+      // keyboard goes quiet
+      while (true) {
+         int idle = edits.dirty() ? JOURNAL_IDLE_MS : -1;
+         if (coldPending) idle = coldMore ? 0 : JOURNAL_IDLE_MS;
 
-      if (c && c != LITERAL_KEY_ESCAPE) {
-         if ((c == 0x08) || (c == 0x7f)) {
-            // backspace key
-
-            if ((virtualCursorChar == 0) && (virtualCursorLine == 0)) {
-               // at the start of the very first line, do nothing
-               updateType = UPDATE_NONE;
-            } else if ((virtualCursorChar == 0) && (virtualCursorLine != 0)) {
-               // at start of a line which is not the first line, append this line to the previous line
-               virtualCursorChar = file.at(virtualCursorLine - 1).length(); // special case to get preceeding line length
-               file.at(virtualCursorLine - 1).append(file.at(virtualCursorLine));
-               file.erase(file.begin() + virtualCursorLine);
-               virtualCursorLine--;
-            } else if (file.at(virtualCursorLine).length() > 0) {
-               // within a line, just delete the caracter preceeding it
-               file.at(virtualCursorLine).erase(file.at(virtualCursorLine).begin() + virtualCursorChar - 1);
-               virtualCursorChar--;
-
-               // if this cursor is within the last subline of the line, then we can do a subline update.
-               // (Since this takes place AFTER the decrement, the 3 char gap between rt.cols takes care of possible wrap problems with a subline update.)
-               if (((virtualCursorChar % rt.cols) > 3) && ((virtualCursorChar % rt.cols) < (rt.cols - 3)) && ((file.at(virtualCursorLine).length() / rt.cols) == (virtualCursorChar / rt.cols))) updateType = UPDATE_SUBLINE;
-            }
-         } else if ((c == 10) || (c == 13)) {
-            // enter key
+         // a frame that's waiting goes first, and its timeout isn't idleness
+         int wait = frameWait();
+         if (wait >= 0) idle = wait;
+         int waited = waitForInput(buffers.loadingFd(), idle);
+         if (framePending) {
+            drawFrame();
+            if (waited == WAIT_TIMEOUT) continue;
+         }
 
-            if (virtualCursorChar == file.at(virtualCursorLine).length()) {
-               // cursor is at end of line, simply create a blank new line after it.
-               file.emplace(file.begin() + virtualCursorLine + 1, "");
-            } else {
-               // cursor is within the line, cut characters out of current line and paste them into a new line.
-               file.emplace(file.begin() + virtualCursorLine + 1, file.at(virtualCursorLine).substr(virtualCursorChar));
-               file.at(virtualCursorLine).erase(virtualCursorChar);
-            }
-            virtualCursorChar = 0;
-            virtualCursorLine++;
-         } else {
-            // emplace character at current position
-            file.at(virtualCursorLine).insert(file.at(virtualCursorLine).begin() + virtualCursorChar, c);
+         if (waited == WAIT_OTHER) collectLoaded();
+         if (edits.dirty() && ((waited == WAIT_TIMEOUT) || edits.overdue(JOURNAL_MAX_MS))) {
+            edits.sync();
+         }
+         if ((waited == WAIT_TIMEOUT) && coldPending) {
+            coldMore = coldPending = compressCold(COLD_PASS_MS);
+         }
+         if (waited == WAIT_KEY) break;
+      }
 
-            // if the cursor is within the last subline of the line, then we can do a subline update.
-            // (Since this takes place BEFORE increment, the 3 char gap between rt.cols takes care of possible wrap problems with a subline update.)
-            if (((virtualCursorChar % rt.cols) > 3) && ((virtualCursorChar % rt.cols) < (rt.cols - 3)) && (file.at(virtualCursorLine).length() / rt.cols) == (virtualCursorChar / rt.cols)) updateType = UPDATE_SUBLINE;
+      int key = getKey();
+      if (key == KEY_SPECIAL + KEY_HANGUP) hangUp();
+      recorder.record(key);
+      coldPending = coldStorage;
+      coldMore = false;
+      if (perf.active()) perf.begin();
 
-            // we added a character, so increment the cursor position
-            virtualCursorChar++;
+      requestFrame(handleKey(key));
+      int updateType = drawFrame();
+
+      if (perf.active()) {
+         perf.end(key, updateType);
+         if (perf.hudVisible()) drawHud();
+      }
+      drawProgress();
+   }
+}
+
+/**
+ * @function collectLoaded
+ * Takes in the lines loaded in the background, and draws them if they
+ * belong on the screen.
+ */
+void collectLoaded() {
+   buffer &buf = buffers.current();
+   size_t before = buf.file.size();
+
+   if (buffers.collect() && (buf.startLine + textLines > before)) {
+      requestFrame(UPDATE_ALL);
+      drawFrame();
+   }
+   drawProgress();
+
+   // compressing as it comes in keeps the lines from piling up in the first
+   // place (the pool hands the lines freed to the next batch)
+   if (coldStorage) coldMore = coldPending = compressCold(COLD_LOAD_MS);
+}
+
+/**
+ * @function compressCold
+ * Compresses the lines of every buffer that are far from its screen and
+ * cursor, for a while.
+ * @param {const int} budget - how long it can take, in milliseconds
+ * @returns {bool} true if there's more to compress.
+ */
+bool compressCold(const int budget) {
+   auto deadline = chrono::steady_clock::now() + chrono::milliseconds(budget);
+   bool more = false;
+   for (size_t i = 0; i < buffers.size(); i++) {
+      buffer &buf = buffers.at(i);
+      size_t from = min(buf.startLine, buf.virtualCursorLine);
+      size_t to = max(buf.startLine + textLines, buf.virtualCursorLine) + COLD_MARGIN;
+      from = (from > COLD_MARGIN) ? from - COLD_MARGIN : 0;
+      if (buf.file.compact(from, to, deadline)) more = true;
+   }
+   return more;
+}
+
+/**
+ * @function replayMacro
+ * Replays the last macro recorded on the current buffer, headless: no
+ * drawing, scrolling or cursor movement per key, just the edits.  Stops
+ * early if the macro runs off either end of the document (an up or down
+ * that can't move).  Replaying "to the end" also stops when a pass doesn't
+ * move to another line, and after as many passes as there were lines.
+ * @param {const size_t} times - how many times to replay it (0 to the end)
+ * @returns {size_t} how many times it was replayed in full.
+ */
+size_t replayMacro(const size_t times) {
+   buffer &buf = buffers.current();
+   const vector<int> &keys = recorder.sequence();
+   const size_t passes = times ? times : buf.file.size();
+   size_t done = 0;
+
+   headless = true;
+   for (bool stopped = false; !stopped && (done < passes); ) {
+      size_t passLine = buf.virtualCursorLine;
+      for (size_t i = 0; (i < keys.size()) && !stopped; i++) {
+         size_t line = buf.virtualCursorLine;
+         handleKey(keys[i]);
+         if (((keys[i] == KEY_SPECIAL + KEY_UP) || (keys[i] == KEY_SPECIAL + KEY_DOWN)) && (buf.virtualCursorLine == line)) {
+            stopped = true;
          }
+      }
+      if (!stopped) done++;
+      if ((times == 0) && (buf.virtualCursorLine == passLine)) stopped = true;
+   }
+   headless = false;
+   return done;
+}
+
+/**
+ * @function macroLabel
+ * @returns {string} the label for F1, which says whether a macro is being recorded.
+ */
+string macroLabel() {
+   return recorder.recording() ? "F1=Stop" : "F1=Macro";
+}
+
+/**
+ * @function requestFrame
+ * Adds what a key changed to what the next frame has to update.
+ * @param {const int} updateType - how much of the screen needs to be updated
+ */
+void requestFrame(const int updateType) {
+   if (!framePending) {
+      pendingUpdate = updateType;
+   } else if ((pendingUpdate == UPDATE_ALL) || (updateType == UPDATE_ALL)) {
+      pendingUpdate = UPDATE_ALL;
+   } else if ((pendingUpdate == UPDATE_LINE) || (updateType == UPDATE_LINE)) {
+      pendingUpdate = damageCombined ? UPDATE_LINE : UPDATE_ALL;
+   } else if ((pendingUpdate == SUGGEST_NONE) || (updateType == SUGGEST_NONE)) {
+      pendingUpdate = SUGGEST_NONE;
+   }
+   framePending = true;
+}
+
+/**
+ * @function frameWait
+ * @returns {int} how many milliseconds until the frame waiting can be drawn
+ * (or checked on again), or -1 if there isn't one.
+ */
+int frameWait() {
+   if (!framePending) return -1;
+   if (tout.busy()) return FRAME_RETRY_MS;
+
+   auto due = lastFrame + frameInterval;
+   auto now = chrono::steady_clock::now();
+   if (now >= due) return 0;
+   return (int)chrono::duration_cast<chrono::milliseconds>(due - now).count() + 1;
+}
+
+/**
+ * @function drawFrame
+ * Draws the frame waiting, unless the last one is still being written or
+ * was drawn too recently.  Keys that come in meanwhile add to it, so the
+ * frames in between are never drawn at all.
+ * @returns {int} how much of the screen was updated (UPDATE_NONE if it waits).
+ */
+int drawFrame() {
+   if (!framePending || tout.busy()) return UPDATE_NONE;
+   auto now = chrono::steady_clock::now();
+   if (now < lastFrame + frameInterval) return UPDATE_NONE;
+
+   int updateType = refresh(pendingUpdate);
+   lastFrame = now;
+   framePending = damagePending = false;
+   damageCombined = true;
+   pendingUpdate = UPDATE_NONE;
+   return updateType;
+}
+
+/**
+ * @function handleKey
+ * Applies a key to the current buffer.
+ * @param {const int} key - the key, as returned by getKey()
+ * @returns {int} how much of the screen needs to be updated.
+ */
+int handleKey(const int key) {
+   buffer &buf = buffers.current();
+   document &file = buf.file;
+   size_t &startLine = buf.startLine;
+   size_t &startCursor = buf.startCursor;
+   size_t &virtualCursorLine = buf.virtualCursorLine;
+   size_t &virtualCursorChar = buf.virtualCursorChar;
+   bool &selecting = buf.selecting;
+   textpos &anchor = buf.anchor;
+   const int c = key;
+
+   // by default, assume the whole screen has to be updated
+   int updateType = UPDATE_ALL;
+
+   if (key == KEY_TIDY) {
+      // tidy up the lines of the selection, or of the whole document
+      size_t first = 0;
+      size_t last = file.size();
+      if (selecting) {
+         textpos cursor = {virtualCursorLine, virtualCursorChar};
+         textpos from = (anchor < cursor) ? anchor : cursor;
+         textpos to = (anchor < cursor) ? cursor : anchor;
+         first = from.line;
+
+         // a selection that ends at the start of a line leaves that line out
+         last = ((to.chr == 0) && (to.line > from.line)) ? to.line : to.line + 1;
+      }
+
+      string command;
+      if (ui.prompt("Tidy: ", command) && tidy(file, first, last, command)) {
+         edits.tidied(first, last, command);
+         selecting = false;
+         virtualCursorLine = min(first, file.size() - 1);
+         virtualCursorChar = 0;
+      }
+
+      // the prompt overlapped a line in the file
+   } else if (key < KEY_SPECIAL) {
+      // typing ends the selection; take the highlight down before the text moves
+      if (selecting) {
+         selecting = false;
+         selectionStart = selectionEnd = {0, 0};
+         updateSelection(startLine, startCursor, file);
+      }
+
+      if ((c == 0x08) || (c == 0x7f)) {
+         // backspace key
+
+         if ((virtualCursorChar == 0) && (virtualCursorLine == 0)) {
+            // at the start of the very first line, do nothing
+            updateType = UPDATE_NONE;
+         } else if ((virtualCursorChar == 0) && (virtualCursorLine != 0)) {
+            // at start of a line which is not the first line, append this line to the previous line
+            edits.join(virtualCursorLine);
+            virtualCursorChar = file.at(virtualCursorLine - 1).length(); // special case to get preceeding line length
+            size_t rowsBefore = screenRows(virtualCursorChar) + screenRows(file.at(virtualCursorLine).length());
+            file.edit(virtualCursorLine - 1).append(file.at(virtualCursorLine));
+            file.erase(virtualCursorLine);
+            virtualCursorLine--;
+
+            // the rows of the line that went away close up under the joined line
+            markDamage(virtualCursorLine, virtualCursorChar, virtualCursorLine, (int)screenRows(file.at(virtualCursorLine).length()) - (int)rowsBefore);
+            updateType = UPDATE_LINE;
+         } else if (file.at(virtualCursorLine).length() > 0) {
+            // within a line, just delete the caracter preceeding it
+            size_t rowsBefore = screenRows(file.at(virtualCursorLine).length());
+            file.edit(virtualCursorLine).erase(virtualCursorChar - 1, 1);
+            edits.erase(virtualCursorLine, virtualCursorChar - 1);
+            virtualCursorChar--;
+
+            // everything from the cursor to the end of the line moved back one
+            markDamage(virtualCursorLine, virtualCursorChar, virtualCursorLine, (int)screenRows(file.at(virtualCursorLine).length()) - (int)rowsBefore);
+            updateType = UPDATE_LINE;
+         }
+      } else if ((c == 10) || (c == 13)) {
+         // enter key
+         edits.split(virtualCursorLine, virtualCursorChar);
+         size_t rowsBefore = screenRows(file.at(virtualCursorLine).length());
+
+         if (virtualCursorChar == file.at(virtualCursorLine).length()) {
+            // cursor is at end of line, simply create a blank new line after it.
+            file.insert(virtualCursorLine + 1, "");
+         } else {
+            // cursor is within the line, cut characters out of current line and paste them into a new line.
+            file.insert(virtualCursorLine + 1, file.at(virtualCursorLine).substr(virtualCursorChar));
+            file.edit(virtualCursorLine).erase(virtualCursorChar);
+         }
+
+         // the rest of the line moves down into rows opened up for it
+         size_t rowsAfter = screenRows(file.at(virtualCursorLine).length()) + screenRows(file.at(virtualCursorLine + 1).length());
+         markDamage(virtualCursorLine, virtualCursorChar, virtualCursorLine + 1, (int)rowsAfter - (int)rowsBefore);
+         updateType = UPDATE_LINE;
+
+         virtualCursorChar = 0;
+         virtualCursorLine++;
       } else {
-         int resultant = resolveEscapeSequence();
+         // emplace character at current position
+         size_t rowsBefore = screenRows(file.at(virtualCursorLine).length());
+         file.edit(virtualCursorLine).insert(virtualCursorChar, 1, c);
+         edits.insert(virtualCursorLine, virtualCursorChar, c);
 
-         if (resultant == KEY_LEFT) {
-            // Decrement the virtual cursor character position if possible
-            if (virtualCursorChar > 0) {
-               virtualCursorChar--;
-            }
+         // everything from the cursor to the end of the line moved along one
+         markDamage(virtualCursorLine, virtualCursorChar, virtualCursorLine, (int)screenRows(file.at(virtualCursorLine).length()) - (int)rowsBefore);
+         updateType = UPDATE_LINE;
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_RIGHT) {
-            // Increment the virtual cursor character position if possible
-            // can exceed length by 1 for append position
-            if (virtualCursorChar < file.at(virtualCursorLine).length()) {
-               virtualCursorChar++;
-            }
+         // we added a character, so increment the cursor position
+         virtualCursorChar++;
+      }
+   } else {
+      int resultant = key - KEY_SPECIAL;
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_UP) {
-            // decrement the virtual line position if possible
-            if (virtualCursorLine > 0) {
-               virtualCursorLine--;
-               virtualCursorChar = 0;
-            }
+      // shift+arrow starts a selection if there isn't one, then moves like an arrow
+      if ((resultant == KEY_SHIFT_LEFT) || (resultant == KEY_SHIFT_RIGHT)) {
+         if (!selecting) {
+            selecting = true;
+            anchor = {virtualCursorLine, virtualCursorChar};
+         }
+         resultant = (resultant == KEY_SHIFT_LEFT) ? KEY_LEFT : KEY_RIGHT;
+      }
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_DOWN) {
-            // increment the virtual cursor character position if possible
-            if (virtualCursorLine < (file.size() - 1)) {
-               virtualCursorLine++;
-               virtualCursorChar = 0;
-            }
+      if (resultant == KEY_LEFT) {
+         // Decrement the virtual cursor character position if possible
+         if (virtualCursorChar > 0) {
+            virtualCursorChar--;
+         }
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_HOME) {
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_RIGHT) {
+         // Increment the virtual cursor character position if possible
+         // can exceed length by 1 for append position
+         if (virtualCursorChar < file.at(virtualCursorLine).length()) {
+            virtualCursorChar++;
+         }
+
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_UP) {
+         // decrement the virtual line position if possible
+         if (virtualCursorLine > 0) {
+            virtualCursorLine--;
             virtualCursorChar = 0;
+         }
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_END) {
-            virtualCursorChar = file.at(virtualCursorLine).length();
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_DOWN) {
+         // increment the virtual cursor character position if possible
+         if (virtualCursorLine < (file.size() - 1)) {
+            virtualCursorLine++;
+            virtualCursorChar = 0;
+         }
 
-            // Nothing has changed, so suggest no display update (scroll routine will have final say)
-            updateType = SUGGEST_NONE;
-         } else if (resultant == KEY_F8) {
-            // exit
-            rt.resetTerminal();
-            exit(0);
-         } else if (resultant == KEY_F3) {
-            // save file
-
-            // prompt for file name
-            rt.moveCursor(rt.lines - 2, 0);
-            cout << setw(rt.cols) << left << "Save to: ";
-            rt.moveCursor(rt.lines - 2, 9);
-
-            // loop for file name
-            string filename = "";
-            while (true) {
-               c = getch();
-               
-               if (c && c != LITERAL_KEY_ESCAPE) {
-                  if ((c == 0x08) || (c == 0x7f)) {
-                     if (filename.length() > 0) {
-                        filename.pop_back();
-                        cout << (char)0x08 << ' ' << (char)0x08;
-                     }
-                  } else if ((c == 10) || (c == 13)) {
-                     // open the file and write to it!
-                     std::ofstream outfile;
-                     outfile.open(filename, ios_base::trunc);
-                     for (size_t i = 0; i < file.size(); i++) {
-                        outfile << file.at(i) << endl;
-                     }
-                     outfile.close();
-                     break;
-                  } else {
-                     filename.push_back(c);
-                     cout << (char)c;
-                  }
-               } else {
-                  resultant = resolveEscapeSequence();
-                  if (resultant == KEY_F8) {
-                     // cancel the save
-                     break;
-                  }
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_HOME) {
+         virtualCursorChar = 0;
+
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_END) {
+         virtualCursorChar = file.at(virtualCursorLine).length();
+
+         // Nothing has changed, so suggest no display update (scroll routine will have final say)
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_F1) {
+         // start or stop recording a macro, or replay the last one
+         updateType = SUGGEST_NONE;
+         if (recorder.recording()) {
+            recorder.stop();
+         } else if (recorder.empty()) {
+            recorder.start();
+         } else {
+            string times;
+            if (ui.prompt("Repeat (* to the end, blank records): ", times)) {
+               if (times.empty()) {
+                  recorder.start();
+               } else if ((times == "*") || (atol(times.c_str()) > 0)) {
+                  replayMacro((times == "*") ? 0 : atol(times.c_str()));
                }
             }
 
-            // We overlapped a line in the file
+            // the prompt overlapped a line in the file
             updateType = UPDATE_ALL;
          }
-      }
+      } else if (resultant == KEY_F7) {
+         // toggle selection, starting from the cursor
+         selecting = !selecting;
+         anchor = {virtualCursorLine, virtualCursorChar};
 
-      // Ensure that the virtualCursorLine is within range of startLine
+         // only the highlight changes
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_F5) {
+         // copy the selection (only references to the lines are kept)
+         if (selecting) {
+            textpos cursor = {virtualCursorLine, virtualCursorChar};
+            textpos from = (anchor < cursor) ? anchor : cursor;
+            textpos to = (anchor < cursor) ? cursor : anchor;
+            if (from != to) {
+               clip.copy(file, from, to);
+               edits.copy(from, to);
+            }
+            selecting = false;
+         }
 
-      // top bound
-      if (virtualCursorLine < startLine) {
-         startLine = virtualCursorLine;
+         // only the highlight changes
+         updateType = SUGGEST_NONE;
+      } else if (resultant == KEY_F6) {
+         // cut the selection
+         if (selecting) {
+            textpos cursor = {virtualCursorLine, virtualCursorChar};
+            textpos from = (anchor < cursor) ? anchor : cursor;
+            textpos to = (anchor < cursor) ? cursor : anchor;
+            selecting = false;
 
-         // need to scroll
-         if (updateType == SUGGEST_NONE) updateType = UPDATE_ALL;
-      }
+            if (from != to) {
+               // the highlight goes away with the text
+               selectionStart = selectionEnd = shownSelectionStart = shownSelectionEnd = {0, 0};
+               clip.cut(file, from, to);
+               edits.cut(from, to);
+               virtualCursorLine = from.line;
+               virtualCursorChar = from.chr;
+            } else {
+               updateType = SUGGEST_NONE;
+            }
+         } else {
+            updateType = SUGGEST_NONE;
+         }
+      } else if (resultant == KEY_F4) {
+         // paste at the cursor
+         if (selecting) {
+            selecting = false;
+            selectionStart = selectionEnd = {0, 0};
+            updateSelection(startLine, startCursor, file);
+         }
 
-      // bottom bound
-      size_t screen_lines_from_top = 0;
-      for (size_t i = virtualCursorLine; i >= startLine; i--) {
-         if (i == virtualCursorLine) {
-            screen_lines_from_top += ((virtualCursorChar != rt.cols) ? 1 : 0) + (virtualCursorChar / (rt.cols));
+         if (clip.empty()) {
+            updateType = SUGGEST_NONE;
          } else {
-            screen_lines_from_top += ((file.at(i).length() != rt.cols) ? 1 : 0) + (file.at(i).length() / (rt.cols));
+            edits.paste({virtualCursorLine, virtualCursorChar}, clip);
+            textpos end = clip.paste(file, {virtualCursorLine, virtualCursorChar});
+            virtualCursorLine = end.line;
+            virtualCursorChar = end.chr;
          }
+      } else if (resultant == KEY_F2) {
+         // load a file into a new buffer, or switch to it if it's already open
+         string filename;
+         if (ui.prompt("Load: ", filename) && !filename.empty()) {
+            size_t existing = buffers.find(filename);
+            if (existing < buffers.size()) {
+               buffers.select(existing);
+               edits.switched(existing);
+            } else {
+               edits.opened(filename, buffers.add(filename, true).file);
+            }
+         }
+
+         // either way, the prompt overlapped a line in the file
+      } else if (resultant == KEY_F10) {
+         // next buffer; only what's on screen gets drawn
+         if (buffers.size() > 1) {
+            buffers.select((buffers.index() + 1) % buffers.size());
+            edits.switched(buffers.index());
+         } else {
+            updateType = SUGGEST_NONE;
+         }
+      } else if (resultant == KEY_F9) {
+         // performance HUD, drawn just above the function labels
+         perf.toggleHud();
+         setTextLines(rt.lines - (perf.hudVisible() ? 2 : 1));
+      } else if (resultant == KEY_F8) {
+         // exit (on purpose, so there is nothing to recover)
+         edits.discard();
+         buffers.rememberPositions();
+         rt.resetTerminal();
+         exit(0);
+      } else if (resultant == KEY_F3) {
+         // save file; a save that fails asks again (F8 gives up)
+         string filename = buf.filename;
+         string label = "Save to: ";
+         while (ui.prompt(label, filename)) {
+            // a file still loading has to be all there before it's written
+            buffers.finishLoading();
 
-         // check for too far
-         if ((screen_lines_from_top) >= (rt.lines - 1)) {
-            startLine = i;
-            startCursor = ((screen_lines_from_top) - (rt.lines - 1)) * rt.cols;
+            if (file.save(filename)) {
+               buffers.dropIndex(buf, filename);
+               buf.filename = filename;
+               buf.savedRevision = file.revision;
+               buf.highlight.choose(filename, file);
 
-            // need to scroll
-            if (updateType == SUGGEST_NONE) updateType = UPDATE_ALL;
-            break;
+               // the journal only needs what happens after this
+               edits.rebase(buffers, clip);
+               break;
+            }
+            label = "Couldn't save. Save to: ";
          }
 
-         // exit before it wraps around if startLine is 0
-         if (i == 0) break;
+         // We overlapped a line in the file
+         updateType = UPDATE_ALL;
       }
+   }
+
+   return updateType;
+}
 
-      // accept update suggestion if they got through the filter
-      if (updateType == SUGGEST_NONE) updateType = UPDATE_NONE;
+/**
+ * @function refresh
+ * Brings the screen up to date with the current buffer after a key.
+ * @param {int} updateType - how much of the screen needs to be updated
+ * @returns {int} how much of the screen was updated in the end.
+ */
+int refresh(int updateType) {
+   buffer &buf = buffers.current();
+   const document &file = buf.file;
+   size_t &startLine = buf.startLine;
+   size_t &startCursor = buf.startCursor;
+   const size_t &virtualCursorLine = buf.virtualCursorLine;
+   const size_t &virtualCursorChar = buf.virtualCursorChar;
+   const bool &selecting = buf.selecting;
+   const textpos &anchor = buf.anchor;
 
-      // adjust for when editing a long line
-      if (virtualCursorChar > rt.cols) {
-         screen_lines_from_top -= (virtualCursorChar / rt.cols) + 1;
+   // damage is relative to what's on screen, so scrolling means starting over
+   size_t shownStartLine = startLine;
+   size_t shownStartCursor = startCursor;
+
+   // work out what should be highlighted now that the cursor has moved
+   if (selecting) {
+      textpos cursor = {virtualCursorLine, virtualCursorChar};
+      selectionStart = (anchor < cursor) ? anchor : cursor;
+      selectionEnd = (anchor < cursor) ? cursor : anchor;
+   } else {
+      selectionStart = selectionEnd = {0, 0};
+   }
+
+   // Ensure that the virtualCursorLine is within range of startLine
+
+   // top bound
+   if (virtualCursorLine < startLine) {
+      startLine = virtualCursorLine;
+      startCursor = 0;
+
+      // need to scroll
+      if (updateType == SUGGEST_NONE) updateType = UPDATE_ALL;
+   }
+
+   // bottom bound
+   size_t screen_lines_from_top = 0;
+   for (size_t i = virtualCursorLine; i >= startLine; i--) {
+      if (i == virtualCursorLine) {
+         screen_lines_from_top += ((virtualCursorChar != rt.cols) ? 1 : 0) + (virtualCursorChar / (rt.cols));
       } else {
-         screen_lines_from_top--;
+         screen_lines_from_top += ((file.at(i).length() != rt.cols) ? 1 : 0) + (file.at(i).length() / (rt.cols));
       }
 
-      // this shouldn't be necessary but I'm trying to get it ready to commit (just let it work)
-      if (startCursor != 0) {
-         screen_lines_from_top -= (startCursor / rt.cols);
+      // check for too far
+      if ((screen_lines_from_top) >= textLines) {
+         startLine = i;
+         startCursor = ((screen_lines_from_top) - textLines) * rt.cols;
+
+         // need to scroll
+         if (updateType == SUGGEST_NONE) updateType = UPDATE_ALL;
+         break;
       }
-      
-      // determine what, if anything, needs to be updated
-      if (updateType == UPDATE_ALL) {
-         // redisplay the file with changes
-         updateDisplay(startLine, startCursor, file);
-      } else if (updateType == UPDATE_SUBLINE) {
-         // update just the line of the virtual cursor
-         updateLine(screen_lines_from_top, virtualCursorLine, virtualCursorChar, file);
-      } else if (updateType == UPDATE_NONE) {
-         // update nothing
+
+      // exit before it wraps around if startLine is 0
+      if (i == 0) break;
+   }
+
+   // accept update suggestion if they got through the filter
+   if (updateType == SUGGEST_NONE) updateType = UPDATE_NONE;
+
+   // damage is only tracked for a screen that starts with a whole line and didn't scroll
+   if ((updateType == UPDATE_LINE) && ((startLine != shownStartLine) || (startCursor != shownStartCursor) || (startCursor != 0))) {
+      updateType = UPDATE_ALL;
+   }
+
+   // catch the highlighting up with the edits; they can recolor lines past the damage
+   size_t recolorTo = HIGHLIGHT_UNCHANGED;
+   if (useColor && !file.empty()) {
+      recolorTo = buf.highlight.refresh(buf.file, min(startLine + textLines, file.size() - 1));
+   }
+   if ((updateType == UPDATE_NONE) && (recolorTo != HIGHLIGHT_UNCHANGED)) updateType = UPDATE_ALL;
+
+   // adjust for when editing a long line
+   if (virtualCursorChar > rt.cols) {
+      screen_lines_from_top -= (virtualCursorChar / rt.cols) + 1;
+   } else {
+      screen_lines_from_top--;
+   }
+
+   // this shouldn't be necessary but I'm trying to get it ready to commit (just let it work)
+   if (startCursor != 0) {
+      screen_lines_from_top -= (startCursor / rt.cols);
+   }
+   
+   // determine what, if anything, needs to be updated
+   if (updateType == UPDATE_ALL) {
+      // redisplay the file with changes
+      updateDisplay(startLine, startCursor, file);
+   } else if (updateType == UPDATE_LINE) {
+      // update just what the edit changed
+      updateDamage(startLine, file, recolorTo);
+   } else if (updateType == UPDATE_NONE) {
+      // update nothing
+   }
+
+   // repaint whatever part of the selection highlight changed (if any)
+   if (updateType != UPDATE_ALL) {
+      updateSelection(startLine, startCursor, file);
+   }
+
+   // the prompt and the labels are drawn in the default color
+   rt.foreground(COLOR_DEFAULT);
+
+   // place the cursor at the proper location
+   rt.moveCursor(screen_lines_from_top + (virtualCursorChar / rt.cols), virtualCursorChar % rt.cols);
+
+   return updateType;
+}
+
+/**
+ * @function setTextLines
+ * Sets how many rows of the screen are used for text, and makes those rows
+ * the scroll region so inserting and deleting lines leaves the rest alone.
+ * As a side effect, destroys cursor location.
+ * @param {size_t} lines - the number of rows for text
+ */
+void setTextLines(const size_t lines) {
+   textLines = lines;
+   rt.changeScrollRegion(0, textLines - 1);
+}
+
+/**
+ * @function markDamage
+ * Records what an edit changed, for UPDATE_LINE.
+ * @param {size_t} line - the line the change starts on
+ * @param {size_t} chr - the first character that changed
+ * @param {size_t} lastLine - the last line that changed (to its end)
+ * @param {int} shift - how many screen rows the lines after lastLine moved down
+ */
+void markDamage(const size_t &line, const size_t &chr, const size_t &lastLine, const int &shift) {
+   // a replay is drawn in full at the end
+   if (headless) return;
+
+   // more changes to the same line before a frame is drawn add up; anything
+   // else has to be drawn in full
+   if (damagePending) {
+      if ((line == damageFrom.line) && (lastLine == damageTo) && (shift == 0) && (damageShift == 0)) {
+         damageFrom.chr = min(damageFrom.chr, chr);
+         return;
       }
+      damageCombined = false;
+   }
+   damagePending = true;
 
-      // place the cursor at the proper location
-      rt.moveCursor(screen_lines_from_top + (virtualCursorChar / rt.cols), virtualCursorChar % rt.cols);
+   damageFrom = {line, chr};
+   damageTo = lastLine;
+   damageShift = shift;
+}
+
+/**
+ * @function openJournal
+ * Finds this session a journal in the working directory: .text.swp, or
+ * .text-1.swp and on when other sessions here hold those.  A journal that no
+ * session holds and that has something in it was left by one that crashed,
+ * and is taken first, so that it gets replayed.
+ * @returns {bool} true if a journal was opened.
+ */
+bool openJournal() {
+   for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < JOURNAL_SESSIONS; i++) {
+         string name = (i == 0) ? ".text.swp" : ".text-" + to_string(i) + ".swp";
+         struct stat info;
+         bool leftBehind = (stat(name.c_str(), &info) == 0) && (info.st_size > 0);
+         if ((pass == 0) && !leftBehind) continue;
+         if (edits.open(name)) return true;
+      }
    }
+   return false;
+}
+
+/**
+ * @function hangUp
+ * Exits once the terminal has gone away (or SIGHUP or SIGTERM came in),
+ * syncing the journal first, so that the next session recovers every key
+ * typed and not just those typed before the keyboard last went quiet.
+ */
+void hangUp() {
+   edits.sync();
+   buffers.rememberPositions();
+   rt.resetTerminal();
+   exit(1);
+}
+
+/**
+ * @function screenRows
+ * @param {size_t} length - the length of a line
+ * @returns {size_t} how many rows of the screen the line takes up.
+ */
+size_t screenRows(const size_t &length) {
+   return (length == 0) ? 1 : (length + rt.cols - 1) / rt.cols;
 }
 
 /**
@@ -281,22 +940,125 @@ int main(void) {
  * As a side effect, destroys cursor location.
  * @param {size_t} startLine - the line of the file to start from
  * @param {size_t} startCursor - the character of the line of the file to start from
- * @param {vector<string>} file - the file to display
+ * @param {document} file - the file to display
  */
-void updateDisplay(const size_t &startLine, const size_t &startCursor, const vector<string> &file) {
-   // ostringstream was causing a memory leak.  Reverted to cout and no bliting.
+void updateDisplay(const size_t &startLine, const size_t &startCursor, const document &file) {
+   // tout collects the whole frame and writes it in one go
+   rt.hideCursor();
+   updateRows(startLine, startCursor, file, 0, 0, textLines);
+   rt.showCursor();
+
+   // everything on screen matches the selection now
+   shownSelectionStart = selectionStart;
+   shownSelectionEnd = selectionEnd;
+}
+
+/**
+ * @function updateDamage
+ * Repaints what the last edit changed (see markDamage) and nothing else.
+ * If the lines after it moved, the terminal moves them with insert or
+ * delete line, and only the rows that scrolls into view get painted.
+ * Lines after the damage that the highlighter recolored (up to recolorTo)
+ * get painted as well.
+ * Expects the screen to start at the beginning of startLine.
+ * As a side effect, destroys cursor location.
+ * @param {size_t} startLine - the line of the file at the top of the screen
+ * @param {document} file - the file being displayed
+ * @param {size_t} recolorTo - the last line whose colors changed, or HIGHLIGHT_UNCHANGED
+ */
+void updateDamage(const size_t &startLine, const document &file, const size_t &recolorTo) {
+   if (damageFrom.line < startLine) {
+      updateDisplay(startLine, 0, file);
+      return;
+   }
+
+   // the rows the damaged lines take up now: [top, end), which may run off the bottom
+   size_t top = 0;
+   for (size_t i = startLine; (i < damageFrom.line) && (top < textLines); i++) {
+      top += screenRows(file.at(i).length());
+   }
+   if (top >= textLines) return;
+
+   size_t end = top;
+   for (size_t i = damageFrom.line; i <= damageTo; i++) {
+      end += screenRows(file.at(i).length());
+   }
+
+   // move whatever was below the damage to where it is now
+   size_t exposed = textLines; // rows from here down have to be painted too
+   size_t shift = abs(damageShift);
+   if (damageShift > 0) {
+      // the rows below moved down; they used to start at end - shift
+      if (!rt.canEditLines()) {
+         exposed = end;
+      } else if (end - shift < textLines) {
+         rt.moveCursor(end - shift, 0);
+         rt.insertLines(shift);
+      }
+   } else if ((damageShift < 0) && (end < textLines)) {
+      // the rows below moved up, which brings new ones in at the bottom
+      if (!rt.canEditLines()) {
+         exposed = end;
+      } else {
+         rt.moveCursor(end, 0);
+         rt.deleteLines(shift);
+         exposed = max(end, textLines - min(shift, textLines));
+      }
+   }
+
+   // the damage starts partway through a row of the first damaged line,
+   // or at the row after it if the change was right at the end of a full row;
+   // with colors, the characters before it may have changed too (typing the
+   // last letter of a keyword, say), so the whole line is painted
+   size_t firstRow = damageFrom.chr / rt.cols;
+   size_t firstCol = damageFrom.chr % rt.cols;
+   if (useColor && buffers.current().highlight.active()) {
+      firstRow = firstCol = 0;
+   } else if (firstRow >= screenRows(file.at(damageFrom.line).length())) {
+      firstRow = screenRows(file.at(damageFrom.line).length());
+      firstCol = 0;
+   }
+   updateRows(startLine, 0, file, top + firstRow, firstCol, min(end, textLines));
+
+   // an edit like opening a comment changes the colors of the lines after it
+   if ((recolorTo != HIGHLIGHT_UNCHANGED) && (recolorTo > damageTo) && (end < exposed)) {
+      size_t recolorEnd = end;
+      for (size_t i = damageTo + 1; (i <= recolorTo) && (i < file.size()) && (recolorEnd < exposed); i++) {
+         recolorEnd += screenRows(file.at(i).length());
+      }
+      updateRows(startLine, 0, file, end, 0, min(recolorEnd, exposed));
+   }
+   updateRows(startLine, 0, file, exposed, 0, textLines);
+}
+
+/**
+ * @function updateRows
+ * Repaints the rows [firstRow, endRow) of the screen, starting at column
+ * firstCol on the first one.
+ * As a side effect, destroys cursor location.
+ * @param {size_t} startLine - the line of the file at the top of the screen
+ * @param {size_t} startCursor - the character of that line at the top of the screen
+ * @param {document} file - the file being displayed
+ * @param {size_t} firstRow - the first row to paint
+ * @param {size_t} firstCol - where to start on the first row
+ * @param {size_t} endRow - one past the last row to paint
+ */
+void updateRows(const size_t &startLine, const size_t &startCursor, const document &file, const size_t &firstRow, const size_t &firstCol, const size_t &endRow) {
+   if (firstRow >= endRow) return;
+   rt.moveCursor(firstRow, firstCol);
+
    size_t curScreenLine = 0;
-   size_t curFileLine = 0;
+   size_t curFileLine = startLine;
    size_t timesOnLine = startCursor / rt.cols;
-   rt.hideCursor();
-   rt.moveCursor(0,0);
 
-   for (; (curScreenLine < (rt.lines - 1)) && ((curFileLine + startLine) < file.size()); curScreenLine++) {
-      // print the next line of text
-      cout << setw(rt.cols) << left << file.at(startLine + curFileLine).substr(timesOnLine * rt.cols, rt.cols);
+   for (; (curScreenLine < endRow) && (curFileLine < file.size()); curScreenLine++) {
+      // print the next line of text, if it's one we're painting
+      if (curScreenLine >= firstRow) {
+         printRow(file, curFileLine, timesOnLine * rt.cols, (curScreenLine == firstRow) ? firstCol : 0);
+      }
 
       // check if we need to stay on this file line for the next screen line
-      if ((file.at(startLine + curFileLine).length() - (timesOnLine * rt.cols)) > rt.cols) {
+      if ((file.at(curFileLine).length() - (timesOnLine * rt.cols)) > rt.cols) {
          timesOnLine++;
       } else {
          // we're done with this file line
@@ -306,32 +1068,429 @@ void updateDisplay(const size_t &startLine, const size_t &startCursor, const vec
    }
 
    // handle screen area after the file ends
-   string blankline (rt.cols, ' ');
-   for (; curScreenLine < (rt.lines - 1); curScreenLine++) {
-      cout << blankline;
+   for (; curScreenLine < endRow; curScreenLine++) {
+      if (curScreenLine >= firstRow) {
+         tout.spaces(rt.cols - ((curScreenLine == firstRow) ? firstCol : 0));
+      }
    }
-   
-   rt.showCursor();
-
 }
 
 /**
- * @function updateLine
+ * @function updateSelection
+ * Repaints only the characters whose highlight differs between the selection
+ * on screen and the current one.  Everything else is left alone.
  * As a side effect, destroys cursor location.
- * @param {size_t} screen_lines_from_top - the line on the screen to update
- * @param {size_t} virtualCursorLine - the line of the file to use as reference
- * @param {size_t} virtualCursorChar - the character of the line that the cursor is at
- * @param {vector<string>} file - the file to display
+ * @param {size_t} startLine - the line of the file at the top of the screen
+ * @param {size_t} startCursor - the character of that line at the top of the screen
+ * @param {document} file - the file being displayed
  */
-void updateLine(const size_t &screen_lines_from_top, const size_t &virtualCursorLine, const size_t &virtualCursorChar, vector<string> &file) {
-   // move to the start of the line
-   rt.moveCursor(screen_lines_from_top + (virtualCursorChar / rt.cols), 0);
-   
-   cout << setw(rt.cols) << left << file.at(virtualCursorLine).substr((virtualCursorChar / rt.cols) * rt.cols, rt.cols);
+void updateSelection(const size_t &startLine, const size_t &startCursor, const document &file) {
+   if (headless) return;
+   if ((selectionStart == shownSelectionStart) && (selectionEnd == shownSelectionEnd)) return;
+
+   // The characters that changed are covered by (at most) two ranges:
+   // between the two starts and between the two ends.  An empty selection
+   // changes exactly the other one.
+   textpos changed[2][2];
+   size_t nChanged = 0;
+   bool shownEmpty = !(shownSelectionStart < shownSelectionEnd);
+   bool currentEmpty = !(selectionStart < selectionEnd);
+   if (shownEmpty || currentEmpty) {
+      changed[0][0] = shownEmpty ? selectionStart : shownSelectionStart;
+      changed[0][1] = shownEmpty ? selectionEnd : shownSelectionEnd;
+      nChanged = 1;
+   } else {
+      changed[0][0] = min(selectionStart, shownSelectionStart);
+      changed[0][1] = max(selectionStart, shownSelectionStart);
+      changed[1][0] = min(selectionEnd, shownSelectionEnd);
+      changed[1][1] = max(selectionEnd, shownSelectionEnd);
+      nChanged = 2;
+   }
+
+   // walk the screen the same way updateDisplay does
+   size_t curScreenLine = 0;
+   size_t curFileLine = startLine;
+   size_t timesOnLine = startCursor / rt.cols;
+   for (; (curScreenLine < textLines) && (curFileLine < file.size()); curScreenLine++) {
+      const string &text = file.at(curFileLine);
+      size_t rowBegin = timesOnLine * rt.cols;
+      size_t rowEnd = min(text.length(), rowBegin + rt.cols);
+
+      for (size_t i = 0; i < nChanged; i++) {
+         size_t begin, end;
+         if (spanOnLine(changed[i][0], changed[i][1], curFileLine, text.length(), begin, end)) {
+            begin = max(begin, rowBegin);
+            end = min(end, rowEnd);
+            if (begin < end) {
+               rt.moveCursor(curScreenLine, begin - rowBegin);
+               printSpan(text, curFileLine, begin, end);
+            }
+         }
+      }
+
+      if ((text.length() - rowBegin) > rt.cols) {
+         timesOnLine++;
+      } else {
+         timesOnLine = 0;
+         curFileLine++;
+      }
+   }
+
+   shownSelectionStart = selectionStart;
+   shownSelectionEnd = selectionEnd;
+}
+
+/**
+ * @function printRow
+ * Prints one screen row of a line from column col on, padded to the width
+ * of the terminal, with the selected part (if any) reversed.
+ * @param {document} file - the file being displayed
+ * @param {size_t} line - the line of the file to print from
+ * @param {size_t} offset - the character of the line that starts the row
+ * @param {size_t} col - the column of the row to start at
+ */
+void printRow(const document &file, const size_t &line, const size_t &offset, const size_t &col) {
+   const string &text = file.at(line);
+   size_t rowBegin = min(text.length(), offset + col);
+   size_t rowEnd = min(text.length(), offset + rt.cols);
+   size_t width = rt.cols - col;
+
+   size_t begin, end;
+   if (spanOnLine(selectionStart, selectionEnd, line, text.length(), begin, end) && (begin < rowEnd) && (end > rowBegin)) {
+      printSpan(text, line, rowBegin, rowEnd);
+   } else {
+      printColored(text, line, rowBegin, rowEnd);
+   }
+   if ((rowEnd - rowBegin) < width) tout.spaces(width - (rowEnd - rowBegin));
+}
+
+/**
+ * @function printSpan
+ * Prints the characters [begin, end) of a line at the current cursor
+ * position, reversing whichever of them are selected.
+ * @param {string} text - the text of the line
+ * @param {size_t} line - the index of the line in the file
+ * @param {size_t} begin - the first character to print
+ * @param {size_t} end - one past the last character to print
+ */
+void printSpan(const string &text, const size_t &line, const size_t &begin, const size_t &end) {
+   size_t selBegin, selEnd;
+   if (!spanOnLine(selectionStart, selectionEnd, line, text.length(), selBegin, selEnd)) {
+      selBegin = selEnd = end;
+   }
+   selBegin = min(max(selBegin, begin), end);
+   selEnd = min(max(selEnd, selBegin), end);
+
+   printColored(text, line, begin, selBegin);
+   if (selBegin < selEnd) {
+      // the selection is reversed without any colors
+      rt.foreground(COLOR_DEFAULT);
+      rt.reverse();
+      tout.write(text.data() + selBegin, selEnd - selBegin);
+      rt.resetAttributes();
+   }
+   printColored(text, line, selEnd, end);
+}
+
+/**
+ * @function printColored
+ * Prints the characters [begin, end) of a line at the current cursor
+ * position in the colors of the highlighter.  The color is only changed
+ * where it has to be; spaces go out in whatever color is already set.
+ * @param {string} text - the text of the line
+ * @param {size_t} line - the index of the line in the file
+ * @param {size_t} begin - the first character to print
+ * @param {size_t} end - one past the last character to print
+ */
+void printColored(const string &text, const size_t &line, const size_t &begin, const size_t &end) {
+   buffer &buf = buffers.current();
+   if (!useColor || !buf.highlight.active() || (begin >= end)) {
+      tout.write(text.data() + begin, end - begin);
+      return;
+   }
+
+   const unsigned char* classes = buf.highlight.classes(buf.file, line);
+   for (size_t run = begin; run < end; ) {
+      size_t next = run + 1;
+      if (text[run] == ' ') {
+         while ((next < end) && (text[next] == ' ')) next++;
+      } else {
+         int color = syntaxColors[classes[run]];
+         while ((next < end) && ((syntaxColors[classes[next]] == color) || (text[next] == ' '))) next++;
+         rt.foreground(color);
+      }
+      tout.write(text.data() + run, next - run);
+      run = next;
+   }
+}
+
+/**
+ * @function spanOnLine
+ * Finds which characters of a line fall within [from, to).
+ * @param {textpos} from - the start of the range
+ * @param {textpos} to - the end of the range
+ * @param {size_t} line - the line to check
+ * @param {size_t} length - the length of that line
+ * @param {size_t} begin - set to the first character in the range
+ * @param {size_t} end - set to one past the last character in the range
+ * @returns {bool} true if any character of the line is in the range.
+ */
+bool spanOnLine(const textpos &from, const textpos &to, const size_t &line, const size_t &length, size_t &begin, size_t &end) {
+   if (!(from < to) || (line < from.line) || (line > to.line)) return false;
+   begin = (line == from.line) ? from.chr : 0;
+   end = (line == to.line) ? to.chr : length;
+   return begin < end;
+}
+
+/**
+ * @function drawHud
+ * Draws the numbers of the last frame on the line above the function labels.
+ * Leaves the cursor where it was.
+ */
+void drawHud() {
+   static const char* updateNames[] = { "none", "all", "line" };
+
+   string hud = " key " + toDecimal(perf.lastLatency, 2) + "ms"
+      + "  p99 " + toDecimal(perf.p99(), 2) + "ms"
+      + "  " + to_string(perf.lastBytes) + "B/frame"
+      + "  update " + (perf.lastUpdate < 3 ? updateNames[perf.lastUpdate] : "?")
+      + "  rss " + to_string(perf.rss()) + "K";
+   if (coldStorage) {
+      // how well the current buffer compresses, and how long scrolling into
+      // a compressed block took
+      const coldstats &cold = buffers.current().file.coldStats();
+      hud += "  z " + toDecimal(cold.packedBytes ? (double)cold.rawBytes / cold.packedBytes : 0, 1) + "x"
+         + " thaw " + toDecimal(cold.lastThaw * 1000, 2) + "ms"
+         + " (max " + toDecimal(cold.maxThaw * 1000, 2) + ")";
+   }
+
+   rt.saveCursor();
+   rt.moveCursor(rt.lines - 2, 0);
+   tout << rt.getReverse() << padRight(hud.substr(0, rt.cols), rt.cols) << rt.getResetAttributes();
+   rt.restoreCursor();
+   tout.flush();
+}
+
+/**
+ * @function drawProgress
+ * Shows how much of the current buffer's file has been loaded, in place of
+ * the F1 label, while it's loading in the background.
+ * Leaves the cursor where it was.
+ */
+void drawProgress() {
+   static string shown;
+   buffer &buf = buffers.current();
+   string label = buf.loading ? to_string(buf.loading->percent()) + "%" : macroLabel();
+   if (label == shown) return;
+   shown = label;
+
+   rt.saveCursor();
+   rt.moveCursor(rt.lines - 1, 0);
+   tout << padRight((" " + label).substr(0, rt.cols / 8 - 1), rt.cols / 8 - 1);
+   rt.restoreCursor();
 }
 
 void drawFunctionLabels() {
    //ui.drawFunctionLabels("F1=Find", "F2=Load", "F3=Save", "", "F5=Copy", "F6=Cut", "F7=Select", "F8=Exit");
-   ui.drawFunctionLabels("", "", "F3=Save", "", "", "", "", "F8=Exit");
+   ui.drawFunctionLabels(macroLabel(), "F2=Load", "F3=Save", "F4=Paste", "F5=Copy", "F6=Cut", "F7=Select", "F8=Exit");
 }
 
+
+/**
+ * @function page
+ * The read only pager.  While following, new lines are scrolled in at the
+ * bottom of the text rows as they arrive; moving back (up, page up, home)
+ * or F7 stops that, and End or F7 goes back to following.  Only the newest
+ * lines are kept, so memory stays the same however much comes through.
+ * @param {follower&} source - where the lines come from
+ * @param {size_t} capacity - how many lines to keep
+ * @returns {int} the exit status.
+ */
+int page(follower &source, const size_t capacity) {
+   linering ring(capacity);
+   bool following = true;
+   bool repaint = true;
+   bool ended = source.done();
+   size_t top = 0; // the line at the top of the screen, when not following
+   size_t shownEnd = 0; // one past the last line on screen, when following
+   size_t usedRows = 0; // how many rows from the top have text, when following
+
+   rt.clear();
+   setTextLines(rt.lines - 1);
+   rt.hideCursor();
+   pageLabels(following, ended);
+   source.read(ring);
+
+   while (true) {
+      if (following) {
+         // rows the new lines need, as far as a screenful
+         size_t newRows = 0;
+         for (size_t i = max(shownEnd, ring.first()); (i < ring.end()) && (newRows <= textLines); i++) {
+            newRows += screenRows(ring.at(i).length());
+         }
+
+         if (repaint || (shownEnd < ring.first()) || (newRows > textLines) || ((newRows > 0) && !rt.canScroll())) {
+            // too much to scroll in, so draw the newest screenful
+            top = pageTop(ring);
+            pageRows(ring, top, 0, textLines);
+            usedRows = 0;
+            for (size_t i = top; (i < ring.end()) && (usedRows < textLines); i++) {
+               usedRows += screenRows(ring.at(i).length());
+            }
+            usedRows = min(usedRows, textLines);
+         } else {
+            // scroll the text rows up for each row of the new lines
+            for (size_t i = shownEnd; i < ring.end(); i++) {
+               const string &text = ring.at(i);
+               for (size_t offset = 0; (offset == 0) || (offset < text.length()); offset += rt.cols) {
+                  if (usedRows < textLines) {
+                     rt.moveCursor(usedRows++, 0);
+                  } else {
+                     rt.moveCursor(textLines - 1, 0);
+                     tout << '\n';
+                  }
+                  tout.write(text.data() + offset, min(rt.cols, text.length() - offset));
+               }
+            }
+         }
+         shownEnd = ring.end();
+      } else if (repaint) {
+         pageRows(ring, top, 0, textLines);
+      }
+      repaint = false;
+
+      if (source.done() != ended) {
+         ended = source.done();
+         pageLabels(following, ended);
+      }
+
+      if (waitForInput(source.waitFd(), source.timeout()) == WAIT_KEY) {
+         int key = getKey() - KEY_SPECIAL;
+         bool wasFollowing = following;
+
+         // lines that were dropped while paused can't be shown any more
+         if (!following && (top < ring.first())) {
+            top = ring.first();
+            repaint = true;
+         }
+
+         // leaving follow mode starts from the newest screenful
+         if (following && ((key == KEY_UP) || (key == KEY_PGUP) || (key == KEY_HOME) || (key == KEY_F7))) {
+            following = false;
+            top = pageTop(ring);
+            repaint = true;
+         }
+
+         if ((key == KEY_F8) || (key == KEY_HANGUP)) {
+            rt.resetTerminal();
+            return 0;
+         } else if (key == KEY_UP) {
+            if (top > ring.first()) {
+               top--;
+               size_t rows = screenRows(ring.at(top).length());
+               if (!repaint && rt.canEditLines() && (rows < textLines)) {
+                  // push what's on screen down and draw only the new line
+                  rt.moveCursor(0, 0);
+                  rt.insertLines(rows);
+                  pageRows(ring, top, 0, rows);
+               } else {
+                  repaint = true;
+               }
+            }
+         } else if (key == KEY_DOWN) {
+            if (following) {
+               // already at the bottom
+            } else if (top < pageTop(ring)) {
+               size_t rows = screenRows(ring.at(top).length());
+               top++;
+               if (!repaint && rt.canEditLines() && (rows < textLines)) {
+                  // pull what's on screen up and draw only the rows that come in
+                  rt.moveCursor(0, 0);
+                  rt.deleteLines(rows);
+                  pageRows(ring, top, textLines - rows, textLines);
+               } else {
+                  repaint = true;
+               }
+            } else {
+               following = true;
+               repaint = true;
+            }
+         } else if (key == KEY_PGUP) {
+            top = max(ring.first(), (top > textLines) ? top - textLines : 0);
+            repaint = true;
+         } else if ((key == KEY_PGDN) && !following) {
+            top += textLines;
+            if (top >= pageTop(ring)) following = true;
+            repaint = true;
+         } else if (key == KEY_HOME) {
+            top = ring.first();
+            repaint = true;
+         } else if ((key == KEY_END) || ((key == KEY_F7) && (wasFollowing == following))) {
+            following = true;
+            repaint = true;
+         }
+
+         if (following != wasFollowing) pageLabels(following, ended);
+      }
+
+      source.read(ring);
+   }
+}
+
+/**
+ * @function pageTop
+ * @param {linering} ring - the lines kept
+ * @returns {size_t} the first line of the newest screenful.
+ */
+size_t pageTop(const linering &ring) {
+   size_t top = ring.end();
+   size_t rows = 0;
+   while (top > ring.first()) {
+      rows += screenRows(ring.at(top - 1).length());
+      if ((rows > textLines) && (top < ring.end())) break;
+      top--;
+   }
+   return top;
+}
+
+/**
+ * @function pageRows
+ * Paints the rows [firstRow, endRow) of the pager, with line top at the top.
+ * As a side effect, destroys cursor location.
+ * @param {linering} ring - the lines kept
+ * @param {size_t} top - the line at the top of the screen
+ * @param {size_t} firstRow - the first row to paint
+ * @param {size_t} endRow - one past the last row to paint
+ */
+void pageRows(const linering &ring, const size_t &top, const size_t &firstRow, const size_t &endRow) {
+   size_t row = 0;
+   for (size_t line = top; (line < ring.end()) && (row < endRow); line++) {
+      const string &text = ring.at(line);
+      for (size_t offset = 0; ((offset == 0) || (offset < text.length())) && (row < endRow); offset += rt.cols, row++) {
+         if (row >= firstRow) {
+            size_t length = min(rt.cols, text.length() - offset);
+            rt.moveCursor(row, 0);
+            tout.write(text.data() + offset, length);
+            if (length < rt.cols) tout.spaces(rt.cols - length);
+         }
+      }
+   }
+
+   // past the newest line
+   for (; row < endRow; row++) {
+      if (row >= firstRow) {
+         rt.moveCursor(row, 0);
+         tout.spaces(rt.cols);
+      }
+   }
+}
+
+/**
+ * @function pageLabels
+ * Draws the function labels of the pager.
+ * @param {bool} following - true if new lines are being scrolled in
+ * @param {bool} ended - true if nothing more is coming
+ */
+void pageLabels(const bool following, const bool ended) {
+   ui.drawFunctionLabels(ended ? "(end)" : "     ", "", "", "", "", "", following ? "F7=Pause " : "F7=Follow", "F8=Exit");
+}